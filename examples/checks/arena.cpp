@@ -0,0 +1,155 @@
+/*
+ * arena.cpp
+ *
+ * Checks reuse of intermediate buffers through the frame arena. Objects
+ * that share buffers across frames must draw the same images as objects
+ * with buffers of their own, the pool must hold only the buffers of the
+ * last few frames, and buffers must go back to the pool when their owner
+ * is gone.
+ */
+#include "check.hpp"
+#include <vector>
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		thrender::shaders::default_fg_shader> pipeline_type;
+
+//! Buffer whose memory can be observed
+struct test_buffer {
+
+	std::vector<int> values;
+
+	void shrink_to_fit() {
+		values.shrink_to_fit();
+	}
+};
+
+//! Draw two objects on a context of their own
+void draw_reference(pipeline_type & pp, checks::mesh_type & first, checks::mesh_type & second,
+		thrender::camera & cam, thrender::framebuffer_array & fb) {
+	thrender::render_context ctx(cam, fb);
+	fb.clear_all();
+	pp.draw(first, ctx);
+	pp.draw(second, ctx);
+}
+
+int main() {
+
+	thrender::framebuffer_array fb(320, 240), reference_ab(320, 240), reference_cb(320, 240);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context ctx(cam, fb);
+
+	thrender::shaders::default_vx_shader vx_shader;
+	thrender::shaders::default_fg_shader fg_shader;
+	pipeline_type pp(vx_shader, fg_shader);
+	vx_shader.mvp_mat = glm::scale(glm::mat4(1.0f), glm::vec3(3.0f, 3.0f, 1.0f));
+
+	// Objects of different sizes, two of them drawn per frame
+	checks::mesh_type a = checks::random_triangles(50, 0.3f, 1),
+		b = checks::random_triangles(300, 0.3f, 2),
+		c = checks::random_triangles(120, 0.3f, 3);
+	draw_reference(pp, a, b, cam, reference_ab);
+	draw_reference(pp, c, b, cam, reference_cb);
+	CHECK(!checks::same_image(reference_ab, reference_cb));
+
+	typedef checks::mesh_type::intermediate_buffer_type buffer_type;
+	const buffer_type * steady = 0;
+	for(size_t frame = 0;frame < 6;frame++) {
+		checks::mesh_type & first = frame % 2 ? c : a;
+		fb.clear_all();
+		pp.draw(first, ctx);
+		pp.draw(b, ctx);
+		CHECK(checks::same_image(fb, frame % 2 ? reference_cb : reference_ab));
+
+		// The object drawn on every frame keeps its buffer
+		if (frame == 0)
+			steady = &b.intermediate_buffer();
+		CHECK(&b.intermediate_buffer() == steady);
+		ctx.end_frame();
+	}
+	CHECK(ctx.arena.pool<buffer_type>()->slots.size() == 2);
+
+	// If the frame does not end, objects do not share buffers
+	fb.clear_all();
+	pp.draw(c, ctx);
+	const buffer_type * kept = &c.intermediate_buffer();
+	pp.draw(a, ctx);
+	pp.draw(b, ctx);
+	CHECK(&c.intermediate_buffer() == kept);
+	CHECK(&a.intermediate_buffer() != kept && &b.intermediate_buffer() != kept);
+	CHECK(&a.intermediate_buffer() != &b.intermediate_buffer());
+
+	// Buffers of the pool
+	thrender::frame_arena reopened;
+	thrender::arena_buffer<test_buffer> outliving;
+	std::shared_ptr<thrender::details::arena_pool<test_buffer> > closed;
+	{
+		thrender::frame_arena arena;
+		std::shared_ptr<thrender::details::arena_pool<test_buffer> > pool = arena.pool<test_buffer>();
+
+		// A destroyed owner gives back its buffer
+		const test_buffer * given_back;
+		{
+			thrender::arena_buffer<test_buffer> owner;
+			CHECK(!owner.acquire(arena));
+			CHECK(owner.is_acquired());
+			(*owner).values.resize(1000);
+			given_back = &*owner;
+		}
+		thrender::arena_buffer<test_buffer> second;
+		second.acquire(arena);
+		CHECK(&*second == given_back && pool->slots.size() == 1);
+
+		// Buffers are valid for one frame, and kept by their owner
+		// shrunk to what it uses
+		(*second).values.resize(10);
+		arena.reset();
+		CHECK(!second.is_acquired());
+		CHECK((*pool->slots[0].buffer).values.capacity() == 10);
+		CHECK(second.acquire(arena));
+		CHECK((*second).values.size() == 10);
+
+		// Buffers idle for idle_frames frames are freed, so the pool
+		// holds only the buffers of the last few frames
+		arena.idle_frames = 2;
+		outliving.acquire(arena);
+		(*outliving).values.resize(20);
+		arena.reset();
+		second.acquire(arena);
+		arena.reset();
+		CHECK(pool->slots.size() == 2 && pool->slots[1].buffer);
+		CHECK(outliving.acquire(arena));
+		CHECK((*outliving).values.size() == 20);
+		arena.reset();
+		arena.reset();
+		CHECK(!pool->slots[0].buffer && pool->slots[1].buffer);
+
+		// Idle buffers are given out first, taking them from their owner
+		thrender::arena_buffer<test_buffer> third;
+		third.acquire(arena);
+		CHECK(&*third == pool->slots[1].buffer.get());
+		CHECK(!outliving.acquire(arena));
+		CHECK(pool->slots.size() == 2);
+		for(size_t frame = 0;frame <= arena.idle_frames;frame++)
+			arena.reset();
+		CHECK(!pool->slots[0].buffer && !pool->slots[1].buffer);
+
+		// Copies do not share buffers
+		thrender::arena_buffer<test_buffer> copy = third;
+		CHECK(!copy.is_acquired());
+
+		// Clearing the arena closes its pools
+		third.acquire(arena);
+		closed = pool;
+		arena.clear();
+		CHECK(closed->closed && closed->slots.empty());
+		CHECK(!third.is_acquired());
+		CHECK(!third.acquire(arena));
+		CHECK(third.is_acquired() && arena.pool<test_buffer>() != closed);
+	}
+	CHECK(!outliving.is_acquired());
+	CHECK(!outliving.acquire(reopened));
+	CHECK(outliving.is_acquired());
+
+	return checks::result();
+}
@@ -0,0 +1,130 @@
+/*
+ * batch.cpp
+ *
+ * Checks drawing objects in a batch. Drawing a batch must give the same
+ * image as drawing its objects one by one in the order they were added,
+ * on both vertex shading paths, with the uniforms of each object reaching
+ * its vertices and fragments only, also after objects change.
+ */
+#include "check.hpp"
+
+//! Fragment shader that scales colors by a value of the uniforms
+struct uniforms_fg_shader {
+
+	template<class RenderableType>
+	void operator()(thrender::framebuffer_array & fb, const thrender::fragment_processing_control<RenderableType> & api) {
+		float scale = 1.0f + api.template instance<thrender::shaders::instance_transform>().model_mat[3][2];
+		FB_PIXEL(fb.color_buffer()) = INTERPOLATE(thrender::COLOR) * scale;
+	}
+};
+
+//! Fragment shader that scales colors by a uniform
+struct uniform_fg_shader {
+
+	float scale;
+
+	template<class RenderableType>
+	void operator()(thrender::framebuffer_array & fb, const thrender::fragment_processing_control<RenderableType> & api) {
+		FB_PIXEL(fb.color_buffer()) = INTERPOLATE(thrender::COLOR) * scale;
+	}
+};
+
+//! Instanced vertex shader without the packet operator
+struct scalar_instanced_vx_shader : public thrender::shaders::instanced_vx_shader {
+
+	typedef thrender::shaders::instanced_vx_shader base_type;
+
+	template<class RenderableType>
+	void operator()(const typename RenderableType::vertex_type & vin, typename RenderableType::vertex_type & vout,
+			thrender::vertex_processing_control<RenderableType> & vcontrol) {
+		base_type::operator()(vin, vout, vcontrol);
+	}
+};
+
+//! Draw every object of a list, one by one
+void draw_separate(checks::mesh_type * meshes, const thrender::shaders::instance_transform * uniforms, size_t count,
+		const glm::mat4 & vp_mat, thrender::render_context & ctx) {
+	thrender::shaders::default_vx_shader vx_shader;
+	uniform_fg_shader fg_shader;
+	thrender::pipeline<checks::mesh_type, thrender::shaders::default_vx_shader, uniform_fg_shader> pp(vx_shader, fg_shader);
+	ctx.fb.clear_all();
+	for(size_t i = 0;i < count;i++) {
+		vx_shader.mvp_mat = vp_mat * uniforms[i].model_mat;
+		fg_shader.scale = 1.0f + uniforms[i].model_mat[3][2];
+		pp.draw(meshes[i], ctx);
+	}
+}
+
+//! Draw a batch with one call
+template<class VertexShader>
+void draw_batch(thrender::render_batch<checks::mesh_type> & batch, thrender::render_context & ctx) {
+	VertexShader vx_shader;
+	uniforms_fg_shader fg_shader;
+	thrender::pipeline<checks::mesh_type, VertexShader, uniforms_fg_shader> pp(vx_shader, fg_shader);
+	ctx.fb.clear_all();
+	pp.draw_batch(batch, ctx);
+}
+
+int main() {
+
+	thrender::framebuffer_array separate(320, 240), batched(320, 240);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context separate_ctx(cam, separate), batched_ctx(cam, batched);
+	glm::mat4 vp_mat = cam.projection_mat * cam.view_mat;
+
+	// Objects of different sizes, none a whole number of packets,
+	// overlapping each other
+	const size_t count = 4;
+	checks::mesh_type meshes[count] = {
+			checks::random_triangles(101, 0.3f, 41),
+			checks::random_triangles(7, 0.6f, 42),
+			checks::random_triangles(233, 0.2f, 43),
+			checks::random_triangles(1, 0.9f, 44)};
+	thrender::shaders::instance_transform uniforms[count];
+	thrender::render_batch<checks::mesh_type> batch;
+	for(size_t i = 0;i < count;i++) {
+		for(size_t v = 0;v < meshes[i].vertices.size();v++) {
+			glm::vec4 & pos = VA_ATTRIBUTE(meshes[i].vertices[v], thrender::POSITION);
+			pos.x *= 3.0f;
+			pos.y *= 3.0f;
+		}
+		meshes[i].data_updated();
+		uniforms[i].model_mat = glm::translate(glm::mat4(1.0f), glm::vec3(0.8f * i - 1.2f, 0.3f * i, 0.1f * i));
+		uniforms[i].update(vp_mat);
+		batch.add(meshes[i], &uniforms[i]);
+	}
+
+	draw_separate(meshes, uniforms, count, vp_mat, separate_ctx);
+	CHECK(checks::covered_pixels(separate) > 0);
+
+	draw_batch<thrender::shaders::instanced_vx_shader>(batch, batched_ctx);
+	CHECK(batch.intermediate_buffer().draws.size() == count);
+	CHECK(checks::same_image(separate, batched));
+
+	draw_batch<scalar_instanced_vx_shader>(batch, batched_ctx);
+	CHECK(checks::same_image(separate, batched));
+
+	// Changed vertices are read on the next draw, changed elements
+	// rebuild the buffers
+	for(size_t v = 0;v < meshes[2].vertices.size();v++)
+		VA_ATTRIBUTE(meshes[2].vertices[v], thrender::POSITION).y -= 0.5f;
+	meshes[2].vertices_updated(0, meshes[2].vertices.size());
+	meshes[0].element_indices[0] = thrender::indices3_t(0, 2, 1);
+	meshes[0].elements_updated(0, 1);
+	draw_separate(meshes, uniforms, count, vp_mat, separate_ctx);
+	draw_batch<thrender::shaders::instanced_vx_shader>(batch, batched_ctx);
+	CHECK(checks::same_image(separate, batched));
+
+	// Removing objects rebuilds the buffers
+	batch.clear();
+	batch.add(meshes[3], &uniforms[3]);
+	batch.add(meshes[1], &uniforms[1]);
+	checks::mesh_type reordered[2] = {meshes[3], meshes[1]};
+	thrender::shaders::instance_transform reordered_uniforms[2] = {uniforms[3], uniforms[1]};
+	draw_separate(reordered, reordered_uniforms, 2, vp_mat, separate_ctx);
+	draw_batch<thrender::shaders::instanced_vx_shader>(batch, batched_ctx);
+	CHECK(batch.intermediate_buffer().draws.size() == 2);
+	CHECK(checks::same_image(separate, batched));
+
+	return checks::result();
+}
@@ -0,0 +1,118 @@
+/*
+ * binning.cpp
+ *
+ * Checks that tile binned rasterization gives the image of serial
+ * rasterization on every run, and that primitives are rasterized in
+ * submission order inside every tile they overlap.
+ */
+#include "check.hpp"
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		thrender::shaders::default_fg_shader> pipeline_type;
+
+//! Copy one triangle of a mesh in a mesh of its own
+checks::mesh_type triangle_of(const checks::mesh_type & mesh, size_t element) {
+	checks::mesh_type m(3, 1);
+	for(size_t v = 0;v < 3;v++)
+		m.vertices[v] = mesh.vertices[mesh.element_indices[element][v]];
+	m.element_indices[0] = thrender::indices3_t(0, 1, 2);
+	m.data_updated();
+	return m;
+}
+
+//! Generate nested rectangles at the same depth, in one mesh
+/**
+ * Rectangle k is inset by k/8 of the viewport on every side, so its
+ * edges lie on pixel boundaries of a 320x240 framebuffer.
+ */
+checks::mesh_type nested_rectangles(size_t count) {
+	checks::mesh_type m(count * 4, count * 2);
+	for(size_t k = 0;k < count;k++) {
+		float inset = k * 0.25f;
+		glm::vec4 color(float(k) / count, 1.0f - float(k) / count, 0.5f, 1.0f);
+		glm::vec4 corners[4] = {
+			glm::vec4(-1.0f + inset, -1.0f + inset, 0.5f, 1.0f),
+			glm::vec4(1.0f - inset, -1.0f + inset, 0.5f, 1.0f),
+			glm::vec4(1.0f - inset, 1.0f - inset, 0.5f, 1.0f),
+			glm::vec4(-1.0f + inset, 1.0f - inset, 0.5f, 1.0f) };
+		for(size_t v = 0;v < 4;v++) {
+			VA_ATTRIBUTE(m.vertices[k*4 + v], thrender::POSITION) = corners[v];
+			VA_ATTRIBUTE(m.vertices[k*4 + v], thrender::COLOR) = color;
+		}
+		m.element_indices[k*2] = thrender::indices3_t(k*4, k*4 + 1, k*4 + 2);
+		m.element_indices[k*2 + 1] = thrender::indices3_t(k*4, k*4 + 2, k*4 + 3);
+	}
+	m.data_updated();
+	return m;
+}
+
+int main() {
+
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::shaders::default_vx_shader vx_shader;
+	thrender::shaders::default_fg_shader fg_shader;
+	vx_shader.mvp_mat = glm::mat4(1.0f);
+	pipeline_type pp(vx_shader, fg_shader);
+
+	// The same triangles give the same image, on any context
+	checks::mesh_type mesh = checks::random_triangles(3000, 0.2f, 1);
+	thrender::framebuffer_array first(320, 240), second(320, 240);
+	thrender::render_context first_ctx(cam, first), second_ctx(cam, second);
+	first.clear_all();
+	pp.draw(mesh, first_ctx);
+	for(size_t run = 0;run < 3;run++) {
+		second.clear_all();
+		pp.draw(mesh, second_ctx);
+		CHECK(checks::same_image(first, second));
+	}
+	CHECK(checks::covered_pixels(first) > 320 * 240 / 2);
+
+	// Drawing one triangle at a time rasterizes serially, in
+	// submission order, and gives the same image
+	second.clear_all();
+	for(size_t e = 0;e < mesh.element_indices.size();e++) {
+		checks::mesh_type single = triangle_of(mesh, e);
+		pp.draw(single, second_ctx);
+	}
+	CHECK(checks::same_image(first, second));
+
+	// Of two primitives at the same depth, the last one submitted wins
+	// on every tile. Edges of the front one lie on pixel boundaries.
+	checks::mesh_type back = checks::rectangle(-1.0f, -1.0f, 1.0f, 1.0f, 0.5f, glm::vec4(1, 0, 0, 1));
+	checks::mesh_type front = checks::rectangle(-0.75f, -0.75f, 0.75f, 0.75f, 0.5f, glm::vec4(0, 1, 0, 1));
+	first.clear_all();
+	pp.draw(back, first_ctx);
+	pp.draw(front, first_ctx);
+	size_t wrong = 0;
+	for(size_t y = 0;y < 240;y++) {
+		for(size_t x = 0;x < 320;x++) {
+			bool inside = x >= 40 && x < 280 && y >= 30 && y < 210;
+			const glm::vec4 & c = first.color_buffer()[y][x];
+			if (inside != (c.g > 0.99f && c.r < 0.01f))
+				wrong++;
+		}
+	}
+	CHECK(wrong == 0);
+
+	// The same holds between primitives of one draw, that overlap
+	// on many tiles
+	const size_t rectangles = 4;
+	checks::mesh_type nested = nested_rectangles(rectangles);
+	first.clear_all();
+	pp.draw(nested, first_ctx);
+	wrong = 0;
+	for(size_t y = 0;y < 240;y++) {
+		for(size_t x = 0;x < 320;x++) {
+			size_t k = 0;
+			while(k + 1 < rectangles && x >= 40 * (k + 1) && x < 320 - 40 * (k + 1) && y >= 30 * (k + 1) && y < 240 - 30 * (k + 1))
+				k++;
+			glm::vec4 difference = first.color_buffer()[y][x] - glm::vec4(float(k) / rectangles, 1.0f - float(k) / rectangles, 0.5f, 1.0f);
+			if (glm::dot(difference, difference) > 1e-10f)
+				wrong++;
+		}
+	}
+	CHECK(wrong == 0);
+
+	return checks::result();
+}
@@ -0,0 +1,184 @@
+/*
+ * check.hpp
+ *
+ * Helpers shared by the deterministic checks of the pipeline. Every
+ * check renders offscreen, compares buffers or counts exactly and
+ * returns non zero if anything failed, so that it can run in ctest.
+ */
+#pragma once
+
+#include <glm/glm.hpp>
+#include <thrust/host_vector.h>
+#include <cmath>
+#include <iostream>
+
+#include "thrender/thrender.hpp"
+
+//! Report a failed condition and count it
+#define CHECK(condition) \
+	checks::verify((condition), #condition, __FILE__, __LINE__)
+
+namespace checks {
+
+	typedef thrender::renderable<thrust::tuple<
+			glm::vec4,
+			glm::vec4,
+			glm::vec4,
+			glm::vec2> > mesh_type;
+
+	//! Number of failed conditions
+	inline size_t & failures() {
+		static size_t count = 0;
+		return count;
+	}
+
+	//! Count a condition that failed
+	inline void verify(bool condition, const char * expression, const char * file, int line) {
+		if (condition)
+			return;
+		std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+		failures()++;
+	}
+
+	//! Exit code of the check program
+	inline int result() {
+		if (failures())
+			std::cerr << failures() << " check(s) failed" << std::endl;
+		return failures() ? 1 : 0;
+	}
+
+	//! Pseudo random numbers, the same on every platform
+	struct random {
+
+		unsigned state;
+
+		explicit random(unsigned seed)
+		:
+			state(seed)
+		{}
+
+		//! Get a number in [lo, hi)
+		float uniform(float lo, float hi) {
+			state = state * 1664525u + 1013904223u;
+			return lo + (hi - lo) * float(state >> 8) / float(1u << 24);
+		}
+	};
+
+	//! Generate a mesh of random triangles inside the NDC cube
+	/**
+	 * Every vertex of a triangle has one of the primary colors.
+	 */
+	inline mesh_type random_triangles(size_t total_triangles, float max_edge, unsigned seed,
+			float z_min = -0.9f, float z_max = 0.9f) {
+		mesh_type m(total_triangles * 3, total_triangles);
+		random rng(seed);
+		for(size_t i = 0;i < total_triangles;i++) {
+			glm::vec4 center(rng.uniform(-1.0f, 1.0f), rng.uniform(-1.0f, 1.0f), rng.uniform(z_min, z_max), 1.0f);
+			for(size_t v = 0;v < 3;v++) {
+				glm::vec4 pos = center + glm::vec4(rng.uniform(-max_edge, max_edge), rng.uniform(-max_edge, max_edge), 0.0f, 0.0f);
+				pos.x = glm::clamp(pos.x, -0.99f, 0.99f);
+				pos.y = glm::clamp(pos.y, -0.99f, 0.99f);
+				VA_ATTRIBUTE(m.vertices[i*3 + v], thrender::POSITION) = pos;
+				VA_ATTRIBUTE(m.vertices[i*3 + v], thrender::COLOR) = glm::vec4(v == 0, v == 1, v == 2, 1.0f);
+			}
+			m.element_indices[i] = thrender::indices3_t(i*3, i*3 + 1, i*3 + 2);
+		}
+		m.data_updated();
+		return m;
+	}
+
+	//! Generate a rectangle of one color, from two front facing triangles
+	/**
+	 * Corners are given in NDC, at the same depth.
+	 */
+	inline mesh_type rectangle(float left, float top, float right, float bottom, float z, const glm::vec4 & color) {
+		mesh_type m(4, 2);
+		VA_ATTRIBUTE(m.vertices[0], thrender::POSITION) = glm::vec4(left, top, z, 1.0f);
+		VA_ATTRIBUTE(m.vertices[1], thrender::POSITION) = glm::vec4(right, top, z, 1.0f);
+		VA_ATTRIBUTE(m.vertices[2], thrender::POSITION) = glm::vec4(right, bottom, z, 1.0f);
+		VA_ATTRIBUTE(m.vertices[3], thrender::POSITION) = glm::vec4(left, bottom, z, 1.0f);
+		for(size_t v = 0;v < 4;v++)
+			VA_ATTRIBUTE(m.vertices[v], thrender::COLOR) = color;
+		m.element_indices[0] = thrender::indices3_t(0, 1, 2);
+		m.element_indices[1] = thrender::indices3_t(0, 2, 3);
+		m.data_updated();
+		return m;
+	}
+
+	//! Generate a sphere of radius 3 around the origin
+	/**
+	 * Elements are front facing, seen from outside.
+	 */
+	inline mesh_type sphere(size_t segments) {
+		const float pi = 3.14159265f;
+		mesh_type m((segments + 1) * (segments + 1), segments * segments * 2);
+		for(size_t i = 0;i <= segments;i++) {
+			for(size_t j = 0;j <= segments;j++) {
+				float theta = pi * i / segments, phi = 2 * pi * j / segments;
+				size_t v = i * (segments + 1) + j;
+				VA_ATTRIBUTE(m.vertices[v], thrender::POSITION) = glm::vec4(
+						3 * std::sin(theta) * std::cos(phi), 3 * std::sin(theta) * std::sin(phi), 3 * std::cos(theta), 1.0f);
+				VA_ATTRIBUTE(m.vertices[v], thrender::COLOR) = glm::vec4(float(i) / segments, float(j) / segments, 0.3f, 1.0f);
+			}
+		}
+		size_t e = 0;
+		for(size_t i = 0;i < segments;i++) {
+			for(size_t j = 0;j < segments;j++) {
+				size_t a = i * (segments + 1) + j, b = a + segments + 1;
+				m.element_indices[e++] = thrender::indices3_t(a, b, a + 1);
+				m.element_indices[e++] = thrender::indices3_t(a + 1, b, b + 1);
+			}
+		}
+		m.data_updated();
+		return m;
+	}
+
+	//! Generate a grid of quads on a plane of constant z
+	inline mesh_type grid(size_t quads, float size, float z) {
+		mesh_type m((quads + 1) * (quads + 1), quads * quads * 2);
+		for(size_t y = 0;y <= quads;y++) {
+			for(size_t x = 0;x <= quads;x++) {
+				size_t v = y * (quads + 1) + x;
+				VA_ATTRIBUTE(m.vertices[v], thrender::POSITION) = glm::vec4(
+						size * (float(x) / quads - 0.5f), size * (float(y) / quads - 0.5f), z, 1.0f);
+				VA_ATTRIBUTE(m.vertices[v], thrender::COLOR) = glm::vec4(float(x) / quads, float(y) / quads, 0.5f, 1.0f);
+			}
+		}
+		size_t e = 0;
+		for(size_t y = 0;y < quads;y++) {
+			for(size_t x = 0;x < quads;x++) {
+				size_t a = y * (quads + 1) + x;
+				m.element_indices[e++] = thrender::indices3_t(a, a + 1, a + quads + 2);
+				m.element_indices[e++] = thrender::indices3_t(a, a + quads + 2, a + quads + 1);
+			}
+		}
+		m.data_updated();
+		return m;
+	}
+
+	//! Check if two framebuffers hold exactly the same colors and depths
+	inline bool same_image(thrender::framebuffer_array & a, thrender::framebuffer_array & b) {
+		if (a.width() != b.width() || a.height() != b.height())
+			return false;
+		for(size_t y = 0;y < a.height();y++) {
+			for(size_t x = 0;x < a.width();x++) {
+				if (a.color_buffer()[y][x] != b.color_buffer()[y][x]
+					|| a.depth_buffer()[y][x] != b.depth_buffer()[y][x])
+					return false;
+			}
+		}
+		return true;
+	}
+
+	//! Count the pixels whose depth was written
+	inline size_t covered_pixels(thrender::framebuffer_array & fb) {
+		size_t covered = 0;
+		for(size_t y = 0;y < fb.height();y++) {
+			for(size_t x = 0;x < fb.width();x++) {
+				if (fb.depth_buffer()[y][x] != thrender::default_depth_clear_value)
+					covered++;
+			}
+		}
+		return covered;
+	}
+}
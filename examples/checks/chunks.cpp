@@ -0,0 +1,107 @@
+/*
+ * chunks.cpp
+ *
+ * Checks chunked geometry processing. Processing vertices and setting
+ * up elements chunk by chunk must give the same processed vertices,
+ * visible elements and image as processing them all at once, for any
+ * chunk size, also for vertices that no element references.
+ */
+#include "check.hpp"
+#include <vector>
+
+//! Vertex shader without the packet operator
+struct scalar_vx_shader : public thrender::shaders::default_vx_shader {
+
+	typedef thrender::shaders::default_vx_shader base_type;
+
+	template<class RenderableType>
+	void operator()(const typename RenderableType::vertex_type & vin, typename RenderableType::vertex_type & vout,
+			thrender::vertex_processing_control<RenderableType> & vcontrol) {
+		base_type::operator()(vin, vout, vcontrol);
+	}
+};
+
+//! Check that two objects have the same output of geometry processing
+bool same_geometry(const checks::mesh_type & a, const checks::mesh_type & b) {
+	const checks::mesh_type::intermediate_buffer_type & ia = a.intermediate_buffer(), & ib = b.intermediate_buffer();
+	if (ia.total_vertices() != ib.total_vertices())
+		return false;
+	for(size_t d = 0;d < ia.draws.size();d++) {
+		for(size_t v = 0;v < a.vertices.size();v++) {
+			size_t id = ia.draws[d].first_vertex + v;
+			if (ia.processed_vertices.attribute<thrender::POSITION>(id) != ib.processed_vertices.attribute<thrender::POSITION>(id)
+				|| ia.processed_vertices.attribute<thrender::COLOR>(id) != ib.processed_vertices.attribute<thrender::COLOR>(id)
+				|| ia.discarded_vertices[id] != ib.discarded_vertices[id]
+				|| ia.clip_codes[id] != ib.clip_codes[id])
+				return false;
+		}
+	}
+	return std::vector<thrender::primitive_id_t>(ia.visible_elements.begin(), ia.visible_elements.end())
+		== std::vector<thrender::primitive_id_t>(ib.visible_elements.begin(), ib.visible_elements.end())
+		&& ia.clipped_elements.size() == ib.clipped_elements.size();
+}
+
+//! Draw an object with and without chunks, and compare the outputs
+template<class VertexShader>
+void check_chunks(VertexShader & vx_shader, checks::mesh_type & mesh, const thrender::shaders::instance_transform * instances,
+		size_t count, thrender::render_context & whole_ctx, thrender::render_context & chunked_ctx) {
+	thrender::shaders::default_fg_shader fg_shader;
+	thrender::pipeline<checks::mesh_type, VertexShader, thrender::shaders::default_fg_shader> pp(vx_shader, fg_shader);
+	checks::mesh_type chunked = mesh;
+
+	whole_ctx.fb.clear_all();
+	if (instances)
+		pp.draw_instanced(mesh, instances, count, whole_ctx);
+	else
+		pp.draw(mesh, whole_ctx);
+	CHECK(checks::covered_pixels(whole_ctx.fb) > 0);
+
+	const size_t sizes[] = {1, 7, 64, 100000};
+	for(size_t s = 0;s < sizeof(sizes) / sizeof(sizes[0]);s++) {
+		pp.chunk_size = sizes[s];
+		chunked_ctx.fb.clear_all();
+		if (instances)
+			pp.draw_instanced(chunked, instances, count, chunked_ctx);
+		else
+			pp.draw(chunked, chunked_ctx);
+		CHECK(same_geometry(mesh, chunked));
+		CHECK(checks::same_image(whole_ctx.fb, chunked_ctx.fb));
+	}
+}
+
+int main() {
+
+	thrender::framebuffer_array whole(320, 240), chunked(320, 240);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context whole_ctx(cam, whole), chunked_ctx(cam, chunked);
+
+	// Triangles in submission order of their vertices, some of them
+	// clipped, followed by vertices that no element references
+	checks::mesh_type triangles = checks::random_triangles(300, 0.3f, 51, -1.4f, 0.9f);
+	const size_t unreferenced = 21;
+	checks::mesh_type mesh(triangles.vertices.size() + unreferenced, triangles.element_indices.size());
+	for(size_t v = 0;v < mesh.vertices.size();v++)
+		mesh.vertices[v] = triangles.vertices[v % triangles.vertices.size()];
+	for(size_t e = 0;e < mesh.element_indices.size();e++)
+		mesh.element_indices[e] = triangles.element_indices[e];
+	mesh.data_updated();
+
+	thrender::shaders::default_vx_shader packet_shader;
+	scalar_vx_shader scalar_shader;
+	packet_shader.mvp_mat = scalar_shader.mvp_mat = glm::mat4(1.0f);
+	check_chunks(packet_shader, mesh, 0, 0, whole_ctx, chunked_ctx);
+	check_chunks(scalar_shader, mesh, 0, 0, whole_ctx, chunked_ctx);
+
+	// Many draws, whose vertices are padded to whole packets
+	glm::mat4 vp_mat(1.0f);
+	const size_t count = 3;
+	thrender::shaders::instance_transform instances[count];
+	for(size_t i = 0;i < count;i++) {
+		instances[i].model_mat = glm::translate(glm::mat4(1.0f), glm::vec3(0.3f * i - 0.3f, 0.2f * i, 0.0f));
+		instances[i].update(vp_mat);
+	}
+	thrender::shaders::instanced_vx_shader instanced_shader;
+	check_chunks(instanced_shader, mesh, instances, count, whole_ctx, chunked_ctx);
+
+	return checks::result();
+}
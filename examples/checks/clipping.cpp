@@ -0,0 +1,131 @@
+/*
+ * clipping.cpp
+ *
+ * Checks clipping against the view volume and the guard band. Clipped
+ * primitives must cover exactly the pixels of their visible part, with
+ * depth inside the depth range, and nothing outside of the viewport.
+ */
+#include "check.hpp"
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		thrender::shaders::default_fg_shader> pipeline_type;
+
+//! Check if a point is inside a counter clockwise triangle, farther than margin from its edges
+bool is_inside(const glm::vec2 * triangle, const glm::vec2 & p, float margin) {
+	for(size_t i = 0;i < 3;i++) {
+		glm::vec2 a = triangle[i], b = triangle[(i + 1) % 3];
+		glm::vec2 edge = b - a;
+		float distance = (edge.x * (p.y - a.y) - edge.y * (p.x - a.x)) / std::sqrt(edge.x * edge.x + edge.y * edge.y);
+		if (distance < margin)
+			return false;
+	}
+	return true;
+}
+
+int main() {
+
+	const size_t width = 320, height = 240;
+	thrender::framebuffer_array gbuff(width, height);
+	thrender::camera cam(glm::vec3(0, 2, -10), 45, 4.0f / 3.0f, 1, 50);
+	thrender::render_context ctx(cam, gbuff);
+
+	thrender::shaders::default_vx_shader vx_shader;
+	thrender::shaders::default_fg_shader fg_shader;
+	pipeline_type pp(vx_shader, fg_shader);
+
+	// Ground plane that crosses the near and far planes. It covers
+	// whole rows from the bottom of the view up to the far plane.
+	const float extent = 1000.0f;
+	checks::mesh_type ground(4, 2);
+	VA_ATTRIBUTE(ground.vertices[0], thrender::POSITION) = glm::vec4(-extent, 0, -extent, 1);
+	VA_ATTRIBUTE(ground.vertices[1], thrender::POSITION) = glm::vec4(extent, 0, -extent, 1);
+	VA_ATTRIBUTE(ground.vertices[2], thrender::POSITION) = glm::vec4(extent, 0, extent, 1);
+	VA_ATTRIBUTE(ground.vertices[3], thrender::POSITION) = glm::vec4(-extent, 0, extent, 1);
+	for(size_t v = 0;v < 4;v++)
+		VA_ATTRIBUTE(ground.vertices[v], thrender::COLOR) = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f);
+	ground.element_indices[0] = thrender::indices3_t(0, 1, 2);
+	ground.element_indices[1] = thrender::indices3_t(0, 2, 3);
+	ground.data_updated();
+	vx_shader.mvp_mat = cam.projection_mat * cam.view_mat;
+
+	const thrender::interpolation_mode modes[2] = {thrender::interpolation_mode::linear, thrender::interpolation_mode::perspective};
+	for(size_t m = 0;m < 2;m++) {
+		ctx.interpolation = modes[m];
+		gbuff.clear_all();
+		pp.draw(ground, ctx);
+		CHECK(!ground.intermediate_buffer().clipped_elements.empty());
+
+		size_t covered_rows = 0, partial_rows = 0, out_of_range = 0;
+		for(size_t y = 0;y < height;y++) {
+			size_t covered = 0;
+			for(size_t x = 0;x < width;x++) {
+				thrender::depth_pixel_t z = gbuff.depth_buffer()[y][x];
+				if (z == thrender::default_depth_clear_value)
+					continue;
+				covered++;
+				if (z < 0.0f || z > 1.0f)
+					out_of_range++;
+			}
+			if (covered == width && covered_rows == y)
+				covered_rows++;
+			else if (covered)
+				partial_rows++;
+		}
+		CHECK(covered_rows > 0 && covered_rows < height);
+		CHECK(partial_rows == 0);
+		CHECK(out_of_range == 0);
+	}
+
+	// Nothing is drawn outside of the viewport
+	ctx.interpolation = thrender::interpolation_mode::linear;
+	ctx.vp = thrender::viewport(100, 60, 120, 100);
+	gbuff.clear_all();
+	pp.draw(ground, ctx);
+	size_t outside = 0;
+	for(size_t y = 0;y < height;y++) {
+		for(size_t x = 0;x < width;x++) {
+			bool in_viewport = x >= 100 && x < 220 && y >= 60 && y < 160;
+			if (!in_viewport && gbuff.depth_buffer()[y][x] != thrender::default_depth_clear_value)
+				outside++;
+		}
+	}
+	CHECK(outside == 0);
+	CHECK(checks::covered_pixels(gbuff) > 0);
+	ctx.vp = thrender::viewport(0, 0, width, height);
+
+	// Triangles with a vertex inside and beyond the guard band cover
+	// exactly the pixels of their visible part
+	vx_shader.mvp_mat = glm::mat4(1.0f);
+	const float far_x[2] = {1.5f, 40.0f};
+	for(size_t t = 0;t < 2;t++) {
+		checks::mesh_type tri(3, 1);
+		glm::vec4 ndc[3] = {glm::vec4(-0.5f, -0.5f, 0.5f, 1), glm::vec4(far_x[t], -0.2f, 0.5f, 1), glm::vec4(-0.4f, 0.7f, 0.5f, 1)};
+		glm::vec2 window[3];
+		for(size_t v = 0;v < 3;v++) {
+			VA_ATTRIBUTE(tri.vertices[v], thrender::POSITION) = ndc[v];
+			VA_ATTRIBUTE(tri.vertices[v], thrender::COLOR) = glm::vec4(1.0f);
+			window[v] = glm::vec2((ndc[v].x + 1.0f) * width / 2, (ndc[v].y + 1.0f) * height / 2);
+		}
+		tri.element_indices[0] = thrender::indices3_t(0, 1, 2);
+		tri.data_updated();
+
+		gbuff.clear_all();
+		pp.draw(tri, ctx);
+		CHECK(tri.intermediate_buffer().clipped_elements.empty() == (far_x[t] < thrender::guard_band));
+		size_t wrong = 0;
+		for(size_t y = 0;y < height;y++) {
+			for(size_t x = 0;x < width;x++) {
+				glm::vec2 center(x + 0.5f, y + 0.5f);
+				bool covered = gbuff.depth_buffer()[y][x] != thrender::default_depth_clear_value;
+				if (covered && !is_inside(window, center, -0.01f))
+					wrong++;
+				if (!covered && is_inside(window, center, 0.01f))
+					wrong++;
+			}
+		}
+		CHECK(wrong == 0);
+	}
+
+	return checks::result();
+}
@@ -0,0 +1,94 @@
+/*
+ * compaction.cpp
+ *
+ * Checks compaction of visible triangles after setup. The list of
+ * visible triangles must keep submission order and hold exactly the
+ * triangles that survived culling, so that triangles of one draw at
+ * the same depth are still drawn in order.
+ */
+#include "check.hpp"
+#include <vector>
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		thrender::shaders::default_fg_shader> pipeline_type;
+
+//! Reverse the winding of every other element
+void reverse_odd_elements(checks::mesh_type & mesh) {
+	for(size_t e = 1;e < mesh.element_indices.size();e += 2) {
+		thrender::indices3_t tr = mesh.element_indices[e];
+		mesh.element_indices[e] = thrender::indices3_t(tr.z, tr.y, tr.x);
+	}
+	mesh.data_updated();
+}
+
+//! Get the visible elements of last draw
+std::vector<thrender::primitive_id_t> visible_elements(const checks::mesh_type & mesh) {
+	const checks::mesh_type::intermediate_buffer_type & ib = mesh.intermediate_buffer();
+	return std::vector<thrender::primitive_id_t>(ib.visible_elements.begin(), ib.visible_elements.end());
+}
+
+int main() {
+
+	thrender::framebuffer_array fb(320, 240);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context ctx(cam, fb);
+
+	thrender::shaders::default_vx_shader vx_shader;
+	thrender::shaders::default_fg_shader fg_shader;
+	pipeline_type pp(vx_shader, fg_shader);
+	vx_shader.mvp_mat = glm::mat4(1.0f);
+
+	// Visible triangles are those that survive with no culling, in
+	// submission order, minus the culled ones
+	checks::mesh_type mesh = checks::random_triangles(500, 0.3f, 21);
+	reverse_odd_elements(mesh);
+	fb.clear_all();
+	pp.draw(mesh, ctx);
+	std::vector<thrender::primitive_id_t> all = visible_elements(mesh);
+	CHECK(all.size() > 400);
+	size_t out_of_order = 0;
+	for(size_t i = 1;i < all.size();i++)
+		out_of_order += all[i - 1] >= all[i];
+	CHECK(out_of_order == 0);
+
+	const thrender::cull_mode modes[2] = {thrender::cull_mode::back, thrender::cull_mode::front};
+	for(size_t m = 0;m < 2;m++) {
+		std::vector<thrender::primitive_id_t> expected;
+		for(size_t i = 0;i < all.size();i++) {
+			const thrender::indices3_t & tr = mesh.element_indices[all[i]];
+			bool is_front = thrender::math::signed_area(
+					VA_ATTRIBUTE(mesh.vertices[tr.x], thrender::POSITION),
+					VA_ATTRIBUTE(mesh.vertices[tr.y], thrender::POSITION),
+					VA_ATTRIBUTE(mesh.vertices[tr.z], thrender::POSITION)) > 0;
+			if (is_front == (modes[m] == thrender::cull_mode::back))
+				expected.push_back(all[i]);
+		}
+		ctx.culling = modes[m];
+		fb.clear_all();
+		pp.draw(mesh, ctx);
+		CHECK(visible_elements(mesh) == expected);
+	}
+
+	// Rectangles at the same depth, all covering the center, with
+	// culled ones between them. The last one that is drawn wins.
+	const size_t total_rectangles = 9;
+	checks::mesh_type stack(total_rectangles * 3, total_rectangles);
+	for(size_t r = 0;r < total_rectangles;r++) {
+		checks::mesh_type rect = checks::rectangle(-0.5f - 0.04f * r, -0.5f, 0.5f, 0.5f + 0.04f * r, 0.5f,
+				glm::vec4(float(r) / total_rectangles, 0.5f, 1.0f - float(r) / total_rectangles, 1.0f));
+		for(size_t v = 0;v < 3;v++)
+			stack.vertices[r * 3 + v] = rect.vertices[rect.element_indices[0][v]];
+		stack.element_indices[r] = thrender::indices3_t(r * 3, r * 3 + 1, r * 3 + 2);
+	}
+	reverse_odd_elements(stack);
+	for(size_t m = 0;m < 2;m++) {
+		ctx.culling = modes[m];
+		fb.clear_all();
+		pp.draw(stack, ctx);
+		size_t last = modes[m] == thrender::cull_mode::back ? total_rectangles - 1 : total_rectangles - 2;
+		CHECK(fb.color_buffer()[110][220] == VA_ATTRIBUTE(stack.vertices[last * 3], thrender::COLOR));
+	}
+
+	return checks::result();
+}
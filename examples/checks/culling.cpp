@@ -0,0 +1,95 @@
+/*
+ * culling.cpp
+ *
+ * Checks object culling against the view frustum. Culling must not
+ * change the image, and no object that would draw any pixel may be
+ * culled. Cached bounds must follow the vertices of objects.
+ */
+#include "check.hpp"
+#include <vector>
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		thrender::shaders::default_fg_shader> pipeline_type;
+
+int main() {
+
+	thrender::framebuffer_array culled(320, 240), reference(320, 240);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 1, 50);
+	thrender::render_context culled_ctx(cam, culled), reference_ctx(cam, reference);
+	culled_ctx.object_culling = true;
+	reference_ctx.object_culling = false;
+	glm::mat4 vp_mat = cam.projection_mat * cam.view_mat;
+
+	thrender::shaders::default_vx_shader vx_shader;
+	thrender::shaders::default_fg_shader fg_shader;
+	pipeline_type pp(vx_shader, fg_shader);
+
+	// Objects around the camera, many of them out of view
+	checks::mesh_type mesh = checks::sphere(8);
+	const size_t count = 300;
+	std::vector<glm::mat4> transforms;
+	checks::random rng(8);
+	for(size_t i = 0;i < count;i++) {
+		glm::vec3 position(rng.uniform(-30.0f, 30.0f), rng.uniform(-20.0f, 20.0f), rng.uniform(-20.0f, 40.0f));
+		transforms.push_back(glm::translate(glm::mat4(1.0f), position));
+	}
+
+	culled.clear_all();
+	reference.clear_all();
+	size_t total_culled = 0;
+	for(size_t i = 0;i < count;i++) {
+		vx_shader.mvp_mat = vp_mat * transforms[i];
+		pp.draw(mesh, transforms[i], culled_ctx);
+		pp.draw(mesh, transforms[i], reference_ctx);
+		if (!culled_ctx.is_object_visible(mesh.bounding_box(), transforms[i]))
+			total_culled++;
+	}
+	CHECK(total_culled > 0 && total_culled < count);
+	CHECK(checks::same_image(culled, reference));
+
+	// A culled object draws nothing on its own
+	size_t wrongly_culled = 0;
+	for(size_t i = 0;i < count;i++) {
+		if (culled_ctx.is_object_visible(mesh.bounding_box(), transforms[i]))
+			continue;
+		vx_shader.mvp_mat = vp_mat * transforms[i];
+		reference.clear_all();
+		pp.draw(mesh, transforms[i], reference_ctx);
+		if (checks::covered_pixels(reference))
+			wrongly_culled++;
+	}
+	CHECK(wrongly_culled == 0);
+
+	// Without a model matrix, the transformation of the shader is not
+	// known and the object is never culled
+	checks::mesh_type away = mesh;
+	for(size_t v = 0;v < away.vertices.size();v++)
+		VA_ATTRIBUTE(away.vertices[v], thrender::POSITION).x += 100.0f;
+	away.data_updated();
+	vx_shader.mvp_mat = vp_mat * glm::translate(glm::mat4(1.0f), glm::vec3(-100.0f, 0.0f, 0.0f));
+	culled.clear_all();
+	pp.draw(away, glm::mat4(1.0f), culled_ctx);
+	CHECK(checks::covered_pixels(culled) == 0);
+	pp.draw(away, culled_ctx);
+	CHECK(checks::covered_pixels(culled) > 0);
+	culled.clear_all();
+	pp.draw_depth(away, culled_ctx);
+	CHECK(checks::covered_pixels(culled) > 0);
+
+	// Bounds follow changes of the vertices
+	VA_ATTRIBUTE(mesh.vertices[5], thrender::POSITION) = glm::vec4(0.0f, 0.0f, 20.0f, 1.0f);
+	mesh.data_updated();
+	const thrender::aabb & box = mesh.bounding_box();
+	CHECK(box.max.z == 20.0f);
+	size_t outside = 0;
+	for(size_t v = 0;v < mesh.vertices.size();v++) {
+		glm::vec4 pos = VA_ATTRIBUTE(mesh.vertices[v], thrender::POSITION);
+		if (pos.x < box.min.x || pos.y < box.min.y || pos.z < box.min.z
+			|| pos.x > box.max.x || pos.y > box.max.y || pos.z > box.max.z)
+			outside++;
+	}
+	CHECK(outside == 0);
+
+	return checks::result();
+}
@@ -0,0 +1,117 @@
+/*
+ * depth.cpp
+ *
+ * Checks the depth test modes. Early and late tests must draw the same
+ * image unless fragments are discarded, discarded fragments must write
+ * depth only on the early test, and a depth pre-pass followed by a pass
+ * with the equal test must shade each pixel once, as forward rendering.
+ */
+#include "check.hpp"
+#include <atomic>
+
+//! Fragment shader that discards the pixels left of a column, and counts the rest
+struct discarding_fg_shader {
+
+	//! Pixels left of it are discarded
+	thrender::window_size_t discard_x;
+
+	std::atomic<size_t> fragments;
+
+	discarding_fg_shader()
+	:
+		discard_x(0),
+		fragments(0)
+	{}
+
+	template<class RenderableType>
+	void operator()(thrender::framebuffer_array & fb, const thrender::fragment_processing_control<RenderableType> & api) {
+		if (api.framebuffer_x < discard_x) {
+			api.discard();
+			return;
+		}
+		fragments++;
+		FB_PIXEL(fb.color_buffer()) = INTERPOLATE(thrender::COLOR);
+	}
+};
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		discarding_fg_shader> scalar_pipeline_type;
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		thrender::shaders::default_fg_shader> packet_pipeline_type;
+
+//! Draw an object with a depth pre-pass, then shade it with the equal test
+template<class PipelineType>
+void draw_with_prepass(PipelineType & pp, checks::mesh_type & mesh, thrender::render_context & ctx) {
+	ctx.fb.clear_all();
+	pp.draw_depth(mesh, ctx);
+	ctx.depth_func = thrender::depth_function::equal;
+	pp.draw(mesh, ctx);
+	ctx.depth_func = thrender::depth_function::greater_equal;
+}
+
+int main() {
+
+	thrender::framebuffer_array fb(320, 240), reference(320, 240);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context ctx(cam, fb), reference_ctx(cam, reference);
+
+	thrender::shaders::default_vx_shader vx_shader;
+	discarding_fg_shader scalar_shader;
+	thrender::shaders::default_fg_shader packet_shader;
+	scalar_pipeline_type scalar_pp(vx_shader, scalar_shader);
+	packet_pipeline_type packet_pp(vx_shader, packet_shader);
+	vx_shader.mvp_mat = glm::mat4(1.0f);
+
+	// With nothing discarded, early and late tests draw the same image
+	checks::mesh_type mesh = checks::random_triangles(600, 0.4f, 31);
+	reference.clear_all();
+	scalar_pp.draw(mesh, reference_ctx);
+	size_t forward_fragments = scalar_shader.fragments;
+	scalar_pp.depth_mode = thrender::depth_test_mode::late;
+	fb.clear_all();
+	scalar_pp.draw(mesh, ctx);
+	CHECK(checks::same_image(fb, reference));
+	scalar_pp.depth_mode = thrender::depth_test_mode::early;
+
+	// A pre-pass gives the same image, shading each covered pixel once,
+	// for shaders of single pixels and of quads
+	scalar_shader.fragments = 0;
+	draw_with_prepass(scalar_pp, mesh, ctx);
+	size_t covered = checks::covered_pixels(fb);
+	CHECK(checks::same_image(fb, reference));
+	CHECK(scalar_shader.fragments == covered);
+	CHECK(forward_fragments > covered);
+
+	fb.clear_all();
+	packet_pp.draw(mesh, ctx);
+	reference.clear_all();
+	draw_with_prepass(packet_pp, mesh, reference_ctx);
+	CHECK(checks::same_image(fb, reference));
+
+	// A rectangle whose left half is discarded, over another one. On
+	// the early test it still hides the other one, on the late test
+	// it does not.
+	const glm::vec4 covering_color(0, 1, 0, 1), covered_color(1, 0, 0, 1);
+	checks::mesh_type covering = checks::rectangle(-1.0f, -1.0f, 1.0f, 1.0f, 0.8f, covering_color),
+		covered_rect = checks::rectangle(-1.0f, -1.0f, 1.0f, 1.0f, 0.2f, covered_color);
+	const thrender::depth_test_mode modes[2] = {thrender::depth_test_mode::early, thrender::depth_test_mode::late};
+	for(size_t m = 0;m < 2;m++) {
+		bool is_late = modes[m] == thrender::depth_test_mode::late;
+		scalar_pp.depth_mode = modes[m];
+		fb.clear_all();
+		scalar_shader.discard_x = 160;
+		scalar_pp.draw(covering, ctx);
+		CHECK((fb.depth_buffer()[120][80] == thrender::default_depth_clear_value) == is_late);
+		CHECK(fb.color_buffer()[120][80] == thrender::default_color_clear_value);
+
+		scalar_shader.discard_x = 0;
+		scalar_pp.draw(covered_rect, ctx);
+		CHECK((fb.color_buffer()[120][80] == covered_color) == is_late);
+		CHECK(fb.color_buffer()[120][240] == covering_color);
+	}
+
+	return checks::result();
+}
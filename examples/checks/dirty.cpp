@@ -0,0 +1,163 @@
+/*
+ * dirty.cpp
+ *
+ * Checks partial updates of objects. After marking changed ranges of
+ * vertices and elements, drawing an object must give the same image as
+ * drawing a copy of it that is rebuilt as a whole, and its cached bounds
+ * and meshlets must be those of the changed data, so that it is not
+ * culled by mistake.
+ */
+#include "check.hpp"
+#include "thrender/utils/meshlets.hpp"
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		thrender::shaders::default_fg_shader> pipeline_type;
+
+//! Check if the bounds of an object enclose all of its vertices
+bool bounds_enclose(const checks::mesh_type & mesh) {
+	const thrender::aabb & box = mesh.bounding_box();
+	for(size_t v = 0;v < mesh.vertices.size();v++) {
+		glm::vec4 pos = VA_ATTRIBUTE(mesh.vertices[v], thrender::POSITION);
+		if (pos.x < box.min.x || pos.y < box.min.y || pos.z < box.min.z
+			|| pos.x > box.max.x || pos.y > box.max.y || pos.z > box.max.z)
+			return false;
+	}
+	return true;
+}
+
+//! Check if the meshlets of an object are valid and have the bounds of its data
+bool meshlets_match(const checks::mesh_type & mesh) {
+	if (!mesh.has_meshlets())
+		return false;
+	for(size_t i = 0;i < mesh.meshlets().size();i++) {
+		const thrender::meshlet & m = mesh.meshlets()[i];
+		thrender::meshlet fresh = m;
+		thrender::calculate_meshlet_bounds(mesh, fresh);
+		if (m.bounds.center != fresh.bounds.center || m.bounds.radius != fresh.bounds.radius
+			|| m.cone_axis != fresh.cone_axis || m.cone_cutoff != fresh.cone_cutoff)
+			return false;
+	}
+	return true;
+}
+
+//! Move a range of vertices, and mark it as changed
+void move_vertices(checks::mesh_type & mesh, size_t first, size_t count, const glm::vec4 & offset) {
+	for(size_t v = first;v < first + count;v++)
+		VA_ATTRIBUTE(mesh.vertices[v], thrender::POSITION) += offset;
+	mesh.vertices_updated(first, count);
+}
+
+//! Reverse the winding of a range of elements, and mark it as changed
+void reverse_elements(checks::mesh_type & mesh, size_t first, size_t count) {
+	for(size_t e = first;e < first + count;e++) {
+		thrender::indices3_t tr = mesh.element_indices[e];
+		mesh.element_indices[e] = thrender::indices3_t(tr.z, tr.y, tr.x);
+	}
+	mesh.elements_updated(first, count);
+}
+
+int main() {
+
+	thrender::framebuffer_array partial_fb(320, 240), rebuilt_fb(320, 240);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context partial_ctx(cam, partial_fb), rebuilt_ctx(cam, rebuilt_fb);
+	partial_ctx.object_culling = rebuilt_ctx.object_culling = true;
+	partial_ctx.culling = rebuilt_ctx.culling = thrender::cull_mode::back;
+
+	thrender::shaders::default_vx_shader vx_shader;
+	thrender::shaders::default_fg_shader fg_shader;
+	pipeline_type pp(vx_shader, fg_shader);
+	vx_shader.mvp_mat = cam.projection_mat * cam.view_mat;
+	const glm::mat4 model_mat(1.0f);
+
+	// Vertices are not a whole number of packets, and start out of view
+	const glm::vec4 away(30.0f, 0.0f, 0.0f, 0.0f);
+	checks::mesh_type mesh = checks::random_triangles(401, 0.2f, 12);
+	for(size_t v = 0;v < mesh.vertices.size();v++) {
+		glm::vec4 & pos = VA_ATTRIBUTE(mesh.vertices[v], thrender::POSITION);
+		pos.x *= 3.0f;
+		pos.y *= 3.0f;
+		pos += away;
+	}
+	mesh.data_updated();
+	partial_fb.clear_all();
+	pp.draw(mesh, model_mat, partial_ctx);
+	CHECK(checks::covered_pixels(partial_fb) == 0);
+
+	for(size_t round = 0;round < 4;round++) {
+		switch(round) {
+		case 0:
+			// One range moves into view
+			move_vertices(mesh, 30, 30, -away);
+			break;
+		case 1:
+			// Several ranges, of vertices and elements, before drawing
+			move_vertices(mesh, 300, 10, -away);
+			move_vertices(mesh, 600, 33, -away);
+			reverse_elements(mesh, 100, 10);
+			mesh.element_indices[5] = thrender::indices3_t(30, 31, 32);
+			mesh.elements_updated(5, 1);
+			break;
+		case 2:
+			// The last vertices, in a partial packet
+			move_vertices(mesh, mesh.vertices.size() - 5, 5, -away);
+			reverse_elements(mesh, 10, 1);
+			break;
+		case 3:
+			// Vertices move inside the view
+			move_vertices(mesh, 35, 200, glm::vec4(0.5f, -0.5f, 0.1f, 0.0f));
+			break;
+		}
+		CHECK(bounds_enclose(mesh));
+
+		checks::mesh_type rebuilt = mesh;
+		rebuilt.data_updated();
+		partial_fb.clear_all();
+		rebuilt_fb.clear_all();
+		pp.draw(mesh, model_mat, partial_ctx);
+		pp.draw(rebuilt, model_mat, rebuilt_ctx);
+		CHECK(checks::covered_pixels(rebuilt_fb) > 0);
+		CHECK(checks::same_image(partial_fb, rebuilt_fb));
+	}
+
+	// Bounds are those of the changed vertices, not only grown
+	checks::mesh_type rebuilt = mesh;
+	rebuilt.data_updated();
+	CHECK(mesh.bounding_box().min == rebuilt.bounding_box().min);
+	CHECK(mesh.bounding_box().max == rebuilt.bounding_box().max);
+	CHECK(mesh.bounding_sphere().radius == rebuilt.bounding_sphere().radius);
+	move_vertices(mesh, 0, mesh.vertices.size(), -away);
+	move_vertices(mesh, 0, mesh.vertices.size(), away);
+	CHECK(mesh.bounding_box().max.x == rebuilt.bounding_box().max.x);
+
+	// Partial updates keep meshlets, recalculating the changed ones
+	checks::mesh_type clustered = checks::sphere(40);
+	thrender::utils::build_meshlets(clustered, 64, 128);
+	CHECK(clustered.meshlets().size() > 4);
+	const thrender::meshlet second = clustered.meshlets()[1];
+	move_vertices(clustered, second.first_vertex - 3, 6, glm::vec4(0.0f, 0.0f, -2.0f, 0.0f));
+	CHECK(meshlets_match(clustered));
+	CHECK(clustered.meshlets()[1].bounds.radius != second.bounds.radius);
+	reverse_elements(clustered, second.first_element, 4);
+	CHECK(meshlets_match(clustered));
+	CHECK(clustered.meshlets()[1].cone_cutoff != second.cone_cutoff);
+
+	rebuilt = clustered;
+	rebuilt.data_updated();
+	CHECK(!rebuilt.has_meshlets());
+	partial_fb.clear_all();
+	rebuilt_fb.clear_all();
+	pp.draw(clustered, model_mat, partial_ctx);
+	pp.draw(rebuilt, model_mat, rebuilt_ctx);
+	CHECK(checks::covered_pixels(rebuilt_fb) > 0);
+	CHECK(checks::same_image(partial_fb, rebuilt_fb));
+
+	// but an element that leaves its meshlet drops them
+	const thrender::meshlet & last = clustered.meshlets()[clustered.meshlets().size() - 1];
+	clustered.element_indices[0] = thrender::indices3_t(last.first_vertex, last.first_vertex + 1, last.first_vertex + 2);
+	clustered.elements_updated(0, 1);
+	CHECK(!clustered.has_meshlets());
+
+	return checks::result();
+}
@@ -0,0 +1,97 @@
+/*
+ * hiz.cpp
+ *
+ * Checks the hierarchical depth buffer. Primitives hidden by what is
+ * already drawn must be rejected before any fragment is shaded, and
+ * the depth bounds of blocks and tiles must always enclose the depth
+ * buffer, so that rejection never drops a visible fragment.
+ */
+#include "check.hpp"
+#include <atomic>
+
+//! Fragment shader that counts the fragments it shades
+struct counting_fg_shader {
+
+	std::atomic<size_t> fragments;
+
+	counting_fg_shader()
+	:
+		fragments(0)
+	{}
+
+	template<class RenderableType>
+	void operator()(thrender::framebuffer_array & fb, const thrender::fragment_processing_control<RenderableType> & api) {
+		fragments++;
+		FB_PIXEL(fb.color_buffer()) = INTERPOLATE(thrender::COLOR);
+	}
+};
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		counting_fg_shader> pipeline_type;
+
+//! Count the primitives in the bins of all tiles
+size_t binned_primitives(const thrender::render_context & ctx) {
+	size_t total = 0;
+	for(size_t t = 0;t < ctx.bins.total_tiles();t++)
+		total += ctx.bins[t].size();
+	return total;
+}
+
+//! Count the blocks and tiles whose bounds do not enclose the depth buffer
+size_t wrong_bounds(thrender::framebuffer_array & fb) {
+	size_t wrong = 0;
+	const size_t tile_blocks = thrender::tile_size / thrender::hiz_block_size;
+	for(size_t by = 0;by < fb.hiz_block_buffer().height();by++) {
+		for(size_t bx = 0;bx < fb.hiz_block_buffer().width();bx++) {
+			thrender::depth_bounds_t block = fb.hiz_block_buffer()[by][bx];
+			thrender::depth_bounds_t tile = fb.hiz_tile_buffer()[by / tile_blocks][bx / tile_blocks];
+			if (tile.min > block.min || tile.max < block.max)
+				wrong++;
+			for(size_t y = by * thrender::hiz_block_size;y < std::min<size_t>((by + 1) * thrender::hiz_block_size, fb.height());y++) {
+				for(size_t x = bx * thrender::hiz_block_size;x < std::min<size_t>((bx + 1) * thrender::hiz_block_size, fb.width());x++) {
+					thrender::depth_pixel_t z = fb.depth_buffer()[y][x];
+					if (z < block.min || z > block.max)
+						wrong++;
+				}
+			}
+		}
+	}
+	return wrong;
+}
+
+int main() {
+
+	thrender::framebuffer_array gbuff(320, 240);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context ctx(cam, gbuff);
+
+	thrender::shaders::default_vx_shader vx_shader;
+	counting_fg_shader fg_shader;
+	vx_shader.mvp_mat = glm::mat4(1.0f);
+	pipeline_type pp(vx_shader, fg_shader);
+
+	// An occluder over the whole framebuffer
+	checks::mesh_type occluder = checks::rectangle(-1.0f, -1.0f, 1.0f, 1.0f, 0.9f, glm::vec4(1.0f));
+	gbuff.clear_all();
+	pp.draw(occluder, ctx);
+	CHECK(fg_shader.fragments == 320 * 240);
+	CHECK(wrong_bounds(gbuff) == 0);
+
+	// Triangles behind it are dropped at binning
+	checks::mesh_type hidden = checks::random_triangles(500, 0.3f, 2, -0.9f, 0.6f);
+	fg_shader.fragments = 0;
+	pp.draw(hidden, ctx);
+	CHECK(binned_primitives(ctx) == 0);
+	CHECK(fg_shader.fragments == 0);
+
+	// Triangles at any depth keep the bounds enclosing the depth buffer
+	checks::mesh_type mixed = checks::random_triangles(500, 0.3f, 3, -0.9f, 0.99f);
+	gbuff.clear_all();
+	pp.draw(mixed, ctx);
+	CHECK(wrong_bounds(gbuff) == 0);
+	pp.draw(hidden, ctx);
+	CHECK(wrong_bounds(gbuff) == 0);
+
+	return checks::result();
+}
@@ -0,0 +1,164 @@
+/*
+ * hooks.cpp
+ *
+ * Checks the prepare and finish hooks of shaders. Each stage function
+ * and each draw of the pipeline must call them once, so that shaders
+ * that bake uniforms there, like gouraud_vx_shader, light vertices the
+ * same way however they are processed, also under non uniform scale.
+ */
+#include "check.hpp"
+#include <algorithm>
+
+//! Vertex shader that counts the calls of its hooks
+struct counting_vx_shader : public thrender::shaders::default_vx_shader {
+
+	size_t prepared, finished;
+
+	counting_vx_shader()
+	:
+		prepared(0),
+		finished(0)
+	{}
+
+	void prepare(thrender::render_context &) {
+		prepared++;
+	}
+
+	void finish(thrender::render_context &) {
+		finished++;
+	}
+};
+
+//! Fragment shader that counts the calls of its hooks
+struct counting_fg_shader : public thrender::shaders::default_fg_shader {
+
+	size_t prepared, finished;
+
+	counting_fg_shader()
+	:
+		prepared(0),
+		finished(0)
+	{}
+
+	void prepare(thrender::render_context &) {
+		prepared++;
+	}
+
+	void finish(thrender::render_context &) {
+		finished++;
+	}
+};
+
+//! Gouraud vertex shader without the packet operator
+struct scalar_gouraud_vx_shader : public thrender::shaders::gouraud_vx_shader {
+
+	typedef thrender::shaders::gouraud_vx_shader base_type;
+
+	template<class RenderableType>
+	void operator()(const typename RenderableType::vertex_type & vin, typename RenderableType::vertex_type & vout,
+			thrender::vertex_processing_control<RenderableType> & vcontrol) {
+		base_type::operator()(vin, vout, vcontrol);
+	}
+};
+
+//! Phong lighting of a vertex in world space, as gouraud_vx_shader documents it
+glm::vec4 reference_color(const thrender::shaders::gouraud_vx_shader & shader, const glm::vec4 & pos, const glm::vec4 & normal) {
+	glm::vec3 pos_ws(shader.mModel * pos);
+	glm::vec3 normal_ws = glm::normalize(glm::transpose(glm::inverse(glm::mat3(shader.mModel))) * glm::vec3(normal));
+	glm::vec3 light_direction = glm::normalize(pos_ws - glm::vec3(shader.light.position_ws));
+	glm::vec3 camera_direction = glm::normalize(pos_ws - glm::vec3(shader.vCameraPos_ws));
+	glm::vec3 reflected = glm::reflect(-light_direction, normal_ws);
+	float diffuse = std::max(0.0f, glm::dot(normal_ws, light_direction));
+	float specular = std::pow(std::max(0.0f, glm::dot(reflected, camera_direction)), shader.material.shininess);
+	return shader.material.emissive_color
+		+ shader.light.diffuse_color * shader.material.diffuse_color * diffuse
+		+ shader.light.specular_color * shader.material.specular_color * specular;
+}
+
+//! Get the largest difference of processed colors from the reference lighting
+float lighting_error(const thrender::shaders::gouraud_vx_shader & shader, const checks::mesh_type & mesh) {
+	const checks::mesh_type::intermediate_buffer_type & ib = mesh.intermediate_buffer();
+	float error = 0.0f;
+	for(size_t v = 0;v < mesh.vertices.size();v++) {
+		glm::vec4 d = ib.processed_vertices.attribute<thrender::COLOR>(v) - reference_color(shader,
+				VA_ATTRIBUTE(mesh.vertices[v], thrender::POSITION), VA_ATTRIBUTE(mesh.vertices[v], thrender::NORMAL));
+		for(size_t i = 0;i < 4;i++)
+			error = std::max(error, std::fabs(d[i]));
+	}
+	return error;
+}
+
+int main() {
+
+	thrender::framebuffer_array fb(320, 240);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context ctx(cam, fb);
+
+	checks::mesh_type mesh = checks::random_triangles(101, 0.3f, 61);
+	checks::random rng(62);
+	for(size_t v = 0;v < mesh.vertices.size();v++) {
+		VA_ATTRIBUTE(mesh.vertices[v], thrender::NORMAL) = glm::vec4(
+				rng.uniform(-1.0f, 1.0f), rng.uniform(-1.0f, 1.0f), rng.uniform(-1.0f, 1.0f), 0.0f);
+	}
+	mesh.data_updated();
+
+	// Every stage function calls the hooks of its shader once
+	counting_vx_shader vx_shader;
+	counting_fg_shader fg_shader;
+	vx_shader.mvp_mat = glm::mat4(1.0f);
+	thrender::process_vertices(mesh, vx_shader, ctx);
+	CHECK(vx_shader.prepared == 1 && vx_shader.finished == 1);
+	thrender::process_primitives(mesh, ctx);
+	thrender::process_fragments(mesh, fg_shader, ctx);
+	CHECK(fg_shader.prepared == 1 && fg_shader.finished == 1);
+	thrender::process_geometry(mesh, vx_shader, ctx, 16);
+	CHECK(vx_shader.prepared == 2 && vx_shader.finished == 2);
+
+	// and every draw of the pipeline calls each hook once
+	thrender::pipeline<checks::mesh_type, counting_vx_shader, counting_fg_shader> pp(vx_shader, fg_shader);
+	pp.draw(mesh, ctx);
+	CHECK(vx_shader.prepared == 3 && vx_shader.finished == 3);
+	CHECK(fg_shader.prepared == 2 && fg_shader.finished == 2);
+	fb.clear_all();
+	pp.draw_visibility(mesh, ctx);
+	pp.resolve(ctx);
+	CHECK(vx_shader.prepared == 4 && vx_shader.finished == 4);
+	CHECK(fg_shader.prepared == 3 && fg_shader.finished == 3);
+
+	// Gouraud lighting under non uniform scale, through the stage
+	// functions and the pipeline, on both vertex shading paths
+	thrender::shaders::gouraud_vx_shader gouraud_shader;
+	gouraud_shader.mModel = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f, -0.2f, 1.0f)), glm::vec3(3.0f, 0.5f, 1.5f));
+	gouraud_shader.mView = cam.view_mat;
+	gouraud_shader.mProjection = cam.projection_mat;
+	gouraud_shader.vCameraPos_ws = glm::vec4(0, 0, -10, 1);
+	gouraud_shader.light.position_ws = glm::vec4(-3, 4, -6, 1);
+	gouraud_shader.light.diffuse_color = glm::vec4(0.8f, 0.7f, 0.6f, 1.0f);
+	gouraud_shader.light.specular_color = glm::vec4(1.0f);
+	gouraud_shader.material.diffuse_color = glm::vec4(0.5f, 0.6f, 0.7f, 1.0f);
+	gouraud_shader.material.specular_color = glm::vec4(0.4f);
+	gouraud_shader.material.emissive_color = glm::vec4(0.1f, 0.1f, 0.1f, 0.0f);
+	gouraud_shader.material.shininess = 8.0f;
+
+	thrender::process_vertices(mesh, gouraud_shader, ctx);
+	CHECK(lighting_error(gouraud_shader, mesh) < 1e-4f);
+
+	thrender::shaders::gouraud_fg_shader gouraud_fg;
+	thrender::pipeline<checks::mesh_type, thrender::shaders::gouraud_vx_shader,
+		thrender::shaders::gouraud_fg_shader> gouraud_pp(gouraud_shader, gouraud_fg);
+	gouraud_shader.mModel = glm::scale(glm::mat4(1.0f), glm::vec3(0.7f, 2.0f, 1.0f));
+	fb.clear_all();
+	gouraud_pp.draw(mesh, ctx);
+	CHECK(lighting_error(gouraud_shader, mesh) < 1e-4f);
+
+	scalar_gouraud_vx_shader scalar_shader;
+	static_cast<thrender::shaders::gouraud_vx_shader &>(scalar_shader) = gouraud_shader;
+	scalar_shader.mModel = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 1.0f, 4.0f));
+	thrender::pipeline<checks::mesh_type, scalar_gouraud_vx_shader,
+		thrender::shaders::gouraud_fg_shader> scalar_pp(scalar_shader, gouraud_fg);
+	fb.clear_all();
+	scalar_pp.draw(mesh, ctx);
+	CHECK(lighting_error(scalar_shader, mesh) < 1e-4f);
+
+	return checks::result();
+}
@@ -0,0 +1,105 @@
+/*
+ * instancing.cpp
+ *
+ * Checks instanced drawing. Drawing the instances of a mesh in one
+ * call must give the same image as drawing them one by one, on both
+ * vertex shading paths, with the data of each instance reaching the
+ * vertices and fragments of that instance only.
+ */
+#include "check.hpp"
+
+//! Fragment shader that scales colors by a value of the instance
+struct instance_fg_shader {
+
+	template<class RenderableType>
+	void operator()(thrender::framebuffer_array & fb, const thrender::fragment_processing_control<RenderableType> & api) {
+		float scale = 1.0f + api.template instance<thrender::shaders::instance_transform>().model_mat[3][2];
+		FB_PIXEL(fb.color_buffer()) = INTERPOLATE(thrender::COLOR) * scale;
+	}
+};
+
+//! Fragment shader that scales colors by a uniform
+struct uniform_fg_shader {
+
+	float scale;
+
+	template<class RenderableType>
+	void operator()(thrender::framebuffer_array & fb, const thrender::fragment_processing_control<RenderableType> & api) {
+		FB_PIXEL(fb.color_buffer()) = INTERPOLATE(thrender::COLOR) * scale;
+	}
+};
+
+//! Instanced vertex shader without the packet operator
+struct scalar_instanced_vx_shader : public thrender::shaders::instanced_vx_shader {
+
+	typedef thrender::shaders::instanced_vx_shader base_type;
+
+	template<class RenderableType>
+	void operator()(const typename RenderableType::vertex_type & vin, typename RenderableType::vertex_type & vout,
+			thrender::vertex_processing_control<RenderableType> & vcontrol) {
+		base_type::operator()(vin, vout, vcontrol);
+	}
+};
+
+//! Draw all instances with one call
+template<class VertexShader>
+void draw_instanced(checks::mesh_type & mesh, thrender::shaders::instance_transform * instances, size_t count,
+		thrender::render_context & ctx) {
+	VertexShader vx_shader;
+	instance_fg_shader fg_shader;
+	thrender::pipeline<checks::mesh_type, VertexShader, instance_fg_shader> pp(vx_shader, fg_shader);
+	ctx.fb.clear_all();
+	pp.draw_instanced(mesh, instances, count, ctx);
+}
+
+int main() {
+
+	thrender::framebuffer_array separate(320, 240), instanced(320, 240);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context separate_ctx(cam, separate), instanced_ctx(cam, instanced);
+	glm::mat4 vp_mat = cam.projection_mat * cam.view_mat;
+
+	// Vertices are not a whole number of packets
+	checks::mesh_type mesh = checks::random_triangles(301, 0.2f, 7);
+	for(size_t v = 0;v < mesh.vertices.size();v++) {
+		glm::vec4 & pos = VA_ATTRIBUTE(mesh.vertices[v], thrender::POSITION);
+		pos.x *= 4.0f;
+		pos.y *= 4.0f;
+	}
+	mesh.data_updated();
+
+	const size_t count = 5;
+	thrender::shaders::instance_transform instances[count];
+	for(size_t i = 0;i < count;i++) {
+		instances[i].model_mat = glm::translate(glm::mat4(1.0f), glm::vec3(1.5f * i - 3.0f, 0.5f * i, 0.1f * i));
+		instances[i].update(vp_mat);
+	}
+
+	// Reference, one draw per instance
+	{
+		thrender::shaders::default_vx_shader vx_shader;
+		uniform_fg_shader fg_shader;
+		thrender::pipeline<checks::mesh_type, thrender::shaders::default_vx_shader, uniform_fg_shader> pp(vx_shader, fg_shader);
+		separate.clear_all();
+		for(size_t i = 0;i < count;i++) {
+			vx_shader.mvp_mat = vp_mat * instances[i].model_mat;
+			fg_shader.scale = 1.0f + instances[i].model_mat[3][2];
+			pp.draw(mesh, separate_ctx);
+		}
+	}
+	CHECK(checks::covered_pixels(separate) > 0);
+
+	draw_instanced<thrender::shaders::instanced_vx_shader>(mesh, instances, count, instanced_ctx);
+	CHECK(checks::same_image(separate, instanced));
+
+	draw_instanced<scalar_instanced_vx_shader>(mesh, instances, count, instanced_ctx);
+	CHECK(checks::same_image(separate, instanced));
+
+	// Buffers are rebuilt when the number of instances changes
+	draw_instanced<thrender::shaders::instanced_vx_shader>(mesh, instances, 1, instanced_ctx);
+	CHECK(mesh.intermediate_buffer().draws.size() == 1);
+	draw_instanced<thrender::shaders::instanced_vx_shader>(mesh, instances, count, instanced_ctx);
+	CHECK(checks::same_image(separate, instanced));
+
+	return checks::result();
+}
@@ -0,0 +1,81 @@
+/*
+ * lod.cpp
+ *
+ * Checks mesh simplification and selection of levels of detail. Each
+ * level must be coarser than the previous one with no smaller error,
+ * simplifying a flat surface must keep it on its plane with no error,
+ * and levels must get coarser as the object moves away from camera.
+ */
+#include "check.hpp"
+#include "thrender/utils/simplify.hpp"
+#include <cmath>
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		thrender::shaders::default_fg_shader> pipeline_type;
+
+int main() {
+
+	// Levels are coarser with no smaller error
+	checks::mesh_type mesh = checks::sphere(40);
+	thrender::lod_chain<checks::mesh_type> chain = thrender::utils::build_lod_chain(mesh, 4);
+	CHECK(chain.size() == 5);
+	CHECK(&chain.level(0) == &mesh && chain.error(0) == 0.0f);
+	for(size_t l = 1;l < chain.size();l++) {
+		CHECK(chain.level(l).element_indices.size() < chain.level(l - 1).element_indices.size());
+		CHECK(chain.error(l) >= chain.error(l - 1));
+	}
+	CHECK(chain.error(chain.size() - 1) > 0.0f);
+
+	// A flat surface stays on its plane
+	checks::mesh_type flat = checks::grid(16, 4.0f, 0.5f);
+	thrender::lod_chain<checks::mesh_type> flat_chain = thrender::utils::build_lod_chain(flat, 3);
+	CHECK(flat_chain.size() > 1);
+	for(size_t l = 1;l < flat_chain.size();l++) {
+		const checks::mesh_type & level = flat_chain.level(l);
+		CHECK(level.element_indices.size() < flat.element_indices.size());
+		CHECK(std::fabs(flat_chain.error(l)) < 1e-5f);
+		size_t off_plane = 0;
+		for(size_t v = 0;v < level.vertices.size();v++)
+			off_plane += VA_ATTRIBUTE(level.vertices[v], thrender::POSITION).z != 0.5f;
+		CHECK(off_plane == 0);
+	}
+
+	// Levels get coarser with distance, and only far enough that the
+	// silhouette moves less than the threshold, which changes coverage by
+	// at most the perimeter of the projected sphere
+	thrender::framebuffer_array fb(320, 240), reference(320, 240);
+	thrender::shaders::default_vx_shader vx_shader;
+	thrender::shaders::default_fg_shader fg_shader;
+	pipeline_type pp(vx_shader, fg_shader);
+	glm::mat4 model_mat(1.0f);
+	const float threshold = 1.0f, pi = 3.14159265f;
+	size_t previous = 0, coarser_drawn = 0;
+	for(float distance = 4.0f;distance < 400.0f;distance *= 1.25f) {
+		thrender::camera cam(glm::vec3(0, 0, -distance), 45, 4.0f / 3.0f, 1, 500);
+		thrender::render_context ctx(cam, fb), reference_ctx(cam, reference);
+		size_t selected = chain.select(ctx, model_mat, threshold);
+		CHECK(selected >= previous);
+		previous = selected;
+		if (selected == 0)
+			continue;
+
+		vx_shader.mvp_mat = cam.projection_mat * cam.view_mat * model_mat;
+		fb.clear_all();
+		reference.clear_all();
+		pp.draw(chain.level(selected), ctx);
+		pp.draw(mesh, reference_ctx);
+		double covered = double(checks::covered_pixels(fb)), expected = double(checks::covered_pixels(reference));
+		CHECK(std::fabs(covered - expected) <= 2 * std::sqrt(pi * expected) * threshold);
+		coarser_drawn++;
+	}
+	CHECK(previous == chain.size() - 1);
+	CHECK(coarser_drawn > 0);
+
+	// Inside the bounds of the object there is no coarser level
+	thrender::camera near_cam(glm::vec3(0, 0, -2), 45, 4.0f / 3.0f, 1, 500);
+	thrender::render_context near_ctx(near_cam, fb);
+	CHECK(chain.select(near_ctx, model_mat, 1000.0f) == 0);
+
+	return checks::result();
+}
@@ -0,0 +1,72 @@
+/*
+ * meshlets.cpp
+ *
+ * Checks meshlet clustering and culling. A mesh partitioned in
+ * meshlets must give the same image as the original one, while
+ * meshlets facing away from the camera are culled, and only when
+ * back faces are culled.
+ */
+#include "check.hpp"
+#include "thrender/utils/meshlets.hpp"
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		thrender::shaders::default_fg_shader> pipeline_type;
+
+//! Count the meshlets culled in the last draw
+size_t culled_meshlets(const checks::mesh_type & object) {
+	const thrust::host_vector<unsigned char> & visible = object.intermediate_buffer().meshlet_visible;
+	size_t culled = 0;
+	for(size_t i = 0;i < visible.size();i++)
+		culled += !visible[i];
+	return culled;
+}
+
+int main() {
+
+	thrender::framebuffer_array plain_fb(320, 240), meshlets_fb(320, 240);
+	thrender::camera cam(glm::vec3(3, 2, -8), 45, 4.0f / 3.0f, 1, 50);
+	thrender::render_context plain_ctx(cam, plain_fb), meshlets_ctx(cam, meshlets_fb);
+	plain_ctx.object_culling = false;
+	meshlets_ctx.object_culling = true;
+
+	thrender::shaders::default_vx_shader vx_shader;
+	thrender::shaders::default_fg_shader fg_shader;
+	pipeline_type pp(vx_shader, fg_shader);
+	glm::mat4 model_mat = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f, 0.0f, 0.0f));
+	vx_shader.mvp_mat = cam.projection_mat * cam.view_mat * model_mat;
+
+	checks::mesh_type plain = checks::sphere(60);
+	checks::mesh_type clustered = plain;
+	thrender::utils::build_meshlets(clustered, 64, 128);
+	CHECK(clustered.has_meshlets());
+	CHECK(clustered.element_indices.size() == plain.element_indices.size());
+
+	size_t oversized = 0, covered_elements = 0;
+	for(size_t i = 0;i < clustered.meshlets().size();i++) {
+		const thrender::meshlet & m = clustered.meshlets()[i];
+		if (m.vertex_count > 64 || m.element_count > 128)
+			oversized++;
+		covered_elements += m.element_count;
+	}
+	CHECK(oversized == 0);
+	CHECK(covered_elements == clustered.element_indices.size());
+
+	const thrender::cull_mode modes[2] = {thrender::cull_mode::none, thrender::cull_mode::back};
+	for(size_t m = 0;m < 2;m++) {
+		plain_ctx.culling = meshlets_ctx.culling = modes[m];
+		plain_fb.clear_all();
+		meshlets_fb.clear_all();
+		pp.draw(plain, model_mat, plain_ctx);
+		pp.draw(clustered, model_mat, meshlets_ctx);
+		CHECK(checks::same_image(plain_fb, meshlets_fb));
+
+		// The sphere is in view, only back faces can be culled
+		if (modes[m] == thrender::cull_mode::back)
+			CHECK(culled_meshlets(clustered) > 0);
+		else
+			CHECK(culled_meshlets(clustered) == 0);
+	}
+
+	return checks::result();
+}
@@ -0,0 +1,70 @@
+/*
+ * optimizer.cpp
+ *
+ * Checks load-time mesh optimization. The optimized mesh must hold
+ * the same triangles with the same winding, and reordering must lower
+ * the average cache miss ratio (ACMR) that is reported for it.
+ */
+#include "check.hpp"
+#include "thrender/utils/mesh_optimizer.hpp"
+#include <algorithm>
+#include <vector>
+
+typedef std::vector<float> triangle_key;
+
+//! Get the triangles of a mesh by their positions, starting from the smallest vertex
+/**
+ * Triangles of zero area are left out, as the optimizer drops them.
+ */
+std::vector<triangle_key> triangle_keys(const checks::mesh_type & mesh) {
+	std::vector<triangle_key> keys;
+	for(size_t e = 0;e < mesh.element_indices.size();e++) {
+		const thrender::indices3_t & tr = mesh.element_indices[e];
+		glm::vec3 p[3];
+		for(size_t i = 0;i < 3;i++)
+			p[i] = glm::vec3(VA_ATTRIBUTE(mesh.vertices[tr[i]], thrender::POSITION));
+		glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+		if (n.x == 0 && n.y == 0 && n.z == 0)
+			continue;
+
+		triangle_key key;
+		for(size_t i = 0;i < 3;i++)
+			for(size_t c = 0;c < 3;c++)
+				key.push_back(p[i][c]);
+		triangle_key smallest = key;
+		for(size_t r = 1;r < 3;r++) {
+			std::rotate(key.begin(), key.begin() + 3, key.end());
+			smallest = std::min(smallest, key);
+		}
+		keys.push_back(smallest);
+	}
+	std::sort(keys.begin(), keys.end());
+	return keys;
+}
+
+int main() {
+
+	// Sphere with its triangles shuffled
+	checks::mesh_type mesh = checks::sphere(60);
+	checks::random rng(11);
+	for(size_t i = mesh.element_indices.size();i > 1;i--)
+		std::swap(mesh.element_indices[i - 1], mesh.element_indices[size_t(rng.uniform(0.0f, 1.0f) * i) % i]);
+	mesh.data_updated();
+	std::vector<triangle_key> before = triangle_keys(mesh);
+
+	thrender::utils::mesh_optimization_options options;
+	thrender::utils::mesh_optimization_report report = thrender::utils::optimize_mesh(mesh, options);
+	CHECK(triangle_keys(mesh) == before);
+	CHECK(report.acmr_after < 0.8 * report.acmr_before);
+	CHECK(report.acmr_after == thrender::utils::calculate_acmr(mesh.element_indices, mesh.vertices.size(), options.cache_size));
+	CHECK(report.overdraw_after >= 1.0);
+
+	// Optimizing again keeps the triangles, and clustering for overdraw
+	// trades no more cache misses than the threshold allows
+	thrender::utils::mesh_optimization_report again = thrender::utils::optimize_mesh(mesh, options);
+	CHECK(triangle_keys(mesh) == before);
+	CHECK(again.removed_elements == 0 && again.removed_vertices == 0);
+	CHECK(again.acmr_after <= report.acmr_after * options.overdraw_threshold);
+
+	return checks::result();
+}
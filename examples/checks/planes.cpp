@@ -0,0 +1,93 @@
+/*
+ * planes.cpp
+ *
+ * Checks interpolation of attributes with the plane equations of
+ * triangle setup. It must give the same values as interpolating the
+ * vertices of each triangle with the barycoords of the pixel, both in
+ * window space and perspective correct.
+ */
+#include "check.hpp"
+#include <algorithm>
+
+//! Fragment shader that interpolates colors with barycoords of the pixel
+struct barycentric_fg_shader {
+
+	template<class RenderableType>
+	void operator()(thrender::framebuffer_array & fb, const thrender::fragment_processing_control<RenderableType> & api) {
+		const typename RenderableType::intermediate_buffer_type & ib = api.object.intermediate_buffer();
+		glm::vec4 positions[3], colors[3];
+		for(size_t i = 0;i < 3;i++) {
+			positions[i] = ib.element_position(api.primitive_id, i);
+			colors[i] = api.primitive_id < ib.elements.size()
+				? ib.processed_vertices.template attribute<thrender::COLOR>(api.primitive.indices[i])
+				: VA_ATTRIBUTE(ib.clipped_vertices[api.primitive.indices[i]], thrender::COLOR);
+		}
+		glm::vec3 weights = thrender::math::barycoords(positions[0], positions[1], positions[2],
+				glm::vec2(api.framebuffer_x + 0.5f, api.framebuffer_y + 0.5f));
+
+		// Window space w is 1/w of clip space
+		if (api.context.interpolation == thrender::interpolation_mode::perspective) {
+			weights = glm::vec3(weights.x * positions[0].w, weights.y * positions[1].w, weights.z * positions[2].w);
+			weights /= weights.x + weights.y + weights.z;
+		}
+		FB_PIXEL(fb.color_buffer()) = colors[0] * weights.x + colors[1] * weights.y + colors[2] * weights.z;
+	}
+};
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		thrender::shaders::default_fg_shader> plane_pipeline_type;
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		barycentric_fg_shader> barycentric_pipeline_type;
+
+//! Get the largest difference of colors between two framebuffers
+float color_difference(thrender::framebuffer_array & a, thrender::framebuffer_array & b) {
+	float difference = 0.0f;
+	for(size_t y = 0;y < a.height();y++) {
+		for(size_t x = 0;x < a.width();x++) {
+			glm::vec4 d = a.color_buffer()[y][x] - b.color_buffer()[y][x];
+			difference = std::max(difference, std::max(std::max(std::fabs(d.x), std::fabs(d.y)),
+					std::max(std::fabs(d.z), std::fabs(d.w))));
+		}
+	}
+	return difference;
+}
+
+int main() {
+
+	thrender::framebuffer_array plane_fb(320, 240), barycentric_fb(320, 240);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context plane_ctx(cam, plane_fb), barycentric_ctx(cam, barycentric_fb);
+
+	thrender::shaders::default_vx_shader vx_shader;
+	thrender::shaders::default_fg_shader plane_shader;
+	barycentric_fg_shader barycentric_shader;
+	plane_pipeline_type plane_pp(vx_shader, plane_shader);
+	barycentric_pipeline_type barycentric_pp(vx_shader, barycentric_shader);
+
+	// Triangles at very different depths, so that perspective correct
+	// interpolation is far from linear, and some of them clipped
+	const thrender::interpolation_mode modes[] = {
+			thrender::interpolation_mode::linear,
+			thrender::interpolation_mode::perspective};
+	checks::mesh_type mesh = checks::random_triangles(200, 0.5f, 7);
+	for(size_t v = 0;v < mesh.vertices.size();v++) {
+		glm::vec4 & pos = VA_ATTRIBUTE(mesh.vertices[v], thrender::POSITION);
+		pos.z = pos.x * 6.0f + (v % 3) * 2.0f;
+	}
+	mesh.data_updated();
+	vx_shader.mvp_mat = cam.projection_mat * cam.view_mat * glm::scale(glm::mat4(1.0f), glm::vec3(4.0f, 3.0f, 1.0f));
+	for(size_t m = 0;m < 2;m++) {
+		plane_ctx.interpolation = barycentric_ctx.interpolation = modes[m];
+		plane_fb.clear_all();
+		barycentric_fb.clear_all();
+		plane_pp.draw(mesh, plane_ctx);
+		barycentric_pp.draw(mesh, barycentric_ctx);
+		CHECK(checks::covered_pixels(plane_fb) > 0);
+		CHECK(color_difference(plane_fb, barycentric_fb) < 1e-3f);
+	}
+
+	return checks::result();
+}
@@ -0,0 +1,99 @@
+/*
+ * rasterizer.cpp
+ *
+ * Checks the fill convention of the half-space rasterizer. Pixels on
+ * an edge shared by two triangles must be rasterized exactly once, and
+ * no pixel whose center is inside a mesh may be missed.
+ */
+#include "check.hpp"
+
+//! Fragment shader that counts the fragments of every pixel
+struct counting_fg_shader {
+
+	template<class RenderableType>
+	void operator()(thrender::framebuffer_array & fb, const thrender::fragment_processing_control<RenderableType> & api) {
+		FB_PIXEL(fb.color_buffer()) += glm::vec4(1.0f);
+	}
+};
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		counting_fg_shader> pipeline_type;
+
+//! Check if a point is inside a convex polygon, farther than margin from its edges
+bool is_inside(const glm::vec2 * polygon, size_t size, const glm::vec2 & p, float margin) {
+	for(size_t i = 0;i < size;i++) {
+		glm::vec2 a = polygon[i], b = polygon[(i + 1) % size];
+		glm::vec2 edge = b - a;
+		float distance = (edge.x * (p.y - a.y) - edge.y * (p.x - a.x)) / std::sqrt(edge.x * edge.x + edge.y * edge.y);
+		if (distance < margin)
+			return false;
+	}
+	return true;
+}
+
+int main() {
+
+	const size_t width = 64, height = 64;
+	thrender::framebuffer_array gbuff(width, height);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 1.0f, 5, 50);
+	thrender::render_context ctx(cam, gbuff);
+
+	thrender::shaders::default_vx_shader vx_shader;
+	counting_fg_shader fg_shader;
+	vx_shader.mvp_mat = glm::mat4(1.0f);
+	pipeline_type pp(vx_shader, fg_shader);
+
+	// Colors start at zero and count fragments
+	gbuff.color_buffer().set_clear_value(glm::vec4(0.0f));
+
+	// Rectangles split on their diagonal, with edges on pixel boundaries
+	// and through pixel centers. Both cover the same pixels, as pixel
+	// centers on the right or bottom edges are left out.
+	const float bounds[2][2] = {{-0.5f, 0.5f}, {-0.484375f, 0.515625f}};
+	for(size_t r = 0;r < 2;r++) {
+		checks::mesh_type rect = checks::rectangle(bounds[r][0], bounds[r][0], bounds[r][1], bounds[r][1], 0.5f, glm::vec4(0.0f));
+		gbuff.clear_all();
+		pp.draw(rect, ctx);
+		size_t wrong = 0;
+		for(size_t y = 0;y < height;y++) {
+			for(size_t x = 0;x < width;x++) {
+				float expected = (x >= 16 && x < 48 && y >= 16 && y < 48) ? 1.0f : 0.0f;
+				if (gbuff.color_buffer()[y][x].x != expected)
+					wrong++;
+			}
+		}
+		CHECK(wrong == 0);
+	}
+
+	// Fan of triangles around a center that is not on the pixel grid
+	const size_t sides = 13;
+	checks::mesh_type fan(sides + 1, sides);
+	glm::vec2 outline[sides];
+	VA_ATTRIBUTE(fan.vertices[0], thrender::POSITION) = glm::vec4(0.0313f, -0.0719f, 0.5f, 1.0f);
+	for(size_t i = 0;i < sides;i++) {
+		float angle = 0.37f + 2.0f * 3.14159265f * i / sides;
+		glm::vec4 pos(0.83f * std::cos(angle), 0.87f * std::sin(angle), 0.5f, 1.0f);
+		VA_ATTRIBUTE(fan.vertices[i + 1], thrender::POSITION) = pos;
+		outline[i] = glm::vec2((pos.x + 1.0f) * width / 2, (pos.y + 1.0f) * height / 2);
+		fan.element_indices[i] = thrender::indices3_t(0, i + 1, (i + 1) % sides + 1);
+	}
+	fan.data_updated();
+
+	gbuff.clear_all();
+	pp.draw(fan, ctx);
+	size_t overdrawn = 0, missed = 0;
+	for(size_t y = 0;y < height;y++) {
+		for(size_t x = 0;x < width;x++) {
+			float count = gbuff.color_buffer()[y][x].x;
+			if (count > 1.0f)
+				overdrawn++;
+			if (count < 1.0f && is_inside(outline, sides, glm::vec2(x + 0.5f, y + 0.5f), 0.001f))
+				missed++;
+		}
+	}
+	CHECK(overdrawn == 0);
+	CHECK(missed == 0);
+
+	return checks::result();
+}
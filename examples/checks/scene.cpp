@@ -0,0 +1,97 @@
+/*
+ * scene.cpp
+ *
+ * Checks hierarchical culling of scenes. The objects that the BVH
+ * finds visible must be exactly those that pass a linear test of every
+ * object against the view frustum, while objects move and meshes
+ * change, and drawing a scene must give the image of drawing all of its
+ * objects one by one.
+ */
+#include "check.hpp"
+#include <algorithm>
+#include <vector>
+
+typedef thrender::scene<checks::mesh_type> scene_type;
+
+//! Get the ids of objects that intersect the view frustum, by testing each one
+scene_type::object_ids_type linear_cull(const scene_type & objects, const thrender::camera & cam) {
+	thrender::frustum view = cam.view_frustum();
+	scene_type::object_ids_type visible_ids;
+	for(size_t i = 0;i < objects.size();i++) {
+		if (view.intersects(objects.object(i).bounding_box().transformed(objects.transform(i))))
+			visible_ids.push_back(i);
+	}
+	return visible_ids;
+}
+
+//! Get a random translation
+glm::mat4 random_transform(checks::random & rng, float extent) {
+	return glm::translate(glm::mat4(1.0f), glm::vec3(
+			rng.uniform(-extent, extent), rng.uniform(-extent, extent), rng.uniform(-extent, extent)));
+}
+
+int main() {
+
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 1, 50);
+	checks::mesh_type sphere = checks::sphere(6);
+	checks::mesh_type triangle = checks::random_triangles(1, 0.5f, 9);
+
+	// Culling with the BVH matches linear culling
+	scene_type objects;
+	checks::random rng(10);
+	const size_t count = 5000;
+	for(size_t i = 0;i < count;i++)
+		objects.add(i % 2 ? sphere : triangle, random_transform(rng, 60.0f));
+
+	for(size_t round = 0;round < 4;round++) {
+		scene_type::object_ids_type visible_ids;
+		objects.cull(cam, visible_ids);
+		std::sort(visible_ids.begin(), visible_ids.end());
+		scene_type::object_ids_type expected = linear_cull(objects, cam);
+		CHECK(!expected.empty());
+		CHECK(visible_ids.size() == expected.size() && std::equal(expected.begin(), expected.end(), visible_ids.begin()));
+
+		// Move some objects and grow one of the meshes
+		for(size_t i = round;i < count;i += 3)
+			objects.set_transform(i, random_transform(rng, 30.0f));
+		if (round == 1) {
+			VA_ATTRIBUTE(triangle.vertices[2], thrender::POSITION) = glm::vec4(0.0f, 9.0f, 0.0f, 1.0f);
+			triangle.data_updated();
+			objects.object_updated(triangle);
+		}
+	}
+
+	// Drawing a scene gives the image of drawing all objects
+	thrender::framebuffer_array scene_fb(320, 240), reference_fb(320, 240);
+	thrender::render_context scene_ctx(cam, scene_fb), reference_ctx(cam, reference_fb);
+	glm::mat4 vp_mat = cam.projection_mat * cam.view_mat;
+
+	scene_type small;
+	for(size_t i = 0;i < 200;i++)
+		small.add(sphere, random_transform(rng, 20.0f));
+
+	{
+		thrender::shaders::instanced_vx_shader vx_shader;
+		thrender::shaders::default_fg_shader fg_shader;
+		thrender::pipeline<checks::mesh_type, thrender::shaders::instanced_vx_shader, thrender::shaders::default_fg_shader> pp(vx_shader, fg_shader);
+		thrender::render_batch<checks::mesh_type> batch;
+		scene_fb.clear_all();
+		pp.draw_scene(small, batch, scene_ctx);
+		CHECK(batch.size() > 0 && batch.size() < small.size());
+	}
+	{
+		thrender::shaders::default_vx_shader vx_shader;
+		thrender::shaders::default_fg_shader fg_shader;
+		thrender::pipeline<checks::mesh_type, thrender::shaders::default_vx_shader, thrender::shaders::default_fg_shader> pp(vx_shader, fg_shader);
+		reference_ctx.object_culling = false;
+		reference_fb.clear_all();
+		for(size_t i = 0;i < small.size();i++) {
+			vx_shader.mvp_mat = vp_mat * small.transform(i);
+			pp.draw(sphere, reference_ctx);
+		}
+	}
+	CHECK(checks::covered_pixels(reference_fb) > 0);
+	CHECK(checks::same_image(scene_fb, reference_fb));
+
+	return checks::result();
+}
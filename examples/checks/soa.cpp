@@ -0,0 +1,127 @@
+/*
+ * soa.cpp
+ *
+ * Checks vertex processing in packets. Vertex shaders that process
+ * packets must output the same vertices as when they process one
+ * vertex at a time, and packets gathered from vertices must be the
+ * same as those loaded from the structure of arrays copy.
+ */
+#include "check.hpp"
+#include <algorithm>
+
+//! Wrapper that hides the packet overload of a vertex shader
+template<class Shader>
+struct scalar_vx_shader {
+
+	Shader & shader;
+
+	typedef typename Shader::varyings_type varyings_type;
+
+	explicit scalar_vx_shader(Shader & _shader)
+	:
+		shader(_shader)
+	{}
+
+	template<class RenderableType>
+	void operator()(const typename RenderableType::vertex_type & vin, typename RenderableType::vertex_type & vout,
+			thrender::vertex_processing_control<RenderableType> & vcontrol) {
+		shader(vin, vout, vcontrol);
+	}
+
+	void prepare(thrender::render_context & ctx) {
+		thrender::details::prepare_shader(shader, ctx);
+	}
+};
+
+//! Get the largest difference of processed positions and colors of two objects
+float vertex_difference(const checks::mesh_type & a, const checks::mesh_type & b) {
+	const checks::mesh_type::intermediate_buffer_type & ia = a.intermediate_buffer(), & ib = b.intermediate_buffer();
+	float difference = 0.0f;
+	for(size_t v = 0;v < a.vertices.size();v++) {
+		glm::vec4 position = ia.processed_vertices.attribute<thrender::POSITION>(v) - ib.processed_vertices.attribute<thrender::POSITION>(v);
+		glm::vec4 color = ia.processed_vertices.attribute<thrender::COLOR>(v) - ib.processed_vertices.attribute<thrender::COLOR>(v);
+		for(size_t i = 0;i < 4;i++)
+			difference = std::max(difference, std::max(std::fabs(position[i]), std::fabs(color[i])));
+	}
+	return difference;
+}
+
+//! Draw an object with a vertex shader, with and without its packet overload
+template<class Shader>
+float packet_difference(Shader & shader, checks::mesh_type & mesh, thrender::render_context & ctx) {
+	scalar_vx_shader<Shader> scalar_shader(shader);
+	thrender::shaders::default_fg_shader fg_shader;
+	thrender::pipeline<checks::mesh_type, Shader, thrender::shaders::default_fg_shader> packet_pp(shader, fg_shader);
+	thrender::pipeline<checks::mesh_type, scalar_vx_shader<Shader>, thrender::shaders::default_fg_shader> scalar_pp(scalar_shader, fg_shader);
+
+	checks::mesh_type scalar_mesh = mesh;
+	packet_pp.draw(mesh, ctx);
+	scalar_pp.draw(scalar_mesh, ctx);
+	return vertex_difference(mesh, scalar_mesh);
+}
+
+int main() {
+
+	thrender::framebuffer_array fb(320, 240);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context ctx(cam, fb);
+
+	// Vertices are not a whole number of packets
+	checks::mesh_type mesh = checks::random_triangles(401, 0.3f, 17);
+	checks::random rng(18);
+	for(size_t v = 0;v < mesh.vertices.size();v++) {
+		VA_ATTRIBUTE(mesh.vertices[v], thrender::NORMAL) = glm::vec4(
+				rng.uniform(-1.0f, 1.0f), rng.uniform(-1.0f, 1.0f), rng.uniform(-1.0f, 1.0f), 0.0f);
+	}
+	mesh.data_updated();
+
+	// Packet and scalar overloads agree, up to the order of operations
+	thrender::shaders::default_vx_shader default_shader;
+	default_shader.mvp_mat = cam.projection_mat * cam.view_mat * glm::scale(glm::mat4(1.0f), glm::vec3(3.0f, 3.0f, 1.0f));
+	CHECK(packet_difference(default_shader, mesh, ctx) < 1e-4f);
+
+	thrender::shaders::gouraud_vx_shader gouraud_shader;
+	gouraud_shader.mModel = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f, -0.2f, 1.0f)), glm::vec3(2.0f));
+	gouraud_shader.mView = cam.view_mat;
+	gouraud_shader.mProjection = cam.projection_mat;
+	gouraud_shader.vCameraPos_ws = glm::vec4(0, 0, -10, 1);
+	gouraud_shader.light.position_ws = glm::vec4(-3, 4, -6, 1);
+	gouraud_shader.light.diffuse_color = glm::vec4(0.8f, 0.7f, 0.6f, 1.0f);
+	gouraud_shader.light.specular_color = glm::vec4(1.0f);
+	gouraud_shader.material.diffuse_color = glm::vec4(0.5f, 0.6f, 0.7f, 1.0f);
+	gouraud_shader.material.specular_color = glm::vec4(0.4f);
+	gouraud_shader.material.emissive_color = glm::vec4(0.1f, 0.1f, 0.1f, 0.0f);
+	gouraud_shader.material.shininess = 8.0f;
+	CHECK(packet_difference(gouraud_shader, mesh, ctx) < 1e-4f);
+
+	// Packets gathered from vertices or loaded from the copy are the
+	// same, also after a partial update of the copy
+	thrender::shaders::default_fg_shader fg_shader;
+	thrender::pipeline<checks::mesh_type, thrender::shaders::gouraud_vx_shader,
+		thrender::shaders::default_fg_shader> pp(gouraud_shader, fg_shader);
+	checks::mesh_type kept = mesh;
+	kept.keep_vertex_streams(true);
+	for(size_t round = 0;round < 2;round++) {
+		pp.draw(mesh, ctx);
+		pp.draw(kept, ctx);
+		CHECK(mesh.vertex_streams().size() == 0);
+		CHECK(kept.vertex_streams().size() == kept.vertices.size());
+		CHECK(vertex_difference(mesh, kept) == 0.0f);
+
+		for(size_t v = 100;v < 150;v++) {
+			VA_ATTRIBUTE(mesh.vertices[v], thrender::POSITION).x += 0.1f;
+			VA_ATTRIBUTE(kept.vertices[v], thrender::POSITION).x += 0.1f;
+		}
+		mesh.vertices_updated(100, 50);
+		kept.vertices_updated(100, 50);
+	}
+
+	// Dropping the copy frees it
+	kept.keep_vertex_streams(false);
+	pp.draw(mesh, ctx);
+	pp.draw(kept, ctx);
+	CHECK(kept.vertex_streams().size() == 0);
+	CHECK(vertex_difference(mesh, kept) == 0.0f);
+
+	return checks::result();
+}
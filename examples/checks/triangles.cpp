@@ -0,0 +1,123 @@
+/*
+ * triangles.cpp
+ *
+ * Checks index only triangles. Elements must hold the indices of their
+ * vertices only, offset to the processed vertices of their draw or
+ * indexing the clipped vertices, so that objects draw the same image
+ * after they are copied or moved around.
+ */
+#include "check.hpp"
+#include <algorithm>
+#include <vector>
+
+//! Check that the vertices of the clipped elements lie inside the window space box of the element they come from
+bool clipped_inside_origins(const checks::mesh_type & mesh) {
+	const checks::mesh_type::intermediate_buffer_type & ib = mesh.intermediate_buffer();
+	const float epsilon = 1e-3f;
+	for(size_t c = 0;c < ib.clipped_elements.size();c++) {
+		thrender::primitive_id_t origin = ib.clipped_origins[c];
+		glm::vec4 box = thrender::triangle_bounding_box(ib.element_position(origin, 0),
+				ib.element_position(origin, 1), ib.element_position(origin, 2));
+		for(size_t i = 0;i < 3;i++) {
+			if (ib.clipped_elements[c].indices[i] >= ib.clipped_vertices.size())
+				return false;
+			glm::vec4 pos = ib.element_position(ib.elements.size() + c, i);
+			if (pos.x < box[0] - epsilon || pos.x > box[0] + box[2] + epsilon
+				|| pos.y < box[1] - epsilon || pos.y > box[1] + box[3] + epsilon)
+				return false;
+		}
+	}
+	return true;
+}
+
+//! Draw every triangle of an object as an object of its own
+void draw_one_by_one(const checks::mesh_type & mesh, thrender::render_context & ctx) {
+	thrender::shaders::default_vx_shader vx_shader;
+	thrender::shaders::default_fg_shader fg_shader;
+	thrender::pipeline<checks::mesh_type, thrender::shaders::default_vx_shader, thrender::shaders::default_fg_shader> pp(vx_shader, fg_shader);
+	vx_shader.mvp_mat = glm::mat4(1.0f);
+	ctx.fb.clear_all();
+	for(size_t e = 0;e < mesh.element_indices.size();e++) {
+		checks::mesh_type single(3, 1);
+		for(size_t i = 0;i < 3;i++)
+			single.vertices[i] = mesh.vertices[mesh.element_indices[e][i]];
+		single.element_indices[0] = thrender::indices3_t(0, 1, 2);
+		single.data_updated();
+		pp.draw(single, ctx);
+	}
+}
+
+int main() {
+
+	thrender::framebuffer_array fb(320, 240), reference(320, 240);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context ctx(cam, fb), reference_ctx(cam, reference);
+
+	// Elements are their indices and nothing else
+	CHECK(sizeof(checks::mesh_type::triangle_type) == sizeof(thrender::indices3_t));
+
+	thrender::shaders::default_vx_shader vx_shader;
+	thrender::shaders::default_fg_shader fg_shader;
+	thrender::pipeline<checks::mesh_type, thrender::shaders::default_vx_shader, thrender::shaders::default_fg_shader> pp(vx_shader, fg_shader);
+	vx_shader.mvp_mat = glm::mat4(1.0f);
+
+	// Most triangles cross the near plane, so clipped vertices grow
+	// while they are clipped
+	checks::mesh_type mesh = checks::random_triangles(301, 0.4f, 81);
+	for(size_t e = 0;e < mesh.element_indices.size();e += 4)
+		VA_ATTRIBUTE(mesh.vertices[mesh.element_indices[e][0]], thrender::POSITION).z = -1.5f;
+	for(size_t e = 1;e < mesh.element_indices.size();e += 4) {
+		VA_ATTRIBUTE(mesh.vertices[mesh.element_indices[e][0]], thrender::POSITION).z = -1.5f;
+		VA_ATTRIBUTE(mesh.vertices[mesh.element_indices[e][1]], thrender::POSITION).z = -1.2f;
+	}
+	mesh.data_updated();
+	fb.clear_all();
+	pp.draw(mesh, ctx);
+	const checks::mesh_type::intermediate_buffer_type & ib = mesh.intermediate_buffer();
+	CHECK(ib.clipped_elements.size() > 50);
+	CHECK(clipped_inside_origins(mesh));
+	draw_one_by_one(mesh, reference_ctx);
+	CHECK(checks::covered_pixels(fb) > 0);
+	CHECK(checks::same_image(fb, reference));
+
+	// Elements of many draws are offset to the vertices of their draw
+	const size_t count = 3;
+	thrender::shaders::instance_transform instances[count];
+	for(size_t i = 0;i < count;i++) {
+		instances[i].model_mat = glm::translate(glm::mat4(1.0f), glm::vec3(0.2f * i, 0.0f, 0.0f));
+		instances[i].update(glm::mat4(1.0f));
+	}
+	thrender::shaders::instanced_vx_shader instanced_shader;
+	thrender::pipeline<checks::mesh_type, thrender::shaders::instanced_vx_shader,
+		thrender::shaders::default_fg_shader> instanced_pp(instanced_shader, fg_shader);
+	fb.clear_all();
+	instanced_pp.draw_instanced(mesh, instances, count, ctx);
+	CHECK(ib.draws.size() == count);
+	bool offset = true;
+	for(size_t d = 0;d < ib.draws.size();d++) {
+		for(size_t e = 0;e < mesh.element_indices.size();e++) {
+			if (ib.elements[ib.draws[d].first_element + e].indices
+				!= mesh.element_indices[e] + thrender::indices3_t(ib.draws[d].first_vertex))
+				offset = false;
+		}
+	}
+	CHECK(offset);
+	CHECK(clipped_inside_origins(mesh));
+
+	// Objects copied and moved around after drawing draw the same image
+	std::vector<checks::mesh_type> copies;
+	for(size_t i = 0;i < 8;i++) {
+		copies.push_back(mesh);
+		pp.draw(copies.back(), ctx);
+	}
+	fb.clear_all();
+	pp.draw(mesh, ctx);
+	for(size_t i = 0;i < copies.size();i++) {
+		reference.clear_all();
+		pp.draw(copies[i], reference_ctx);
+		CHECK(checks::same_image(fb, reference));
+		CHECK(clipped_inside_origins(copies[i]));
+	}
+
+	return checks::result();
+}
@@ -0,0 +1,117 @@
+/*
+ * varyings.cpp
+ *
+ * Checks declared varyings. A vertex shader that declares the
+ * attributes it outputs must draw the same image as the same shader
+ * processing and interpolating all attributes, while only its declared
+ * attributes are setup, on both vertex shading paths.
+ */
+#include "check.hpp"
+
+//! Wrapper that hides the varyings of a vertex shader, so that it outputs all attributes
+template<class Shader>
+struct all_attributes_vx_shader {
+
+	Shader & shader;
+
+	explicit all_attributes_vx_shader(Shader & _shader)
+	:
+		shader(_shader)
+	{}
+
+	template<class RenderableType>
+	void operator()(const typename RenderableType::vertex_type & vin, typename RenderableType::vertex_type & vout,
+			thrender::vertex_processing_control<RenderableType> & vcontrol) {
+		shader(vin, vout, vcontrol);
+	}
+
+	//! Packet overload, only if the shader has one
+	template<class RenderableType>
+	auto operator()(const typename RenderableType::vertex_packet_type & vin, typename RenderableType::vertex_packet_type & vout,
+			thrender::vertex_packet_control<RenderableType> & vcontrol) -> decltype(shader(vin, vout, vcontrol)) {
+		shader(vin, vout, vcontrol);
+	}
+
+	void prepare(thrender::render_context & ctx) {
+		thrender::details::prepare_shader(shader, ctx);
+	}
+};
+
+//! Vertex shader without the packet operator
+struct scalar_vx_shader : public thrender::shaders::default_vx_shader {
+
+	typedef thrender::shaders::default_vx_shader base_type;
+
+	template<class RenderableType>
+	void operator()(const typename RenderableType::vertex_type & vin, typename RenderableType::vertex_type & vout,
+			thrender::vertex_processing_control<RenderableType> & vcontrol) {
+		base_type::operator()(vin, vout, vcontrol);
+	}
+};
+
+//! Draw an object with a vertex shader, with and without its varyings, and compare
+template<class Shader>
+void check_varyings(Shader & shader, checks::mesh_type & mesh, thrender::render_context & varyings_ctx,
+		thrender::render_context & all_ctx) {
+	all_attributes_vx_shader<Shader> all_shader(shader);
+	thrender::shaders::default_fg_shader fg_shader;
+	thrender::pipeline<checks::mesh_type, Shader, thrender::shaders::default_fg_shader> varyings_pp(shader, fg_shader);
+	thrender::pipeline<checks::mesh_type, all_attributes_vx_shader<Shader>,
+		thrender::shaders::default_fg_shader> all_pp(all_shader, fg_shader);
+
+	checks::mesh_type all_mesh = mesh;
+	varyings_ctx.fb.clear_all();
+	all_ctx.fb.clear_all();
+	varyings_pp.draw(mesh, varyings_ctx);
+	all_pp.draw(all_mesh, all_ctx);
+	CHECK(checks::covered_pixels(varyings_ctx.fb) > 0);
+	CHECK(checks::same_image(varyings_ctx.fb, all_ctx.fb));
+
+	const size_t position_color = (size_t(1) << thrender::POSITION) | (size_t(1) << thrender::COLOR);
+	CHECK(mesh.intermediate_buffer().interpolated_attributes == position_color);
+	CHECK((all_mesh.intermediate_buffer().interpolated_attributes & position_color) == position_color);
+	CHECK(all_mesh.intermediate_buffer().interpolated_attributes != position_color);
+}
+
+int main() {
+
+	thrender::framebuffer_array varyings_fb(320, 240), all_fb(320, 240);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context varyings_ctx(cam, varyings_fb), all_ctx(cam, all_fb);
+
+	// Vertices are not a whole number of packets, and some
+	// triangles are clipped
+	checks::mesh_type mesh = checks::random_triangles(301, 0.4f, 71, -1.4f, 0.9f);
+	checks::random rng(72);
+	for(size_t v = 0;v < mesh.vertices.size();v++) {
+		VA_ATTRIBUTE(mesh.vertices[v], thrender::NORMAL) = glm::vec4(
+				rng.uniform(-1.0f, 1.0f), rng.uniform(-1.0f, 1.0f), rng.uniform(-1.0f, 1.0f), 0.0f);
+	}
+	mesh.data_updated();
+
+	// Shaders that pass the color through
+	thrender::shaders::default_vx_shader default_shader;
+	default_shader.mvp_mat = glm::mat4(1.0f);
+	check_varyings(default_shader, mesh, varyings_ctx, all_ctx);
+
+	scalar_vx_shader scalar_shader;
+	scalar_shader.mvp_mat = glm::mat4(1.0f);
+	check_varyings(scalar_shader, mesh, varyings_ctx, all_ctx);
+
+	// A shader that computes the color
+	thrender::shaders::gouraud_vx_shader gouraud_shader;
+	gouraud_shader.mModel = glm::scale(glm::mat4(1.0f), glm::vec3(3.0f, 3.0f, 1.0f));
+	gouraud_shader.mView = cam.view_mat;
+	gouraud_shader.mProjection = cam.projection_mat;
+	gouraud_shader.vCameraPos_ws = glm::vec4(0, 0, -10, 1);
+	gouraud_shader.light.position_ws = glm::vec4(-3, 4, -6, 1);
+	gouraud_shader.light.diffuse_color = glm::vec4(0.8f, 0.7f, 0.6f, 1.0f);
+	gouraud_shader.light.specular_color = glm::vec4(1.0f);
+	gouraud_shader.material.diffuse_color = glm::vec4(0.5f, 0.6f, 0.7f, 1.0f);
+	gouraud_shader.material.specular_color = glm::vec4(0.4f);
+	gouraud_shader.material.emissive_color = glm::vec4(0.1f, 0.1f, 0.1f, 0.0f);
+	gouraud_shader.material.shininess = 8.0f;
+	check_varyings(gouraud_shader, mesh, varyings_ctx, all_ctx);
+
+	return checks::result();
+}
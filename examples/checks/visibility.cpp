@@ -0,0 +1,117 @@
+/*
+ * visibility.cpp
+ *
+ * Checks the visibility buffer mode. Every object drawn gets its own
+ * range of ids, and resolving shades each covered pixel once, giving
+ * the image of forward rendering. An object can be drawn only once.
+ */
+#include "check.hpp"
+#include <atomic>
+#include <stdexcept>
+
+//! Fragment shader that counts the fragments it shades
+struct counting_fg_shader {
+
+	std::atomic<size_t> fragments;
+
+	counting_fg_shader()
+	:
+		fragments(0)
+	{}
+
+	template<class RenderableType>
+	void operator()(thrender::framebuffer_array & fb, const thrender::fragment_processing_control<RenderableType> & api) {
+		fragments++;
+		FB_PIXEL(fb.color_buffer()) = INTERPOLATE(thrender::COLOR);
+	}
+};
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		counting_fg_shader> pipeline_type;
+
+//! Check if an id is inside the range of an object
+bool is_in_range(thrender::framebuffer_array & fb, thrender::visibility_pixel_t id, const checks::mesh_type & object) {
+	const thrender::framebuffer_array::visibility_range * range = fb.find_visibility_range(id);
+	return range && range->owner == &object && range->first == object.intermediate_buffer().visibility_base
+		&& range->count == object.intermediate_buffer().setups.size();
+}
+
+int main() {
+
+	const size_t width = 320, height = 240;
+	thrender::framebuffer_array forward(width, height), deferred(width, height);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context forward_ctx(cam, forward), deferred_ctx(cam, deferred);
+
+	thrender::shaders::default_vx_shader vx_shader;
+	counting_fg_shader fg_shader;
+	vx_shader.mvp_mat = glm::mat4(1.0f);
+	pipeline_type pp(vx_shader, fg_shader);
+
+	checks::mesh_type first = checks::random_triangles(800, 0.3f, 4);
+	checks::mesh_type second = checks::random_triangles(800, 0.3f, 5);
+	checks::mesh_type culled = checks::random_triangles(100, 0.3f, 6);
+	glm::mat4 away = glm::translate(glm::mat4(1.0f), glm::vec3(100.0f, 0.0f, 0.0f));
+
+	forward.clear_all();
+	pp.draw(first, forward_ctx);
+	pp.draw(second, forward_ctx);
+	size_t forward_fragments = fg_shader.fragments;
+
+	deferred.clear_all();
+	deferred_ctx.object_culling = true;
+	pp.draw_visibility(first, deferred_ctx);
+	pp.draw_visibility(second, deferred_ctx);
+	pp.draw_visibility(culled, away, deferred_ctx);
+	CHECK(deferred.visibility_ranges().size() == 2);
+
+	// Ranges of ids are disjoint and cover all written ids
+	const checks::mesh_type::intermediate_buffer_type & first_ib = first.intermediate_buffer();
+	CHECK(first_ib.visibility_base + first_ib.setups.size() <= second.intermediate_buffer().visibility_base);
+	size_t unknown_ids = 0;
+	for(size_t y = 0;y < height;y++) {
+		for(size_t x = 0;x < width;x++) {
+			thrender::visibility_pixel_t id = deferred.visibility_buffer()[y][x];
+			if (id != thrender::default_visibility_clear_value && !is_in_range(deferred, id, first) && !is_in_range(deferred, id, second))
+				unknown_ids++;
+		}
+	}
+	CHECK(unknown_ids == 0);
+
+	// Drawing an object twice would lose the ids of the first draw
+	bool thrown = false;
+	try {
+		pp.draw_visibility(first, deferred_ctx);
+	} catch(const std::logic_error &) {
+		thrown = true;
+	}
+	CHECK(thrown);
+
+	// Resolving shades each covered pixel once, as forward rendering
+	fg_shader.fragments = 0;
+	pp.resolve(deferred_ctx);
+	size_t covered = checks::covered_pixels(deferred);
+	CHECK(fg_shader.fragments == covered);
+	CHECK(forward_fragments > covered);
+
+	size_t wrong = 0;
+	for(size_t y = 0;y < height;y++) {
+		for(size_t x = 0;x < width;x++) {
+			glm::vec4 difference = forward.color_buffer()[y][x] - deferred.color_buffer()[y][x];
+			if (forward.depth_buffer()[y][x] != deferred.depth_buffer()[y][x]
+				|| glm::dot(difference, difference) > 1e-8f)
+				wrong++;
+		}
+	}
+	CHECK(wrong == 0);
+
+	// On a new frame objects can be drawn again
+	deferred.clear_all();
+	pp.draw_visibility(second, deferred_ctx);
+	pp.draw_visibility(first, deferred_ctx);
+	CHECK(deferred.visibility_ranges().size() == 2);
+	CHECK(first.intermediate_buffer().visibility_base > second.intermediate_buffer().visibility_base);
+
+	return checks::result();
+}
@@ -0,0 +1,76 @@
+/*
+ * winding.cpp
+ *
+ * Checks face culling by winding order. Counter-clock-wise triangles
+ * must be dropped only when front faces are culled and clock-wise ones
+ * only when back faces are, also when they are split by clipping.
+ */
+#include "check.hpp"
+
+typedef thrender::pipeline<checks::mesh_type,
+		thrender::shaders::default_vx_shader,
+		thrender::shaders::default_fg_shader> pipeline_type;
+
+//! Count the pixels of a color
+size_t count_color(thrender::framebuffer_array & fb, const glm::vec4 & color) {
+	size_t count = 0;
+	for(size_t y = 0;y < fb.height();y++) {
+		for(size_t x = 0;x < fb.width();x++) {
+			if (fb.color_buffer()[y][x] == color)
+				count++;
+		}
+	}
+	return count;
+}
+
+int main() {
+
+	thrender::framebuffer_array fb(320, 240);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context ctx(cam, fb);
+
+	thrender::shaders::default_vx_shader vx_shader;
+	thrender::shaders::default_fg_shader fg_shader;
+	pipeline_type pp(vx_shader, fg_shader);
+	vx_shader.mvp_mat = glm::mat4(1.0f);
+
+	// Front and back facing rectangles at the top, and front and back
+	// facing triangles at the bottom with a vertex behind the near plane
+	const glm::vec4 colors[4] = {
+			glm::vec4(1, 0, 0, 1), glm::vec4(0, 1, 0, 1),
+			glm::vec4(0, 0, 1, 1), glm::vec4(1, 1, 0, 1)};
+	checks::mesh_type front = checks::rectangle(-0.9f, 0.1f, -0.1f, 0.9f, 0.5f, colors[0]),
+		back = checks::rectangle(0.1f, 0.1f, 0.9f, 0.9f, 0.5f, colors[1]);
+	for(size_t e = 0;e < back.element_indices.size();e++) {
+		thrender::indices3_t tr = back.element_indices[e];
+		back.element_indices[e] = thrender::indices3_t(tr.z, tr.y, tr.x);
+	}
+	back.data_updated();
+
+	checks::mesh_type clipped(6, 2);
+	const glm::vec4 positions[6] = {
+			glm::vec4(-0.9f, -0.9f, 0.5f, 1.0f), glm::vec4(-0.1f, -0.9f, -3.0f, 1.0f), glm::vec4(-0.5f, -0.1f, 0.5f, 1.0f),
+			glm::vec4(0.9f, -0.9f, 0.5f, 1.0f), glm::vec4(0.1f, -0.9f, -3.0f, 1.0f), glm::vec4(0.5f, -0.1f, 0.5f, 1.0f)};
+	for(size_t v = 0;v < 6;v++) {
+		VA_ATTRIBUTE(clipped.vertices[v], thrender::POSITION) = positions[v];
+		VA_ATTRIBUTE(clipped.vertices[v], thrender::COLOR) = colors[2 + v / 3];
+	}
+	clipped.element_indices[0] = thrender::indices3_t(0, 1, 2);
+	clipped.element_indices[1] = thrender::indices3_t(3, 4, 5);
+	clipped.data_updated();
+
+	// Which colors are drawn by each mode
+	const thrender::cull_mode modes[3] = {thrender::cull_mode::none, thrender::cull_mode::back, thrender::cull_mode::front};
+	const bool drawn[3][4] = {{true, true, true, true}, {true, false, true, false}, {false, true, false, true}};
+	for(size_t m = 0;m < 3;m++) {
+		ctx.culling = modes[m];
+		fb.clear_all();
+		pp.draw(front, ctx);
+		pp.draw(back, ctx);
+		pp.draw(clipped, ctx);
+		for(size_t c = 0;c < 4;c++)
+			CHECK((count_color(fb, colors[c]) > 0) == drawn[m][c]);
+	}
+
+	return checks::result();
+}
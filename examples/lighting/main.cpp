@@ -113,6 +113,7 @@ void render() {
 		{	PROFILE_BLOCK(prof, "Upload images");
 			upload_images(gbuff);
 		}
+		ctx.end_frame();
 		std::cout << prof.report() << std::endl;
 
 		process_events();
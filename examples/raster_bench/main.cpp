@@ -0,0 +1,83 @@
+/*
+ * main.cpp
+ *
+ * Benchmark of the available rasterization algorithms. A mesh
+ * of random triangles is rendered offscreen with every algorithm
+ * and the average time per frame is reported.
+ */
+#include <glm/glm.hpp>
+#include <thrust/host_vector.h>
+#include <boost/random.hpp>
+#include <iostream>
+
+#include "thrender/thrender.hpp"
+#include "thrender/utils/to_string.hpp"
+#include "thrender/utils/profiler.hpp"
+
+typedef thrender::renderable<thrust::tuple<
+		glm::vec4,
+		glm::vec4,
+		glm::vec4,
+		glm::vec2> > mesh_type;
+
+//! Generate a mesh of random triangles inside the NDC cube
+mesh_type generate_mesh(size_t total_triangles, float max_edge) {
+	mesh_type m(total_triangles * 3, total_triangles);
+
+	boost::random::mt19937 rng;
+	boost::random::uniform_real_distribution<float> ndc(-1.0f, 1.0f);
+	boost::random::uniform_real_distribution<float> edge(-max_edge, max_edge);
+	boost::random::uniform_real_distribution<float> one(0.0f, 1.0f);
+
+	for(size_t i = 0;i < total_triangles;i++) {
+		glm::vec4 center(ndc(rng), ndc(rng), ndc(rng) * 0.9f, 1.0f);
+		for(size_t v = 0;v < 3;v++) {
+			glm::vec4 pos = center + glm::vec4(edge(rng), edge(rng), 0.0f, 0.0f);
+			pos.x = glm::clamp(pos.x, -0.99f, 0.99f);
+			pos.y = glm::clamp(pos.y, -0.99f, 0.99f);
+			VA_ATTRIBUTE(m.vertices[i*3 + v], thrender::POSITION) = pos;
+			VA_ATTRIBUTE(m.vertices[i*3 + v], thrender::COLOR) = glm::vec4(one(rng), one(rng), one(rng), 1.0f);
+		}
+		m.element_indices[i] = thrender::indices3_t(i*3, i*3 + 1, i*3 + 2);
+	}
+	m.data_updated();
+	return m;
+}
+
+int main() {
+
+	const size_t total_frames = 20;
+	thrender::framebuffer_array gbuff(1024, 768);
+	thrender::camera cam(glm::vec3(0, 0, -10), 45, 4.0f / 3.0f, 5, 50);
+	thrender::render_context ctx(cam, gbuff);
+
+	thrender::shaders::default_vx_shader vx_shader;
+	thrender::shaders::default_fg_shader fg_shader;
+	vx_shader.mvp_mat = glm::mat4(1.0f);
+	thrender::pipeline<mesh_type, thrender::shaders::default_vx_shader, thrender::shaders::default_fg_shader> pp(vx_shader, fg_shader);
+
+	const float edge_sizes[] = {0.01f, 0.05f, 0.2f};
+	for(size_t e = 0;e < sizeof(edge_sizes)/sizeof(edge_sizes[0]);e++) {
+		mesh_type mesh = generate_mesh(20000, edge_sizes[e]);
+		std::stringstream title;
+		title << "Triangles with max edge " << edge_sizes[e] << " NDC, " << thrender::utils::to_string(mesh);
+		thrender::utils::profiler<boost::chrono::high_resolution_clock> prof(title.str());
+
+		{	PROFILE_BLOCK(prof, "half_space");
+			ctx.rasterizer = thrender::raster_algorithm::half_space;
+			for(size_t i = 0;i < total_frames;i++) {
+				gbuff.clear_all();
+				pp.draw(mesh, ctx);
+			}
+		}
+		{	PROFILE_BLOCK(prof, "scanline_bresenham");
+			ctx.rasterizer = thrender::raster_algorithm::scanline_bresenham;
+			for(size_t i = 0;i < total_frames;i++) {
+				gbuff.clear_all();
+				pp.draw(mesh, ctx);
+			}
+		}
+		std::cout << prof.report() << "(" << total_frames << " frames per algorithm)" << std::endl;
+	}
+	return 0;
+}
@@ -84,7 +84,15 @@ void render() {
 	thrender::pipeline<mesh_type,thrender::shaders::default_vx_shader, thrender::shaders::default_fg_shader> pp(vx_shader, fg_shader);
 	vx_shader.mvp_mat = ctx.cam.projection_mat * ctx.cam.view_mat;
 
-
+	thrender::shaders::instanced_vx_shader instanced_vx_shader;
+	thrender::pipeline<mesh_type,thrender::shaders::instanced_vx_shader, thrender::shaders::default_fg_shader> instanced_pp(instanced_vx_shader, fg_shader);
+	std::vector<thrender::shaders::instance_transform> instances(500);
+	for(size_t k = 0;k < instances.size();k++){
+		glm::mat4 model_mat(1.0f);
+		model_mat = glm::translate(model_mat, glm::vec3(0,0,0.5*k));
+		model_mat = glm::rotate(model_mat, 45.0f, glm::vec3(1.0f,1.0f,.0f));
+		instances[k].model_mat = model_mat;
+	}
 
 
 	thrender::utils::frame_rate_keeper<> lock_fps(1);
@@ -97,25 +105,23 @@ void render() {
 		{	PROFILE_BLOCK(prof, "Process vertices");
 			thrender::process_vertices(tux, vx_shader, ctx);
 		}
+		{	PROFILE_BLOCK(prof, "Process primitives");
+			thrender::process_primitives(tux, ctx);
+		}
 		{	PROFILE_BLOCK(prof, "Process fragments");
 			thrender::process_fragments(tux, fg_shader, ctx);
 		}
 		{
-			PROFILE_BLOCK(prof, "Pipelined 500 render");
-/*
-			for(int k =0;k < 500;k++){
-				glm::mat4 model_mat(1.0f);
-				model_mat = glm::translate(model_mat, glm::vec3(0,0,0.5*k));
-				model_mat = glm::rotate(model_mat, 45.0f, glm::vec3(1.0f,1.0f,.0f));
-				vx_shader.mvp_mat = ctx.cam.projection_mat * ctx.cam.view_mat * model_mat;
-				pp.draw(tux, ctx);
-			}
-			*/
+			PROFILE_BLOCK(prof, "Instanced 500 render");
+			for(size_t k = 0;k < instances.size();k++)
+				instances[k].update(ctx.cam.projection_mat * ctx.cam.view_mat);
+			instanced_pp.draw_instanced(tux, &instances[0], instances.size(), ctx);
 		}
 
 		{	PROFILE_BLOCK(prof, "Upload images");
 			upload_images(gbuff);
 		}
+		ctx.end_frame();
 		vx_shader.mvp_mat = ctx.cam.projection_mat * ctx.cam.view_mat/* * m.model_mat*/;
 		std::cout << prof.report() << std::endl;
 
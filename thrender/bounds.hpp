@@ -0,0 +1,184 @@
+#pragma once
+
+#include <limits>
+#include <glm/glm.hpp>
+
+namespace thrender {
+
+	//! Axis aligned bounding box
+	struct aabb {
+
+		//! Corner with the minimum coordinates
+		glm::vec3 min;
+
+		//! Corner with the maximum coordinates
+		glm::vec3 max;
+
+		//! Construct an empty box
+		aabb()
+		:
+			min(std::numeric_limits<float>::max()),
+			max(-std::numeric_limits<float>::max())
+		{}
+
+		//! Construct from its corners
+		aabb(const glm::vec3 & _min, const glm::vec3 & _max)
+		:
+			min(_min),
+			max(_max)
+		{}
+
+		//! Check if box holds no point
+		inline bool empty() const {
+			return min.x > max.x || min.y > max.y || min.z > max.z;
+		}
+
+		//! Get the center of the box
+		inline glm::vec3 center() const {
+			return (min + max) * 0.5f;
+		}
+
+		//! Grow box to include a point
+		inline void extend(const glm::vec3 & p) {
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+
+		//! Grow box to include another box
+		inline void extend(const aabb & box) {
+			min = glm::min(min, box.min);
+			max = glm::max(max, box.max);
+		}
+
+		//! Get the box that bounds this one after a transformation
+		aabb transformed(const glm::mat4 & m) const {
+			if (empty())
+				return *this;
+
+			aabb box;
+			for(int i = 0;i < 8;i++) {
+				glm::vec4 corner(
+						(i & 1) ? max.x : min.x,
+						(i & 2) ? max.y : min.y,
+						(i & 4) ? max.z : min.z,
+						1.0f);
+				box.extend(glm::vec3(m * corner));
+			}
+			return box;
+		}
+	};
+
+	//! Bounding sphere
+	struct sphere {
+
+		//! Center of sphere
+		glm::vec3 center;
+
+		//! Radius of sphere, negative if sphere is empty
+		float radius;
+
+		//! Construct an empty sphere
+		sphere()
+		:
+			center(0.0f),
+			radius(-1.0f)
+		{}
+
+		//! Construct from center and radius
+		sphere(const glm::vec3 & _center, float _radius)
+		:
+			center(_center),
+			radius(_radius)
+		{}
+
+		//! Check if sphere holds no point
+		inline bool empty() const {
+			return radius < 0;
+		}
+	};
+
+	//! The six planes of a view frustum
+	/**
+	 * Planes point inwards, a point p is inside a plane when
+	 * dot(plane, vec4(p, 1)) >= 0.
+	 */
+	struct frustum {
+
+		//! Total planes of frustum
+		static const size_t total_planes = 6;
+
+		//! Planes (left, right, bottom, top, near, far), normalized
+		glm::vec4 planes[total_planes];
+
+		//! Extract planes from a matrix that transforms to clip space
+		/**
+		 * Planes are in the space that the matrix transforms from.
+		 * With projection * view they are in world space, with the
+		 * whole model view projection matrix in object space.
+		 */
+		explicit frustum(const glm::mat4 & m) {
+			glm::vec4 row[4];
+			for(int i = 0;i < 4;i++)
+				row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+			planes[0] = row[3] + row[0];
+			planes[1] = row[3] - row[0];
+			planes[2] = row[3] + row[1];
+			planes[3] = row[3] - row[1];
+			planes[4] = row[3] + row[2];
+			planes[5] = row[3] - row[2];
+			for(size_t i = 0;i < total_planes;i++)
+				planes[i] /= glm::length(glm::vec3(planes[i]));
+		}
+
+		//! Check if any part of a box may be inside frustum
+		/**
+		 * Conservative, boxes near the corners of the frustum may
+		 * pass even if they are outside.
+		 */
+		bool intersects(const aabb & box) const {
+			if (box.empty())
+				return false;
+
+			for(size_t i = 0;i < total_planes;i++) {
+				// The corner that is furthest along the plane normal
+				glm::vec3 p(
+						planes[i].x >= 0 ? box.max.x : box.min.x,
+						planes[i].y >= 0 ? box.max.y : box.min.y,
+						planes[i].z >= 0 ? box.max.z : box.min.z);
+				if (glm::dot(glm::vec3(planes[i]), p) + planes[i].w < 0)
+					return false;
+			}
+			return true;
+		}
+
+		//! Check if a box is entirely inside frustum
+		bool contains(const aabb & box) const {
+			if (box.empty())
+				return false;
+
+			for(size_t i = 0;i < total_planes;i++) {
+				// The corner that is furthest against the plane normal
+				glm::vec3 n(
+						planes[i].x >= 0 ? box.min.x : box.max.x,
+						planes[i].y >= 0 ? box.min.y : box.max.y,
+						planes[i].z >= 0 ? box.min.z : box.max.z);
+				if (glm::dot(glm::vec3(planes[i]), n) + planes[i].w < 0)
+					return false;
+			}
+			return true;
+		}
+
+		//! Check if any part of a sphere may be inside frustum
+		bool intersects(const sphere & s) const {
+			if (s.empty())
+				return false;
+
+			for(size_t i = 0;i < total_planes;i++) {
+				if (glm::dot(glm::vec3(planes[i]), s.center) + planes[i].w < -s.radius)
+					return false;
+			}
+			return true;
+		}
+	};
+}
@@ -2,6 +2,7 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "./bounds.hpp"
 
 namespace thrender {
 
@@ -35,6 +36,14 @@ namespace thrender {
 			return glm::vec3(view_mat[0][3], view_mat[1][3], view_mat[2][3])/view_mat[3][3];
 		}
 
+		//! Get the view frustum of camera (World-Space)
+		/**
+		 * It is extracted from projection and view matrices.
+		 */
+		frustum view_frustum() const {
+			return frustum(projection_mat * view_mat);
+		}
+
 	};
 
 }
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <boost/array.hpp>
+#include <glm/glm.hpp>
+#include <thrust/tuple.h>
+#include "./types.hpp"
+#include "./vertex_array.hpp"
+#include "./render_context.hpp"
+#include "./triangle_setup.hpp"
+
+namespace thrender {
+namespace details {
+
+	//! Number of planes that primitives are clipped against
+	static const size_t total_clip_planes = 6;
+
+	//! Maximum vertices of a triangle clipped by all planes
+	static const size_t max_clipped_vertices = 3 + total_clip_planes;
+
+	//! Signed distance of a clip space point from a clip plane
+	/**
+	 * Planes are near, far and then the left, right, bottom
+	 * and top sides of the guard band. The distance is positive
+	 * for points inside the plane.
+	 */
+	inline float clip_distance(const glm::vec4 & p, size_t plane) {
+		switch(plane) {
+		case 0: return p.w + p.z;
+		case 1: return p.w - p.z;
+		case 2: return guard_band * p.w + p.x;
+		case 3: return guard_band * p.w - p.x;
+		case 4: return guard_band * p.w + p.y;
+		default: return guard_band * p.w - p.y;
+		}
+	}
+
+	//! Calculate the clip code of a clip space point
+	/**
+	 * Bit n is set if the point is outside of the nth clip plane.
+	 */
+	inline clip_code_t clip_code(const glm::vec4 & p) {
+		clip_code_t code = 0;
+		for(size_t plane = 0;plane < total_clip_planes;plane++) {
+			if (clip_distance(p, plane) < 0)
+				code |= clip_code_t(1) << plane;
+		}
+		return code;
+	}
+
+	//! Linear interpolation of some attributes of a vertex
+	/**
+	 * Other attributes of the output vertex are left untouched.
+	 */
+	template<class VertexType,
+		class Indices = typename make_index_sequence<thrust::tuple_size<VertexType>::value>::type>
+	struct vertex_lerp;
+
+	template<class VertexType, size_t... I>
+	struct vertex_lerp<VertexType, index_sequence<I...> > {
+
+		static void lerp(VertexType & out, const VertexType & a, const VertexType & b, float t) {
+			int expand[] = {0, (thrust::get<I>(out) = thrust::get<I>(a) + (thrust::get<I>(b) - thrust::get<I>(a)) * t, 0)...};
+			(void)expand;
+		}
+	};
+
+	//! Vertex of a polygon that is being clipped
+	template<class VertexType>
+	struct clip_vertex {
+
+		//! Processed vertex, with position in window space
+		VertexType vertex;
+
+		//! Position in clip space
+		glm::vec4 clip_position;
+	};
+
+	//! Convex polygon clipped in homogeneous clip space
+	/**
+	 * Starts as a triangle and is clipped one plane at a time
+	 * (Sutherland-Hodgman). The Attributes of new vertices are
+	 * interpolated linearly in clip space, others are undefined.
+	 */
+	template<class VertexType,
+		class Attributes = typename make_index_sequence<thrust::tuple_size<VertexType>::value>::type>
+	struct clip_polygon {
+
+		//! Type of vertex
+		typedef VertexType vertex_type;
+
+		//! Type of polygon vertex
+		typedef clip_vertex<vertex_type> clip_vertex_type;
+
+		//! Type of vertices storage
+		typedef boost::array<clip_vertex_type, max_clipped_vertices> vertices_type;
+
+		//! Vertices of the polygon
+		vertices_type vertices;
+
+		//! Number of vertices in polygon
+		size_t size;
+
+		//! Construct an empty polygon
+		clip_polygon()
+		:
+			size(0)
+		{}
+
+		//! Append a vertex
+		inline void push_back(const vertex_type & vertex, const glm::vec4 & clip_position) {
+			vertices[size].vertex = vertex;
+			vertices[size].clip_position = clip_position;
+			size++;
+		}
+
+		//! Clip polygon on all planes whose bit is set in a clip code
+		/**
+		 * @param code The union of the clip codes of the vertices
+		 * @param context The context to translate new vertices to window space
+		 */
+		void clip(clip_code_t code, const render_context & context) {
+			for(size_t plane = 0;plane < total_clip_planes && size >= 3;plane++) {
+				if (code & (clip_code_t(1) << plane))
+					clip_plane(plane, context);
+			}
+		}
+
+	private:
+
+		//! Clip polygon on one plane
+		void clip_plane(size_t plane, const render_context & context) {
+			vertices_type input = vertices;
+			size_t input_size = size;
+			size = 0;
+
+			for(size_t i = 0;i < input_size;i++) {
+				const clip_vertex_type & current = input[i];
+				const clip_vertex_type & next = input[(i + 1) % input_size];
+				float d_current = clip_distance(current.clip_position, plane);
+				float d_next = clip_distance(next.clip_position, plane);
+
+				if (d_current >= 0)
+					vertices[size++] = current;
+
+				// Edge crosses the plane
+				if ((d_current >= 0) != (d_next >= 0)) {
+					float t = d_current / (d_current - d_next);
+					clip_vertex_type & out = vertices[size++];
+					vertex_lerp<vertex_type, Attributes>::lerp(out.vertex, current.vertex, next.vertex, t);
+					out.clip_position = current.clip_position + (next.clip_position - current.clip_position) * t;
+
+					glm::vec4 & position = VA_ATTRIBUTE(out.vertex, POSITION);
+					position = out.clip_position;
+					context.translate_to_window_space(position);
+				}
+			}
+		}
+	};
+}
+}
@@ -4,7 +4,15 @@
 #include "./render_context.hpp"
 #include "./vertex_array.hpp"
 #include "./math.hpp"
+#include "./simd.hpp"
+#include "./hiz.hpp"
+#include "./shader_hooks.hpp"
 #include "./utils/profiler.hpp"
+#include <algorithm>
+#include <cassert>
+#include <type_traits>
+#include <utility>
+#include <thrust/iterator/counting_iterator.h>
 
 namespace thrender {
 
@@ -20,15 +28,27 @@ namespace thrender {
 		//! Type of triangle
 		typedef typename renderable_type::triangle_type triangle_type;
 
+		//! Type of triangle setup
+		typedef typename renderable_type::triangle_setup_type setup_type;
+
 		//! Reference to the owner object
 		const renderable_type & object;
 
 		//! Reference to current render context
 		render_context & context;
 
+		//! The id of current primitive in object
+		primitive_id_t primitive_id;
+
+		//! The instance current primitive belongs to, or its object in a batch
+		size_t instance_id;
+
 		//! Reference to current primitive
 		const triangle_type & primitive;
 
+		//! Reference to the setup of current primitive
+		const setup_type & setup;
+
 		//! Barycoords of the processed pixel
 		glm::vec3 barycoords;
 
@@ -39,41 +59,340 @@ namespace thrender {
 		window_size_t framebuffer_y;
 
 		//! Construct control on fragment processing
-		fragment_processing_control(const renderable_type & _object, render_context & _context, const triangle_type & _triangle)
+		/**
+		 * @param _instance_id The draw of the primitive, looked up
+		 * once per primitive by the caller
+		 */
+		fragment_processing_control(const renderable_type & _object, render_context & _context,
+				primitive_id_t _primitive_id, size_t _instance_id, const triangle_type & _triangle, const setup_type & _setup)
 		:
 			object(_object),
 			context(_context),
+			primitive_id(_primitive_id),
+			instance_id(_instance_id),
 			primitive(_triangle),
+			setup(_setup),
 			framebuffer_x(0),
-			framebuffer_y(0)
+			framebuffer_y(0),
+			m_discarded(false),
+			m_w(1.0f)
 		{}
 
+		//! Get the data of the instance being drawn
+		/**
+		 * Valid only inside pipeline::draw_instanced() and
+		 * pipeline::draw_batch(), with the type of instance
+		 * data or uniforms passed there.
+		 */
+		template<class InstanceType>
+		inline const InstanceType & instance() const {
+			return object.intermediate_buffer().template instance<InstanceType>(instance_id);
+		}
+
 		//! Drops the current fragment as discarded
 		/**
-		 * If a pixel is discarded
+		 * The shader must return without writing on any buffer.
+		 * On depth_test_mode::late the depth of a discarded fragment
+		 * is not written, on depth_test_mode::early it already is.
 		 */
 		void discard() const{
-			//const_cast<renderable_type &>(object).intermediate_buffer.discarded_vertices[vertex_id] = true;
+			m_discarded = true;
 		}
 
+		//! Check if current fragment was discarded by shader
+		inline bool is_discarded() const {
+			return m_discarded;
+		}
+
+		//! Interpolate a vertex attribute on current pixel
+		/**
+		 * Evaluates the attribute plane of the triangle setup.
+		 */
 		template<size_t AttrID, class T>
 		T interpolate() const{
-			return VA_ATTRIBUTE(primitive.vertice(0), AttrID) * barycoords.x
-				+ VA_ATTRIBUTE(primitive.vertice(1), AttrID) * barycoords.y
-				+ VA_ATTRIBUTE(primitive.vertice(2), AttrID) * barycoords.z;
+			// Attribute is not a varying of the vertex shader
+			assert((object.intermediate_buffer().interpolated_attributes >> AttrID) & 1);
+
+			T value = thrust::get<AttrID>(setup.planes).evaluate(m_sample.x, m_sample.y);
+			if (context.interpolation == interpolation_mode::perspective)
+				return value * m_w;
+			return value;
 		}
 
+		//! Set current pixel and calculate its barycoords
 		void set_coords(float x, float y) {
 			framebuffer_x = x;
 			framebuffer_y = y;
-			barycoords = math::barycoords(*primitive.positions[0], *primitive.positions[1], *primitive.positions[2], glm::vec2(x,y));
+			barycoords = setup.edges.evaluate(x, y);
+			m_discarded = false;
+			set_sample(x, y);
+		}
+
+		//! Set current pixel with already known barycoords
+		/**
+		 * Attributes are sampled at the center of the pixel.
+		 */
+		inline void set_fragment(window_size_t x, window_size_t y, const glm::vec3 & _barycoords) {
+			framebuffer_x = x;
+			framebuffer_y = y;
+			barycoords = _barycoords;
+			m_discarded = false;
+			set_sample(x + 0.5f, y + 0.5f);
 		}
 
 		// non-copyable
 		fragment_processing_control(const fragment_processing_control&) = delete;
 		fragment_processing_control& operator=(const fragment_processing_control&) = delete;
+
+	private:
+
+		//! Set the point where attributes are sampled
+		inline void set_sample(float x, float y) {
+			m_sample = glm::vec2(x, y) - setup.edges.origin;
+			if (context.interpolation == interpolation_mode::perspective)
+				m_w = 1.0f / setup.inv_w.evaluate(m_sample.x, m_sample.y);
+		}
+
+		//! Flag if current fragment was discarded
+		mutable bool m_discarded;
+
+		//! Sampled point relative to the origin of attribute planes
+		glm::vec2 m_sample;
+
+		//! Clip space w on sampled point (perspective interpolation)
+		float m_w;
 	};
 
+	//! Control of fragment processing on a 2x2 quad of pixels
+	/**
+	 * It is passed to fragment shaders that provide a packet
+	 * overload. Interpolated attributes are returned in simd::soa
+	 * form, one lane per pixel of the quad. Lane l is the pixel
+	 * (framebuffer_x + (l & 1), framebuffer_y + (l >> 1)).
+	 */
+	template<class RenderableType>
+	struct fragment_packet_control {
+
+		//! Type of renderable object
+		typedef RenderableType renderable_type;
+
+		//! Type of vertex
+		typedef typename renderable_type::vertex_type vertex_type;
+
+		//! Type of triangle
+		typedef typename renderable_type::triangle_type triangle_type;
+
+		//! Type of triangle setup
+		typedef typename renderable_type::triangle_setup_type setup_type;
+
+		//! Number of pixels per packet
+		static const size_t lanes = simd::float4::lanes;
+
+		//! Reference to the owner object
+		const renderable_type & object;
+
+		//! Reference to current render context
+		render_context & context;
+
+		//! The id of current primitive in object
+		primitive_id_t primitive_id;
+
+		//! The instance current primitive belongs to, or its object in a batch
+		size_t instance_id;
+
+		//! Reference to current primitive
+		const triangle_type & primitive;
+
+		//! Reference to the setup of current primitive
+		const setup_type & setup;
+
+		//! Barycoords of the quad pixels, one float4 per vertex
+		simd::float4 barycoords[3];
+
+		//! Framebuffer X coordinate of the top-left pixel of the quad
+		window_size_t framebuffer_x;
+
+		//! Framebuffer Y coordinate of the top-left pixel of the quad
+		window_size_t framebuffer_y;
+
+		//! Bit mask of the covered pixels that passed depth test
+		/**
+		 * Lanes discarded by the shader are removed from mask.
+		 */
+		mutable int mask;
+
+		//! Construct control on packet processing
+		/**
+		 * @see fragment_processing_control::fragment_processing_control()
+		 */
+		fragment_packet_control(const renderable_type & _object, render_context & _context,
+				primitive_id_t _primitive_id, size_t _instance_id, const triangle_type & _triangle, const setup_type & _setup)
+		:
+			object(_object),
+			context(_context),
+			primitive_id(_primitive_id),
+			instance_id(_instance_id),
+			primitive(_triangle),
+			setup(_setup),
+			framebuffer_x(0),
+			framebuffer_y(0),
+			mask(0),
+			m_w(1.0f)
+		{}
+
+		//! Get the data of the instance being drawn
+		/**
+		 * @see fragment_processing_control::instance()
+		 */
+		template<class InstanceType>
+		inline const InstanceType & instance() const {
+			return object.intermediate_buffer().template instance<InstanceType>(instance_id);
+		}
+
+		//! Check if a lane holds a pixel that must be shaded
+		inline bool is_active(size_t lane) const {
+			return (mask >> lane) & 1;
+		}
+
+		//! Drop the fragment of one lane as discarded
+		/**
+		 * Same as fragment_processing_control::discard(), the
+		 * shader must not write the lane on any buffer.
+		 */
+		inline void discard(size_t lane) const {
+			mask &= ~(1 << lane);
+		}
+
+		//! Drop the fragments of all lanes as discarded
+		inline void discard() const {
+			mask = 0;
+		}
+
+		//! Get the framebuffer X coordinate of a lane
+		inline window_size_t lane_x(size_t lane) const {
+			return framebuffer_x + (lane & 1);
+		}
+
+		//! Get the framebuffer Y coordinate of a lane
+		inline window_size_t lane_y(size_t lane) const {
+			return framebuffer_y + (lane >> 1);
+		}
+
+		//! Interpolate a vertex attribute for all lanes
+		template<size_t AttrID, class T>
+		simd::soa<T> interpolate() const{
+			// Attribute is not a varying of the vertex shader
+			assert((object.intermediate_buffer().interpolated_attributes >> AttrID) & 1);
+
+			typedef typename simd::soa<T>::components components;
+			const attribute_plane<T> & plane = thrust::get<AttrID>(setup.planes);
+
+			simd::soa<T> result;
+			for(size_t i = 0;i < components::size;i++) {
+				result.c[i] = simd::float4(components::get(plane.value, i))
+					+ m_sample_x * components::get(plane.ddx, i)
+					+ m_sample_y * components::get(plane.ddy, i);
+			}
+			if (context.interpolation == interpolation_mode::perspective)
+				return result * m_w;
+			return result;
+		}
+
+		//! Write the values of the active lanes on a buffer
+		template<class Buffer, class T>
+		void store(Buffer & buffer, const simd::soa<T> & values) const {
+			T lane_values[lanes];
+			values.extract(lane_values);
+			for(size_t l = 0;l < lanes;l++) {
+				if (is_active(l))
+					buffer[lane_y(l)][lane_x(l)] = lane_values[l];
+			}
+		}
+
+		//! Set current quad
+		inline void set_packet(window_size_t x, window_size_t y, int _mask,
+				const simd::float4 & b0, const simd::float4 & b1, const simd::float4 & b2) {
+			framebuffer_x = x;
+			framebuffer_y = y;
+			mask = _mask;
+			barycoords[0] = b0;
+			barycoords[1] = b1;
+			barycoords[2] = b2;
+
+			// Attributes are sampled at pixel centers
+			m_sample_x = simd::float4(x + 0.5f - setup.edges.origin.x) + simd::float4(0, 1, 0, 1);
+			m_sample_y = simd::float4(y + 0.5f - setup.edges.origin.y) + simd::float4(0, 0, 1, 1);
+			if (context.interpolation == interpolation_mode::perspective) {
+				m_w = simd::float4(1.0f) / (simd::float4(setup.inv_w.value)
+					+ m_sample_x * setup.inv_w.ddx
+					+ m_sample_y * setup.inv_w.ddy);
+			}
+		}
+
+		// non-copyable
+		fragment_packet_control(const fragment_packet_control&) = delete;
+		fragment_packet_control& operator=(const fragment_packet_control&) = delete;
+
+	private:
+
+		//! X of sampled points relative to the origin of attribute planes
+		simd::float4 m_sample_x;
+
+		//! Y of sampled points relative to the origin of attribute planes
+		simd::float4 m_sample_y;
+
+		//! Clip space w on sampled points (perspective interpolation)
+		simd::float4 m_w;
+	};
+
+	//! When depth test is done relative to fragment shading
+	enum class depth_test_mode {
+		early,	//!< Test and write depth before shading (default)
+		late	//!< Write depth after shading, only if fragment was not discarded
+	};
+
+namespace details {
+
+	//! Check if a fragment shader provides a packet overload
+	template<class FragmentShader, class RenderableType>
+	struct has_packet_operator {
+
+		template<class S>
+		static std::true_type test(int, decltype(std::declval<S &>()(
+			std::declval<framebuffer_array &>(),
+			std::declval<const fragment_packet_control<RenderableType> &>())) * = 0);
+
+		template<class S>
+		static std::false_type test(...);
+
+		//! std::true_type if the overload exists
+		typedef decltype(test<FragmentShader>(0)) type;
+
+		static const bool value = type::value;
+	};
+
+	//! Fragment shader that does nothing, for depth only rendering
+	/**
+	 * The packet overload is provided only if requested, so that
+	 * rasterization follows the same path as another shader.
+	 */
+	template<bool HasPacketOperator>
+	struct depth_only_fg_shader {
+
+		template<class RenderableType>
+		void operator()(framebuffer_array &, const fragment_processing_control<RenderableType> &) {}
+	};
+
+	template<>
+	struct depth_only_fg_shader<true> : depth_only_fg_shader<false> {
+
+		using depth_only_fg_shader<false>::operator();
+
+		template<class RenderableType>
+		void operator()(framebuffer_array &, const fragment_packet_control<RenderableType> &) {}
+	};
+}
+
 
 	template<class FragmentShader, class RenderableType>
 	struct fragment_processor_kernel {
@@ -87,6 +406,9 @@ namespace thrender {
 		//! Type of the primitive
 		typedef typename renderable_type::triangle_type triangle_type;
 
+		//! Type of the primitive setup
+		typedef typename renderable_type::triangle_setup_type setup_type;
+
 		//! Reference to the object that this fragment belongs to.
 		const renderable_type & object;
 
@@ -96,50 +418,342 @@ namespace thrender {
 		//! Reference to fragment shader
 		fragment_shader & shader;
 
+		//! When depth is tested and written
+		depth_test_mode depth_mode;
+
 		//! Construct the kernel for a specific object and context
-		fragment_processor_kernel(const renderable_type & _object, fragment_shader & _shader, render_context & _context)
+		fragment_processor_kernel(const renderable_type & _object, fragment_shader & _shader, render_context & _context,
+				depth_test_mode _depth_mode)
 		:
 			object(_object),
 			context(_context),
-			shader(_shader)
+			shader(_shader),
+			depth_mode(_depth_mode)
 		{
 		}
 
-		void operator()(const triangle_type & tr)  {
+		//! Rasterize all primitives binned to one tile
+		/**
+		 * Primitives are rasterized in submission order, so the
+		 * result is the same as rendering them serially.
+		 */
+		void operator()(size_t tile_index) {
+			const details::tile_bins::bin_type & bin = context.bins[tile_index];
+			if (bin.empty())
+				return;
+
+			tile_rect rect = context.bins.rect(tile_index);
+			details::hiz_tile hiz(context.fb, rect);
 
-			// If any vertex is discarded, the whole triangle is.
-			if (object.intermediate_buffer.discarded_vertices[tr.indices[0]]
-				|| object.intermediate_buffer.discarded_vertices[tr.indices[1]]
-				|| object.intermediate_buffer.discarded_vertices[tr.indices[2]])
-			{
+			// Pixels outside the viewport are never touched
+			tile_rect scissor;
+			scissor.left = std::max(rect.left, context.vp.left());
+			scissor.top = std::max(rect.top, context.vp.top());
+			scissor.right = std::min(rect.right, context.vp.right());
+			scissor.bottom = std::min(rect.bottom, context.vp.bottom());
+			if (scissor.left >= scissor.right || scissor.top >= scissor.bottom)
 				return;
+
+			for(details::tile_bins::bin_type::const_iterator it = bin.begin();it != bin.end();it++) {
+				rasterize(*it, scissor, hiz);
 			}
+			hiz.flush();
+		}
+
+		//! Rasterize the part of a triangle that is inside a tile
+		inline void rasterize(primitive_id_t id, const tile_rect & rect, details::hiz_tile & hiz) {
+			const triangle_type & tr = object.intermediate_buffer().element(id);
+			const setup_type & setup = object.intermediate_buffer().setups[id];
+			const triangle_bounds & bounds = object.intermediate_buffer().setup_bounds[id];
+			size_t draw = object.intermediate_buffer().draw_of_element(id);
+			if (context.rasterizer == raster_algorithm::scanline_bresenham)
+				rasterize_scanline(id, draw, tr, setup, bounds, rect, hiz);
+			else
+				rasterize_half_space(id, draw, tr, setup, bounds, rect, hiz, typename details::has_packet_operator<fragment_shader, renderable_type>::type());
+		}
+
+		//! Compare fragment depth with the stored one
+		inline bool depth_test(depth_pixel_t stored, depth_pixel_t z) const {
+			if (context.depth_func == depth_function::equal)
+				return stored == z;
+			return !(stored > z);
+		}
+
+		//! Check if a block of pixels passes depth test for any depth down to z_min
+		inline bool is_block_accepted(details::hiz_tile & hiz, int bx, int by, depth_pixel_t z_min, depth_pixel_t z_max) {
+			if (context.depth_func == depth_function::equal || !hiz.is_block_accepted(bx, by, z_min))
+				return false;
+			hiz.write(bx, by, z_max);
+			return true;
+		}
+
+		//! Write the depth of a fragment that passed depth test
+		/**
+		 * Hierarchical depth is updated, unless the block is accepted
+		 * and already accounts for the whole primitive.
+		 */
+		inline void write_depth(depth_pixel_t & stored, depth_pixel_t z, int bx, int by, bool accepted, details::hiz_tile & hiz) {
+			if (context.depth_func == depth_function::equal)
+				return;
+			if (!accepted)
+				hiz.write(bx, by, stored, z);
+			stored = z;
+		}
+
+		//! Shade a fragment that passed depth test
+		/**
+		 * On early mode depth is written before the shader runs, on
+		 * late mode only if the shader did not discard the fragment.
+		 */
+		inline void shade(fragment_processing_control<RenderableType> & fgcontrol, depth_pixel_t & stored, depth_pixel_t z,
+				int bx, int by, bool accepted, details::hiz_tile & hiz) {
+			if (depth_mode == depth_test_mode::early) {
+				write_depth(stored, z, bx, by, accepted, hiz);
+				shader(context.fb, fgcontrol);
+			} else {
+				shader(context.fb, fgcontrol);
+				if (!fgcontrol.is_discarded())
+					write_depth(stored, z, bx, by, accepted, hiz);
+			}
+		}
+
+		//! Rasterize by stepping the edge functions of the triangle
+		/**
+		 * Pixels are sampled at their center. Barycoords and depth
+		 * are updated incrementally, with one addition per pixel.
+		 * Blocks of pixels that are occluded according to the
+		 * hierarchical depth are skipped.
+		 */
+		void rasterize_half_space(primitive_id_t id, size_t draw, const triangle_type & tr, const setup_type & setup, const triangle_bounds & bounds, const tile_rect & rect,
+				details::hiz_tile & hiz, std::false_type) {
+
+			const details::edge_equations & edges = setup.edges;
+
+			// Pixels whose center may be covered, limited inside the tile
+			const glm::vec4 & bounding_box = bounds.bounding_box;
+			int x_begin = std::max<int>(ceilf(bounding_box[0] - 0.5f), rect.left);
+			int y_begin = std::max<int>(ceilf(bounding_box[1] - 0.5f), rect.top);
+			int x_end = std::min<int>(floorf(bounding_box[0] + bounding_box[2] - 0.5f), rect.right - 1);
+			int y_end = std::min<int>(floorf(bounding_box[1] + bounding_box[3] - 0.5f), rect.bottom - 1);
+			if (x_begin > x_end || y_begin > y_end)
+				return;
+
+			// Depth is clamped in the range of vertices, so that incremental
+			// stepping errors never escape the hierarchical depth bounds.
+			depth_pixel_t z_min = bounds.depth_bounds.min;
+			depth_pixel_t z_max = bounds.depth_bounds.max;
 
-			// Face-culling
-			//if (!tr.is_ccw_winding_order())
-			//	return;
+			fragment_processing_control<RenderableType> fgcontrol(object, context, id, draw, tr, setup);
+
+			for (int by = y_begin / hiz_block_size; by <= y_end / int(hiz_block_size); by++) {
+				int block_y_begin = std::max<int>(y_begin, by * hiz_block_size);
+				int block_y_end = std::min<int>(y_end, (by + 1) * hiz_block_size - 1);
+
+				for (int bx = x_begin / hiz_block_size; bx <= x_end / int(hiz_block_size); bx++) {
+					if (!hiz.is_block_visible(bx, by, z_max))
+						continue;
+
+					// If all pixels pass, depth test can be skipped
+					bool accepted = is_block_accepted(hiz, bx, by, z_min, z_max);
+
+					int block_x_begin = std::max<int>(x_begin, bx * hiz_block_size);
+					int block_x_end = std::min<int>(x_end, (bx + 1) * hiz_block_size - 1);
+
+					glm::vec3 row_barycoords = edges.evaluate(block_x_begin + 0.5f, block_y_begin + 0.5f);
+					float row_z = setup.depth.evaluate(block_x_begin + 0.5f - edges.origin.x, block_y_begin + 0.5f - edges.origin.y);
+					for (int y = block_y_begin; y <= block_y_end; y++) {
+						depth_pixel_t * depth_row = context.fb.depth_buffer()[y];
+						glm::vec3 barycoords = row_barycoords;
+						float z = row_z;
+						for (int x = block_x_begin; x <= block_x_end; x++) {
+							// Coverage and Z-test
+							if (edges.inside(barycoords)) {
+								depth_pixel_t pixel_z = std::min(std::max(z, z_min), z_max);
+								if (accepted || depth_test(depth_row[x], pixel_z)) {
+									fgcontrol.set_fragment(x, y, barycoords);
+									shade(fgcontrol, depth_row[x], pixel_z, bx, by, accepted, hiz);
+								}
+							}
+							barycoords += edges.a;
+							z += setup.depth.ddx;
+						}
+						row_barycoords += edges.b;
+						row_z += setup.depth.ddy;
+					}
+				}
+			}
+		}
+
+		//! Rasterize by stepping the edge functions on 2x2 quads
+		/**
+		 * Used when the fragment shader has a packet overload. Coverage,
+		 * barycoords and depth of the four pixels are computed at once
+		 * and the shader is invoked once per quad with any live pixel.
+		 */
+		void rasterize_half_space(primitive_id_t id, size_t draw, const triangle_type & tr, const setup_type & setup, const triangle_bounds & bounds, const tile_rect & rect,
+				details::hiz_tile & hiz, std::true_type) {
+
+			const details::edge_equations & edges = setup.edges;
+
+			// Pixels whose center may be covered, limited inside the tile
+			const glm::vec4 & bounding_box = bounds.bounding_box;
+			int x_begin = std::max<int>(ceilf(bounding_box[0] - 0.5f), rect.left);
+			int y_begin = std::max<int>(ceilf(bounding_box[1] - 0.5f), rect.top);
+			int x_end = std::min<int>(floorf(bounding_box[0] + bounding_box[2] - 0.5f), rect.right - 1);
+			int y_end = std::min<int>(floorf(bounding_box[1] + bounding_box[3] - 0.5f), rect.bottom - 1);
+			if (x_begin > x_end || y_begin > y_end)
+				return;
+
+			// Offsets of edge functions per lane of the quad
+			const simd::float4 lane_dx(0, 1, 0, 1);
+			const simd::float4 lane_dy(0, 0, 1, 1);
+			simd::float4 lane_offset[3];
+			simd::float4 bias[3];
+			for(int i = 0;i < 3;i++) {
+				lane_offset[i] = lane_dx * edges.a[i] + lane_dy * edges.b[i];
+				bias[i] = edges.bias[i];
+			}
+			const simd::float4 lane_z = lane_dx * setup.depth.ddx + lane_dy * setup.depth.ddy;
+			depth_pixel_t z_min = bounds.depth_bounds.min;
+			depth_pixel_t z_max = bounds.depth_bounds.max;
+
+			fragment_packet_control<RenderableType> pkcontrol(object, context, id, draw, tr, setup);
+
+			// Quads are aligned on even pixels, blocks are too.
+			for (int by = y_begin / hiz_block_size; by <= y_end / int(hiz_block_size); by++) {
+				int block_y_begin = std::max<int>(y_begin, by * hiz_block_size) & ~1;
+				int block_y_end = std::min<int>(y_end, (by + 1) * hiz_block_size - 1);
+
+				for (int bx = x_begin / hiz_block_size; bx <= x_end / int(hiz_block_size); bx++) {
+					if (!hiz.is_block_visible(bx, by, z_max))
+						continue;
+
+					// If all pixels pass, depth test can be skipped
+					bool accepted = is_block_accepted(hiz, bx, by, z_min, z_max);
+
+					int block_x_begin = std::max<int>(x_begin, bx * hiz_block_size) & ~1;
+					int block_x_end = std::min<int>(x_end, (bx + 1) * hiz_block_size - 1);
+
+					glm::vec3 row_barycoords = edges.evaluate(block_x_begin + 0.5f, block_y_begin + 0.5f);
+					float row_z = setup.depth.evaluate(block_x_begin + 0.5f - edges.origin.x, block_y_begin + 0.5f - edges.origin.y);
+					for (int y = block_y_begin; y <= block_y_end; y += 2) {
+
+						// Lanes outside the vertical range
+						int row_mask = 0xF;
+						if (y < y_begin) row_mask &= 0xC;
+						if (y + 1 > y_end) row_mask &= 0x3;
+
+						depth_pixel_t * depth_rows[2] = {
+							context.fb.depth_buffer()[y],
+							(row_mask & 0xC) ? context.fb.depth_buffer()[y + 1] : 0 };
+
+						glm::vec3 quad_barycoords = row_barycoords;
+						float quad_z = row_z;
+						for (int x = block_x_begin; x <= block_x_end; x += 2) {
+
+							// Lanes outside the horizontal range
+							int mask = row_mask;
+							if (x < x_begin) mask &= 0xA;
+							if (x + 1 > x_end) mask &= 0x5;
+
+							// Coverage
+							simd::float4 b0 = simd::float4(quad_barycoords.x) + lane_offset[0];
+							simd::float4 b1 = simd::float4(quad_barycoords.y) + lane_offset[1];
+							simd::float4 b2 = simd::float4(quad_barycoords.z) + lane_offset[2];
+							mask &= b0.greater_equal_mask(bias[0])
+								& b1.greater_equal_mask(bias[1])
+								& b2.greater_equal_mask(bias[2]);
+							quad_barycoords += edges.a * 2.0f;
+							float z[simd::float4::lanes];
+							(simd::float4(quad_z) + lane_z).store(z);
+							quad_z += setup.depth.ddx * 2.0f;
+							if (!mask)
+								continue;
+
+							// Z-test
+							for(int l = 0;l < 4;l++) {
+								if (!((mask >> l) & 1))
+									continue;
+								z[l] = std::min(std::max(z[l], z_min), z_max);
+								depth_pixel_t & depth = depth_rows[l >> 1][x + (l & 1)];
+								if (!accepted && !depth_test(depth, z[l])) {
+									mask &= ~(1 << l);
+									continue;
+								}
+								if (depth_mode == depth_test_mode::early)
+									write_depth(depth, z[l], bx, by, accepted, hiz);
+							}
+							if (!mask)
+								continue;
+
+							pkcontrol.set_packet(x, y, mask, b0, b1, b2);
+							shader(context.fb, pkcontrol);
+
+							// Lanes that survived the shader
+							if (depth_mode == depth_test_mode::late) {
+								for(int l = 0;l < 4;l++) {
+									if (pkcontrol.is_active(l))
+										write_depth(depth_rows[l >> 1][x + (l & 1)], z[l], bx, by, accepted, hiz);
+								}
+							}
+						}
+						row_barycoords += edges.b * 2.0f;
+						row_z += setup.depth.ddy * 2.0f;
+					}
+				}
+			}
+		}
+
+		//! Rasterize by walking the contour of the triangle
+		/**
+		 * The edges are walked with bresenham and barycoords are
+		 * computed from scratch for every pixel.
+		 */
+		void rasterize_scanline(primitive_id_t id, size_t draw, const triangle_type & tr, const setup_type & setup, const triangle_bounds & bounds, const tile_rect & rect,
+				details::hiz_tile & hiz) {
+
+			glm::vec4 vertex_positions[3];
+			const glm::vec4 * positions[3];
+			for(size_t i = 0;i < 3;i++) {
+				vertex_positions[i] = object.intermediate_buffer().element_position(id, i);
+				positions[i] = &vertex_positions[i];
+			}
 
 			// Sort points by y
-			const glm::vec4 * pord[3] = {tr.positions[0], tr.positions[1], tr.positions[2]};
+			const glm::vec4 * pord[3] = {positions[0], positions[1], positions[2]};
 			math::sort3vec_by_y(pord);
 
-			fragment_processing_control<RenderableType> fgcontrol(object, context, tr);
+			fragment_processing_control<RenderableType> fgcontrol(object, context, id, draw, tr, setup);
 
 			// One pixel fragment
-			glm::vec4 bounding_box = tr.bounding_box();
+			const glm::vec4 & bounding_box = bounds.bounding_box;
 			if (bounding_box[3] < 1.0f && bounding_box[2] < 1.0f) {
-				fgcontrol.set_coords(tr.positions[0]->x, tr.positions[1]->y);
+				fgcontrol.set_coords(positions[0]->x, positions[1]->y);
+				window_size_t x = fgcontrol.framebuffer_x;
+				window_size_t y = fgcontrol.framebuffer_y;
+				if (!rect.contains(x, y))
+					return;
 				// Z-test
-				if (context.fb.depth_buffer()[fgcontrol.framebuffer_y][fgcontrol.framebuffer_x] > tr.positions[0]->z)
+				if (!depth_test(context.fb.depth_buffer()[y][x], positions[0]->z))
 					return;
-				context.fb.depth_buffer()[fgcontrol.framebuffer_y][fgcontrol.framebuffer_x] = tr.positions[0]->z;
-				shader(context.fb, fgcontrol);
+				shade(fgcontrol, context.fb.depth_buffer()[y][x], positions[0]->z,
+						x / hiz_block_size, y / hiz_block_size, false, hiz);
 				return;
 			}
 
-			// Find triangle contour
+			// Interpolation on the contour may overshoot vertices depth
+			depth_pixel_t z_min = bounds.depth_bounds.min;
+			depth_pixel_t z_max = bounds.depth_bounds.max;
+
+			// Scan conversion is limited inside the tile
+			window_size_t y_begin = std::max<float>(bounding_box[1], rect.top);
+			window_size_t y_end = std::min<float>(bounding_box[1] + bounding_box[3], rect.bottom - 1);
+			if (y_begin > y_end)
+				return;
+
+			// Find triangle contour on the covered rows of the tile
 			details::polygon_vertical_limits tri_contour;
-			tri_contour.clear();
+			tri_contour.clear(y_begin, y_end - y_begin + 1);
 			details::mark_vertical_contour mark_contour_op(tri_contour);
 			thrender::math::line_bresenham(pord[0]->x, pord[0]->y, pord[1]->x,
 					pord[1]->y, mark_contour_op);
@@ -148,17 +762,18 @@ namespace thrender {
 			thrender::math::line_bresenham(pord[0]->x, pord[0]->y, pord[2]->x,
 					pord[2]->y, mark_contour_op);
 
-
 			// Scan conversion fill
-			for (window_size_t y = bounding_box[1]; y <= bounding_box[1]+ bounding_box[3]; y++) {
-				for (window_size_t x = tri_contour.leftmost[y]; x < tri_contour.rightmost[y]; x++) {
+			for (window_size_t y = y_begin; y <= y_end; y++) {
+				window_size_t x_begin = std::max(tri_contour.leftmost[y - y_begin], rect.left);
+				window_size_t x_end = std::min(tri_contour.rightmost[y - y_begin], rect.right);
+				for (window_size_t x = x_begin; x < x_end; x++) {
 					fgcontrol.set_coords(x,y);
-					float z = fgcontrol.template interpolate<0, glm::vec4>().z;
+					float z = setup.depth.evaluate(x - setup.edges.origin.x, y - setup.edges.origin.y);
+					z = std::min(std::max(z, z_min), z_max);
 					// Z-test
-					if (context.fb.depth_buffer()[y][x] > z)
+					if (!depth_test(context.fb.depth_buffer()[y][x], z))
 						continue;
-					context.fb.depth_buffer()[y][x] = z;
-					shader(context.fb, fgcontrol);
+					shade(fgcontrol, context.fb.depth_buffer()[y][x], z, x / hiz_block_size, y / hiz_block_size, false, hiz);
 				}
 
 			}
@@ -166,12 +781,80 @@ namespace thrender {
 		}
 	};
 
-	// Rasterization of fragments/primitives
+namespace details {
+
+	//! Bin one primitive to the screen tiles it overlaps
+	inline void bin_primitive(render_context & context, primitive_id_t id, const triangle_bounds & bounds) {
+		// Skip tiles where the triangle is hidden by what is already drawn
+		context.bins.insert(bounds.bounding_box, id, hiz_tile_test(context.fb, bounds.depth_bounds.max));
+	}
+}
+
+	//! Bin primitives of an object to the screen tiles they overlap
+	/**
+	 * Only the visible triangles compacted at setup are visited. Those
+	 * occluded in the whole tile according to the hierarchical depth
+	 * are dropped at this stage and never reach rasterization.
+	 */
+	template<class RenderableType>
+	void bin_primitives(const RenderableType & object, render_context & context) {
+		context.bins.clear();
+
+		const typename RenderableType::intermediate_buffer_type & ib = object.intermediate_buffer();
+		size_t clipped_index = 0;
+		typename RenderableType::intermediate_buffer_type::element_ids_type::const_iterator it;
+		for(it = ib.visible_elements.begin(); it != ib.visible_elements.end(); it++) {
+			primitive_id_t id = *it;
+
+			// Clipped triangles take the place of their source triangle
+			if (ib.setup_states[id] == setup_state::clipped) {
+				for(;clipped_index < ib.clipped_origins.size() && ib.clipped_origins[clipped_index] == id; clipped_index++) {
+					primitive_id_t clipped_id = ib.elements.size() + clipped_index;
+					if (ib.setup_states[clipped_id] == setup_state::visible)
+						details::bin_primitive(context, clipped_id, ib.setup_bounds[clipped_id]);
+				}
+				continue;
+			}
+
+			details::bin_primitive(context, id, ib.setup_bounds[id]);
+		}
+	}
+
+namespace details {
+
+	//! Rasterize the primitives of an object, without calling shader hooks
+	/**
+	 * @see thrender::process_fragments()
+	 */
 	template<class FragmentShader, class RenderableType>
-	void process_fragments(const RenderableType & object, FragmentShader & shader, render_context & context) {
+	void run_fragments(const RenderableType & object, FragmentShader & shader, render_context & context,
+			depth_test_mode depth_mode) {
+		bin_primitives(object, context);
+
+		thrust::counting_iterator<size_t> tiles_begin(0);
 		thrust::for_each(
-				object.intermediate_buffer.elements.begin(),
-				object.intermediate_buffer.elements.end(),
-				fragment_processor_kernel<FragmentShader, RenderableType >(object, shader, context));
+				tiles_begin,
+				tiles_begin + context.bins.total_tiles(),
+				fragment_processor_kernel<FragmentShader, RenderableType >(object, shader, context, depth_mode));
+	}
+}
+
+	// Rasterization of fragments/primitives
+	/**
+	 * Primitives are first binned to screen tiles, then every tile
+	 * is rasterized by its own worker. No two workers touch the
+	 * same pixel, so this is safe on any thrust backend.
+	 *
+	 * Primitives must have been setup with process_primitives().
+	 * The prepare and finish hooks of the shader are called before
+	 * and after the fragments.
+	 * @param depth_mode Use depth_test_mode::late if shader may discard fragments.
+	 */
+	template<class FragmentShader, class RenderableType>
+	void process_fragments(const RenderableType & object, FragmentShader & shader, render_context & context,
+			depth_test_mode depth_mode = depth_test_mode::early) {
+		details::prepare_shader(shader, context);
+		details::run_fragments(object, shader, context, depth_mode);
+		details::finish_shader(shader, context);
 	}
 }
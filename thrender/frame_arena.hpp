@@ -0,0 +1,412 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+#include <type_traits>
+
+namespace thrender {
+namespace details {
+
+	//! Generate a unique id for a user of frame arenas
+	inline size_t next_arena_owner() {
+		static std::atomic<size_t> next(1);
+		return next++;
+	}
+
+	//! Check if a buffer type can free its unused capacity
+	template<class T>
+	struct has_shrink_to_fit {
+
+		template<class U>
+		static std::true_type test(int, decltype(std::declval<U &>().shrink_to_fit()) * = 0);
+
+		template<class U>
+		static std::false_type test(...);
+
+		//! std::true_type if T::shrink_to_fit() exists
+		typedef decltype(test<T>(0)) type;
+	};
+
+	template<class T>
+	inline void shrink_buffer(T & buffer, std::true_type) {
+		buffer.shrink_to_fit();
+	}
+
+	template<class T>
+	inline void shrink_buffer(T &, std::false_type) {
+	}
+
+	//! Base of the pools of frame_arena, one per buffer type
+	struct arena_pool_base {
+
+		//! If true, the arena of the pool is gone and buffers are freed
+		bool closed;
+
+		arena_pool_base()
+		:
+			closed(false)
+		{}
+
+		//! Release all buffers of the pool
+		/**
+		 * @param idle_frames Frames that a buffer may stay unused
+		 * before it is freed
+		 */
+		virtual void reset(size_t idle_frames) = 0;
+
+		//! Free all buffers, the pool is not used anymore
+		virtual void close() = 0;
+
+		virtual ~arena_pool_base() {}
+	};
+
+	//! Pool of buffers of one type
+	template<class T>
+	struct arena_pool : public arena_pool_base {
+
+		//! A buffer of the pool
+		struct slot {
+
+			//! The buffer, its address is stable, null if freed
+			std::unique_ptr<T> buffer;
+
+			//! The last owner that acquired the buffer, 0 for none
+			size_t owner;
+
+			//! If true, buffer is acquired in current frame
+			bool in_use;
+
+			//! If true, buffer changed owner in current frame
+			bool rebuilt;
+
+			//! The generation that buffer was last acquired in
+			size_t last_used;
+
+			slot()
+			:
+				owner(0),
+				in_use(false),
+				rebuilt(false),
+				last_used(0)
+			{}
+		};
+
+		//! All buffers of the pool
+		std::vector<slot> slots;
+
+		//! Slots that may be free, the last one is tried first
+		std::vector<size_t> released;
+
+		//! Number of frames ended, buffers are valid for one generation
+		size_t generation;
+
+		arena_pool()
+		:
+			generation(0)
+		{}
+
+		//! Acquire a buffer
+		/**
+		 * @param owner Id of the owner
+		 * @param index The slot the owner held before, updated
+		 * to the slot it holds now
+		 * @param kept Set to true if owner got back the buffer
+		 * it held before, with its content intact
+		 */
+		T & acquire(size_t owner, size_t & index, bool & kept) {
+			kept = index < slots.size() && slots[index].owner == owner;
+			if (!kept) {
+				index = slots.size();
+				while(!released.empty()) {
+					size_t candidate = released.back();
+					released.pop_back();
+					if (!slots[candidate].in_use) {
+						index = candidate;
+						break;
+					}
+				}
+				if (index == slots.size())
+					slots.push_back(slot());
+				if (!slots[index].buffer)
+					slots[index].buffer.reset(new T());
+				slots[index].rebuilt = true;
+			}
+			slots[index].owner = owner;
+			slots[index].in_use = true;
+			slots[index].last_used = generation;
+			return *slots[index].buffer;
+		}
+
+		//! Give back a buffer before the frame ends
+		/**
+		 * Nothing happens if the owner does not hold the slot anymore.
+		 */
+		void give_back(size_t owner, size_t index) {
+			if (index >= slots.size() || slots[index].owner != owner)
+				return;
+			slots[index].owner = 0;
+			slots[index].in_use = false;
+			released.push_back(index);
+		}
+
+		//! Release all buffers of the pool
+		/**
+		 * Buffers that were not acquired in the last idle_frames
+		 * frames are freed, and buffers that changed owner in the
+		 * frame that ends are shrunk to what their new owner uses, if
+		 * T has shrink_to_fit(). So the memory of the pool follows
+		 * what was drawn in the last few frames and not the largest
+		 * frame ever drawn, while owners that skip a frame, or keep
+		 * their buffer from frame to frame, do not allocate. Idle
+		 * buffers are given out first, then buffers of the frame that
+		 * ends, then slots without buffer. Idle buffers keep their
+		 * owner, who gets them back with their content if they are
+		 * not given out meanwhile.
+		 */
+		void reset(size_t idle_frames) {
+			released.clear();
+			for(size_t i = slots.size();i > 0;i--) {
+				slot & s = slots[i - 1];
+				if (!s.in_use && generation - s.last_used >= idle_frames) {
+					s.buffer.reset();
+					s.owner = 0;
+					released.push_back(i - 1);
+				}
+			}
+			for(size_t i = slots.size();i > 0;i--) {
+				slot & s = slots[i - 1];
+				if (!s.in_use)
+					continue;
+				if (s.rebuilt)
+					shrink_buffer(*s.buffer, typename has_shrink_to_fit<T>::type());
+				released.push_back(i - 1);
+			}
+			for(size_t i = slots.size();i > 0;i--) {
+				slot & s = slots[i - 1];
+				if (s.in_use) {
+					s.in_use = false;
+					s.rebuilt = false;
+				} else if (s.buffer) {
+					released.push_back(i - 1);
+				}
+			}
+			generation++;
+		}
+
+		//! Free all buffers, holders that refer to the pool see it closed
+		void close() {
+			closed = true;
+			slots.clear();
+			released.clear();
+		}
+	};
+}
+
+	//! Pool of the intermediate buffers of draws, owned by a render context
+	/**
+	 * Objects acquire their buffers from the arena on every draw, and
+	 * all buffers are released at once at the end of the frame. A
+	 * released buffer is given to the next object that needs one, so
+	 * memory follows the objects drawn in the last few frames and not
+	 * those loaded, and steady frames do not allocate. An object that
+	 * gets back the buffer it held before reuses its content. If the
+	 * frame is never ended, each object keeps a buffer of its own.
+	 * Copies of an arena are empty.
+	 * @see details::arena_pool::reset()
+	 */
+	class frame_arena {
+	public:
+
+		//! Frames that a buffer may stay unused before it is freed
+		size_t idle_frames;
+
+		//! Construct an arena without buffers
+		frame_arena()
+		:
+			idle_frames(4)
+		{}
+
+		//! Copying gives an arena without buffers
+		frame_arena(const frame_arena & other)
+		:
+			idle_frames(other.idle_frames)
+		{}
+
+		//! Assignment frees the buffers, like destruction
+		frame_arena & operator=(const frame_arena & other) {
+			clear();
+			idle_frames = other.idle_frames;
+			return *this;
+		}
+
+		~frame_arena() {
+			clear();
+		}
+
+		//! Get the pool of a type of buffers, created on first use
+		template<class T>
+		std::shared_ptr<details::arena_pool<T> > pool() {
+			std::shared_ptr<details::arena_pool_base> & pool = m_pools[std::type_index(typeid(T))];
+			if (!pool)
+				pool.reset(new details::arena_pool<T>());
+			return std::static_pointer_cast<details::arena_pool<T> >(pool);
+		}
+
+		//! Release all buffers at once
+		/**
+		 * Buffers must not be used after this call, until they are
+		 * acquired again. Buffers that were not used in the last
+		 * idle_frames frames are freed.
+		 */
+		void reset() {
+			std::map<std::type_index, std::shared_ptr<details::arena_pool_base> >::iterator it;
+			for(it = m_pools.begin();it != m_pools.end(); it++)
+				it->second->reset(idle_frames);
+		}
+
+		//! Free the memory of all buffers
+		/**
+		 * Holders of buffers acquire new ones on their next draw.
+		 */
+		void clear() {
+			std::map<std::type_index, std::shared_ptr<details::arena_pool_base> >::iterator it;
+			for(it = m_pools.begin();it != m_pools.end(); it++)
+				it->second->close();
+			m_pools.clear();
+		}
+
+	private:
+
+		//! Pool per type of buffer
+		std::map<std::type_index, std::shared_ptr<details::arena_pool_base> > m_pools;
+	};
+
+	//! A buffer of a frame arena held by an object
+	/**
+	 * Copies of a holder are empty and have an identity of their own,
+	 * so copied objects never share buffers. The buffer is given back
+	 * to its pool when the holder is destroyed or assigned. The holder
+	 * keeps the pool of its arena, so acquiring from the same arena
+	 * again does not look it up. Holders may outlive the arena, whose
+	 * pools are closed when it is destroyed.
+	 */
+	template<class T>
+	class arena_buffer {
+	public:
+
+		//! Type of the pool of buffers
+		typedef details::arena_pool<T> pool_type;
+
+		//! Construct without buffer
+		arena_buffer()
+		:
+			mp_arena(0),
+			mp_buffer(0),
+			m_acquired(false),
+			m_owner(details::next_arena_owner()),
+			m_index(size_t(-1)),
+			m_generation(0)
+		{}
+
+		//! Copying gives a holder without buffer
+		arena_buffer(const arena_buffer &)
+		:
+			mp_arena(0),
+			mp_buffer(0),
+			m_acquired(false),
+			m_owner(details::next_arena_owner()),
+			m_index(size_t(-1)),
+			m_generation(0)
+		{}
+
+		//! Assignment gives back the buffer, like destruction
+		arena_buffer & operator=(const arena_buffer &) {
+			give_back();
+			return *this;
+		}
+
+		~arena_buffer() {
+			give_back();
+		}
+
+		//! Acquire the buffer for current frame
+		/**
+		 * @return True if it is the buffer held before, with its content
+		 */
+		bool acquire(frame_arena & arena) {
+			if (&arena != mp_arena || !mp_pool || mp_pool->closed) {
+				give_back();
+				mp_pool = arena.template pool<T>();
+				mp_arena = &arena;
+			}
+			bool kept;
+			T * previous = mp_buffer;
+			mp_buffer = &mp_pool->acquire(m_owner, m_index, kept);
+			m_acquired = true;
+			m_generation = mp_pool->generation;
+			return kept && mp_buffer == previous;
+		}
+
+		//! Mark the buffer as not used by the holder in current frame
+		/**
+		 * The buffer stays in the arena until the frame ends, and
+		 * it is kept if it is acquired again before that.
+		 */
+		inline void release() {
+			m_acquired = false;
+		}
+
+		//! Check if the buffer is acquired, for the current frame
+		/**
+		 * It is false once the frame of the arena ended, or the
+		 * arena is gone.
+		 */
+		inline bool is_acquired() const {
+			return m_acquired && !mp_pool->closed && mp_pool->generation == m_generation;
+		}
+
+		//! Get the buffer, valid until the frame of the arena ends
+		inline T & operator*() const {
+			return *mp_buffer;
+		}
+
+	private:
+
+		//! The pool of the last acquire
+		std::shared_ptr<pool_type> mp_pool;
+
+		//! The arena of the last acquire, only compared
+		const frame_arena * mp_arena;
+
+		//! The buffer of the last acquire
+		T * mp_buffer;
+
+		//! Flag if buffer was acquired and not released
+		bool m_acquired;
+
+		//! Id of holder in arenas
+		size_t m_owner;
+
+		//! Slot of the buffer in its pool
+		size_t m_index;
+
+		//! Generation of the pool at the last acquire
+		size_t m_generation;
+
+		//! Give back the buffer to its pool, if the pool is still open
+		void give_back() {
+			if (mp_pool && !mp_pool->closed)
+				mp_pool->give_back(m_owner, m_index);
+			mp_pool.reset();
+			mp_arena = 0;
+			mp_buffer = 0;
+			m_acquired = false;
+			m_index = size_t(-1);
+		}
+	};
+}
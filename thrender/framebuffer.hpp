@@ -173,6 +173,10 @@ namespace thrender {
 			m_clear_value = value;
 		}
 
+		inline const pixel_type & clear_value() const {
+			return m_clear_value;
+		}
+
 		inline void clear() {
 			thrust::fill(begin(), end(), m_clear_value);
 		}
@@ -2,6 +2,9 @@
 
 #include "framebuffer.hpp"
 #include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <typeinfo>
 #include <glm/glm.hpp>
 #include <thrust/host_vector.h>
 
@@ -24,32 +27,76 @@ namespace thrender {
 		//! The framebuffer type of the color buffer
 		typedef framebuffer_<color_pixel_t> color_buffer_type;
 
+		//! The framebuffer type of the hierarchical depth buffers
+		typedef framebuffer_<depth_bounds_t> depth_bounds_buffer_type;
+
+		//! The framebuffer type of the visibility buffer
+		typedef framebuffer_<visibility_pixel_t> visibility_buffer_type;
+
 		//! The type of shared pointer used for color buffer
 		typedef std::shared_ptr<color_buffer_type> color_buffer_pointer_type;
 
 		//! The type of shared pointer used for depth buffer
 		typedef std::shared_ptr<depth_buffer_type> depth_buffer_pointer_type;
 
+		//! The type of shared pointer used for hierarchical depth buffers
+		typedef std::shared_ptr<depth_bounds_buffer_type> depth_bounds_buffer_pointer_type;
+
+		//! The type of shared pointer used for visibility buffer
+		typedef std::shared_ptr<visibility_buffer_type> visibility_buffer_pointer_type;
+
 		//! The type of shared pointer used for extra buffer
 		typedef std::shared_ptr<extra_buffer_type> extra_buffer_pointer_type;
 
 		//! The type of container to hold all extra buffers
 		typedef thrust::host_vector<extra_buffer_pointer_type> extra_buffers_container_type;
 
+		//! A range of visibility ids reserved by an object
+		struct visibility_range {
+
+			//! The first id of the range
+			visibility_pixel_t first;
+
+			//! Total ids of the range
+			size_t count;
+
+			//! The object that reserved the range
+			const void * owner;
+
+			//! The type of the object that reserved the range
+			const std::type_info * type;
+		};
+
+		//! The type of container to hold the ranges of visibility ids
+		typedef thrust::host_vector<visibility_range> visibility_ranges_type;
+
 		//! Initialize a new framebuffer
 		/**
 		 * It will allocate the needed buffers (color, depth).
 		 * There is no way to change framebuffer size after initialization.
+		 * @throw std::invalid_argument If size exceeds max_framebuffer_width
+		 * or max_framebuffer_height.
 		 */
 		framebuffer_array(size_t width, size_t height)
 		:
-			m_width(width),
+			m_width(checked_width(width, height)),
 			m_height(height),
 			m_depth_buffer(depth_buffer_pointer_type(new depth_buffer_type(width, height))),
-			m_color_buffer(color_buffer_pointer_type(new color_buffer_type(width, height)))
+			m_color_buffer(color_buffer_pointer_type(new color_buffer_type(width, height))),
+			m_hiz_blocks(depth_bounds_buffer_pointer_type(new depth_bounds_buffer_type(
+				(width + hiz_block_size - 1) / hiz_block_size,
+				(height + hiz_block_size - 1) / hiz_block_size))),
+			m_hiz_tiles(depth_bounds_buffer_pointer_type(new depth_bounds_buffer_type(
+				(width + tile_size - 1) / tile_size,
+				(height + tile_size - 1) / tile_size))),
+			m_visibility_buffer(visibility_buffer_pointer_type(new visibility_buffer_type(width, height))),
+			m_visibility_ids(0)
 		{
 			m_depth_buffer->set_clear_value(default_depth_clear_value);
 			m_color_buffer->set_clear_value(default_color_clear_value);
+			m_visibility_buffer->set_clear_value(default_visibility_clear_value);
+			m_visibility_buffer->clear();
+			clear_hiz();
 		}
 
 		//! Get access to depth buffer
@@ -62,6 +109,113 @@ namespace thrender {
 			return * m_color_buffer;
 		}
 
+		//! Get access to the depth bounds per hiz_block_size block
+		/**
+		 * Together with hiz_tile_buffer() they form a hierarchical
+		 * depth buffer that is kept up to date by the rasterizer.
+		 */
+		inline depth_bounds_buffer_type & hiz_block_buffer() {
+			return *m_hiz_blocks;
+		}
+
+		//! Get access to the depth bounds per screen tile
+		inline depth_bounds_buffer_type & hiz_tile_buffer() {
+			return *m_hiz_tiles;
+		}
+
+		//! Get access to visibility buffer
+		/**
+		 * It holds the id of the primitive visible on each pixel,
+		 * written by visibility rendering.
+		 */
+		inline visibility_buffer_type & visibility_buffer() {
+			return *m_visibility_buffer;
+		}
+
+		//! Reserve a range of ids in the visibility buffer
+		/**
+		 * Every object rendered in the visibility buffer gets its
+		 * own range, so that pixels can be mapped back to objects.
+		 * Ids are released when the framebuffers are cleared.
+		 * @param count Total ids to reserve
+		 * @param owner The object that the ids belong to
+		 * @return The first id of the reserved range
+		 */
+		template<class OwnerType>
+		visibility_pixel_t reserve_visibility_ids(size_t count, const OwnerType & owner) {
+			visibility_pixel_t first = m_visibility_ids;
+			m_visibility_ids += count;
+			if (count) {
+				visibility_range range = {first, count, &owner, &typeid(OwnerType)};
+				m_visibility_ranges.push_back(range);
+			}
+			return first;
+		}
+
+		//! Find the range of visibility ids that an id belongs to
+		/**
+		 * @return The range, or 0 if the id was not reserved
+		 * since the framebuffers were cleared.
+		 */
+		const visibility_range * find_visibility_range(visibility_pixel_t id) const {
+			// Ranges are reserved in increasing order of ids
+			size_t low = 0, high = m_visibility_ranges.size();
+			while(low < high) {
+				size_t middle = (low + high) / 2;
+				if (m_visibility_ranges[middle].first <= id)
+					low = middle + 1;
+				else
+					high = middle;
+			}
+			if (low == 0 || id - m_visibility_ranges[low - 1].first >= m_visibility_ranges[low - 1].count)
+				return 0;
+			return &m_visibility_ranges[low - 1];
+		}
+
+		//! Get the ranges of visibility ids reserved since the framebuffers were cleared
+		inline const visibility_ranges_type & visibility_ranges() const {
+			return m_visibility_ranges;
+		}
+
+		//! Rebuild the hierarchical depth buffer from the depth buffer
+		/**
+		 * The rasterizer keeps the hierarchical depth up to date. This
+		 * must be called only when depth buffer is modified by any
+		 * other means, like a fragment shader writing on it.
+		 */
+		void update_hiz() {
+			depth_buffer_type & depth = *m_depth_buffer;
+			depth_bounds_buffer_type & blocks = *m_hiz_blocks;
+			depth_bounds_buffer_type & tiles = *m_hiz_tiles;
+
+			for(size_t by = 0;by < blocks.height();by++) {
+				for(size_t bx = 0;bx < blocks.width();bx++) {
+					depth_bounds_t & bounds = blocks[by][bx];
+					bounds.min = bounds.max = depth[by * hiz_block_size][bx * hiz_block_size];
+					for(size_t y = by * hiz_block_size;y < std::min<size_t>((by + 1) * hiz_block_size, height());y++) {
+						for(size_t x = bx * hiz_block_size;x < std::min<size_t>((bx + 1) * hiz_block_size, width());x++) {
+							bounds.min = std::min(bounds.min, depth[y][x]);
+							bounds.max = std::max(bounds.max, depth[y][x]);
+						}
+					}
+				}
+			}
+
+			const size_t tile_blocks = tile_size / hiz_block_size;
+			for(size_t ty = 0;ty < tiles.height();ty++) {
+				for(size_t tx = 0;tx < tiles.width();tx++) {
+					depth_bounds_t & bounds = tiles[ty][tx];
+					bounds = blocks[ty * tile_blocks][tx * tile_blocks];
+					for(size_t by = ty * tile_blocks;by < std::min((ty + 1) * tile_blocks, blocks.height());by++) {
+						for(size_t bx = tx * tile_blocks;bx < std::min((tx + 1) * tile_blocks, blocks.width());bx++) {
+							bounds.min = std::min(bounds.min, blocks[by][bx].min);
+							bounds.max = std::max(bounds.max, blocks[by][bx].max);
+						}
+					}
+				}
+			}
+		}
+
 		//! Get access to nth extra_buffer
 		inline extra_buffer_type & extra_buffer(size_t index){
 			return * extra_buffers[index];
@@ -79,6 +233,11 @@ namespace thrender {
 		void clear_all() {
 			m_depth_buffer->clear();
 			m_color_buffer->clear();
+			m_visibility_buffer->clear();
+			m_visibility_ids = 0;
+			m_visibility_ranges.clear();
+			clear_hiz();
+
 			for(extra_buffers_container_type::iterator
 				it = extra_buffers.begin();it!= extra_buffers.end();it++) {
 					(*it)->clear();
@@ -112,6 +271,30 @@ namespace thrender {
 
 	private:
 
+		//! Validate the size of a new framebuffer array
+		/**
+		 * It is called by the first member initializer, so that
+		 * nothing is allocated for an invalid size.
+		 * @return The width
+		 * @throw std::invalid_argument If size exceeds max_framebuffer_width
+		 * or max_framebuffer_height.
+		 */
+		static size_t checked_width(size_t width, size_t height) {
+			if (width > max_framebuffer_width || height > max_framebuffer_height)
+				throw std::invalid_argument("Framebuffer size exceeds the maximum supported");
+			return width;
+		}
+
+		//! Reset hierarchical depth to the clear value of depth buffer
+		void clear_hiz() {
+			depth_bounds_t cleared_bounds;
+			cleared_bounds.min = cleared_bounds.max = m_depth_buffer->clear_value();
+			m_hiz_blocks->set_clear_value(cleared_bounds);
+			m_hiz_blocks->clear();
+			m_hiz_tiles->set_clear_value(cleared_bounds);
+			m_hiz_tiles->clear();
+		}
+
 		//! The width of the framebuffer
 		window_size_t m_width;
 
@@ -124,6 +307,21 @@ namespace thrender {
 		//! Pointer to color buffer
 		color_buffer_pointer_type m_color_buffer;
 
+		//! Pointer to depth bounds per block
+		depth_bounds_buffer_pointer_type m_hiz_blocks;
+
+		//! Pointer to depth bounds per tile
+		depth_bounds_buffer_pointer_type m_hiz_tiles;
+
+		//! Pointer to visibility buffer
+		visibility_buffer_pointer_type m_visibility_buffer;
+
+		//! Next free id of visibility buffer
+		visibility_pixel_t m_visibility_ids;
+
+		//! Ranges of visibility ids, in the order they were reserved
+		visibility_ranges_type m_visibility_ranges;
+
 		//! Vector of all extra buffers
 		extra_buffers_container_type extra_buffers;
 
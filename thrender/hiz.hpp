@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include "./types.hpp"
+#include "./tiling.hpp"
+#include "./framebuffer_array.hpp"
+
+namespace thrender {
+namespace details {
+
+	//! Hierarchical depth of a tile while it is rasterized
+	/**
+	 * Keeps the depth bounds of the blocks of one tile up to date as
+	 * pixels are written. A write can only raise the minimum of a block,
+	 * so the block is marked dirty and its minimum is recomputed the next
+	 * time it is tested. The maximum is updated on every write.
+	 *
+	 * A pixel passes depth test when its depth is not less than the
+	 * stored one, so a block with minimum greater than the maximum depth
+	 * of a triangle is fully occluded by what is already drawn.
+	 */
+	struct hiz_tile {
+
+		//! Type of mask with one bit per block of the tile
+		typedef boost::uint64_t block_mask_type;
+
+		//! Number of blocks per side of a tile
+		static const window_size_t blocks_per_side = tile_size / hiz_block_size;
+
+		static_assert(blocks_per_side * blocks_per_side <= sizeof(block_mask_type) * 8,
+				"Blocks of a tile do not fit in block mask");
+
+		//! Construct for a specific tile of a framebuffer
+		hiz_tile(framebuffer_array & fb, const tile_rect & rect)
+		:
+			m_fb(fb),
+			m_rect(rect),
+			m_dirty_blocks(0)
+		{}
+
+		//! Check if any pixel of a block may pass depth test
+		/**
+		 * @param bx Block column in framebuffer
+		 * @param by Block row in framebuffer
+		 * @param z_max The maximum depth of the tested primitive
+		 */
+		inline bool is_block_visible(window_size_t bx, window_size_t by, depth_pixel_t z_max) {
+			refresh_block(bx, by);
+			return !(m_fb.hiz_block_buffer()[by][bx].min > z_max);
+		}
+
+		//! Check if all pixels of a block pass depth test
+		/**
+		 * @param bx Block column in framebuffer
+		 * @param by Block row in framebuffer
+		 * @param z_min The minimum depth of the tested primitive
+		 */
+		inline bool is_block_accepted(window_size_t bx, window_size_t by, depth_pixel_t z_min) {
+			return !(m_fb.hiz_block_buffer()[by][bx].max > z_min);
+		}
+
+		//! Record a depth write on a block
+		/**
+		 * @param bx Block column in framebuffer
+		 * @param by Block row in framebuffer
+		 * @param previous The depth value that was overwritten
+		 * @param z The new depth value
+		 */
+		inline void write(window_size_t bx, window_size_t by, depth_pixel_t previous, depth_pixel_t z) {
+			depth_bounds_t & bounds = m_fb.hiz_block_buffer()[by][bx];
+			if (previous == bounds.min)
+				m_dirty_blocks |= block_bit(bx, by);
+			if (z > bounds.max)
+				bounds.max = z;
+		}
+
+		//! Record a depth write without knowing the overwritten value
+		inline void write(window_size_t bx, window_size_t by, depth_pixel_t z) {
+			depth_bounds_t & bounds = m_fb.hiz_block_buffer()[by][bx];
+			m_dirty_blocks |= block_bit(bx, by);
+			if (z > bounds.max)
+				bounds.max = z;
+		}
+
+		//! Refresh all dirty blocks and the bounds of the tile
+		void flush() {
+			window_size_t bx_begin = m_rect.left / hiz_block_size;
+			window_size_t by_begin = m_rect.top / hiz_block_size;
+			window_size_t bx_end = (m_rect.right + hiz_block_size - 1) / hiz_block_size;
+			window_size_t by_end = (m_rect.bottom + hiz_block_size - 1) / hiz_block_size;
+
+			depth_bounds_t & tile_bounds = m_fb.hiz_tile_buffer()[m_rect.top / tile_size][m_rect.left / tile_size];
+			for(window_size_t by = by_begin;by < by_end;by++) {
+				for(window_size_t bx = bx_begin;bx < bx_end;bx++) {
+					refresh_block(bx, by);
+					const depth_bounds_t & bounds = m_fb.hiz_block_buffer()[by][bx];
+					if (bx == bx_begin && by == by_begin) {
+						tile_bounds = bounds;
+					} else {
+						tile_bounds.min = std::min(tile_bounds.min, bounds.min);
+						tile_bounds.max = std::max(tile_bounds.max, bounds.max);
+					}
+				}
+			}
+		}
+
+	private:
+
+		//! Get the bit of a block in dirty mask
+		inline block_mask_type block_bit(window_size_t bx, window_size_t by) const {
+			return block_mask_type(1) << ((by % blocks_per_side) * blocks_per_side + (bx % blocks_per_side));
+		}
+
+		//! Recompute minimum of a block if it is dirty
+		void refresh_block(window_size_t bx, window_size_t by) {
+			block_mask_type bit = block_bit(bx, by);
+			if (!(m_dirty_blocks & bit))
+				return;
+			m_dirty_blocks &= ~bit;
+
+			window_size_t x_begin = bx * hiz_block_size;
+			window_size_t y_begin = by * hiz_block_size;
+			window_size_t x_end = std::min<window_size_t>(x_begin + hiz_block_size, m_rect.right);
+			window_size_t y_end = std::min<window_size_t>(y_begin + hiz_block_size, m_rect.bottom);
+
+			depth_pixel_t z_min = m_fb.depth_buffer()[y_begin][x_begin];
+			for(window_size_t y = y_begin;y < y_end;y++) {
+				const depth_pixel_t * depth_row = m_fb.depth_buffer()[y];
+				for(window_size_t x = x_begin;x < x_end;x++)
+					z_min = std::min(z_min, depth_row[x]);
+			}
+			m_fb.hiz_block_buffer()[by][bx].min = z_min;
+		}
+
+		//! The framebuffer of the tile
+		framebuffer_array & m_fb;
+
+		//! Rectangle of the tile
+		tile_rect m_rect;
+
+		//! Blocks whose minimum must be recomputed
+		block_mask_type m_dirty_blocks;
+	};
+
+	//! Tile test for binning against the hierarchical depth
+	/**
+	 * Rejects tiles whose stored depth is already greater than
+	 * anything the binned primitive can write.
+	 */
+	struct hiz_tile_test {
+
+		//! The tested framebuffer
+		framebuffer_array & fb;
+
+		//! The maximum depth of the primitive
+		depth_pixel_t z_max;
+
+		hiz_tile_test(framebuffer_array & _fb, depth_pixel_t _z_max)
+		:
+			fb(_fb),
+			z_max(_z_max)
+		{}
+
+		inline bool operator()(size_t tx, size_t ty) const {
+			return !(fb.hiz_tile_buffer()[ty][tx].min > z_max);
+		}
+	};
+}
+}
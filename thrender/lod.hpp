@@ -0,0 +1,104 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "./bounds.hpp"
+#include "./render_context.hpp"
+
+namespace thrender {
+
+	//! Levels of detail of an object
+	/**
+	 * Level 0 is the object itself, each next level is a simplified
+	 * version of it with the geometric error of simplification. Levels
+	 * must be added from finer to coarser. The object is referenced
+	 * and must outlive the chain, simplified levels are owned.
+	 *
+	 * @see utils::build_lod_chain()
+	 */
+	template<class RenderableType>
+	class lod_chain {
+	public:
+
+		//! Type of objects
+		typedef RenderableType renderable_type;
+
+		//! Construct chain with only the object itself
+		explicit lod_chain(renderable_type & base)
+		:
+			m_base(&base),
+			m_errors(1, 0.0f)
+		{}
+
+		//! Append a coarser level
+		/**
+		 * @param object The simplified object, it is copied
+		 * @param error Maximum distance of the simplified surface from
+		 * the original one (Object-Space), select() projects it
+		 * to pixels
+		 */
+		void add_level(const renderable_type & object, float error) {
+			m_levels.push_back(object);
+			m_errors.push_back(error);
+		}
+
+		//! Get the number of levels
+		inline size_t size() const {
+			return m_errors.size();
+		}
+
+		//! Get the object of a level
+		inline renderable_type & level(size_t index) {
+			return index == 0 ? *m_base : m_levels[index - 1];
+		}
+
+		//! Get the geometric error of a level (Object-Space)
+		inline float error(size_t index) const {
+			return m_errors[index];
+		}
+
+		//! Select the coarsest level whose error is small enough on screen
+		/**
+		 * Error is projected on the viewport at the point of the
+		 * bounding sphere of the object that is nearest to camera.
+		 * @param model_mat Transformation of the object to world space
+		 * @param threshold Maximum error in pixels
+		 */
+		size_t select(const render_context & context, const glm::mat4 & model_mat, float threshold) const {
+			const sphere & bounds = m_base->bounding_sphere();
+			if (bounds.empty())
+				return 0;
+
+			float scale = std::max(std::max(
+					glm::length(glm::vec3(model_mat[0])),
+					glm::length(glm::vec3(model_mat[1]))),
+					glm::length(glm::vec3(model_mat[2])));
+			glm::vec3 center(model_mat * glm::vec4(bounds.center, 1.0f));
+			glm::vec3 eye(glm::inverse(context.cam.view_mat)[3]);
+			float distance = glm::length(center - eye) - bounds.radius * scale;
+			if (distance <= 0)
+				return 0;
+
+			// Projection scales y by cot(fov/2)
+			float pixels_per_unit = context.cam.projection_mat[1][1] * context.vp.height() * 0.5f / distance;
+			for(size_t i = size() - 1;i > 0;i--) {
+				if (m_errors[i] * scale * pixels_per_unit <= threshold)
+					return i;
+			}
+			return 0;
+		}
+
+	private:
+
+		//! The object itself
+		renderable_type * m_base;
+
+		//! Simplified objects, whose address is stable
+		std::deque<renderable_type> m_levels;
+
+		//! Error of each level
+		std::vector<float> m_errors;
+	};
+}
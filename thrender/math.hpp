@@ -93,6 +93,16 @@ namespace math{
 		//return  (a * lambda.x) + (b * lambda.y) + (c * lambda.z);
 	}
 
+	//! Twice the signed area of a 2d triangle
+	/**
+	 * Positive when points are in counter-clock-wise order.
+	 */
+	template <typename InVec>
+	inline float signed_area(InVec const & a, InVec const & b, InVec const & c)
+	{
+		return (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+	}
+
 	//! Sort 3 vectors by y using sorting networks
 	/**
 	 * @origin http://stackoverflow.com/questions/2786899/fastest-sort-of-fixed-length-6-int-array
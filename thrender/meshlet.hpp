@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <thrust/host_vector.h>
+#include <glm/glm.hpp>
+#include "./types.hpp"
+#include "./bounds.hpp"
+#include "./vertex_array.hpp"
+
+namespace thrender {
+
+	//! A cluster of nearby triangles of an object
+	/**
+	 * Vertices and elements of a meshlet are consecutive in the
+	 * object, so a whole meshlet can be skipped before its vertices
+	 * are processed.
+	 */
+	struct meshlet {
+
+		//! First vertex of meshlet
+		boost::uint32_t first_vertex;
+
+		//! Number of vertices
+		boost::uint32_t vertex_count;
+
+		//! First element of meshlet
+		boost::uint32_t first_element;
+
+		//! Number of elements
+		boost::uint32_t element_count;
+
+		//! Bounds of vertices (Object-Space)
+		sphere bounds;
+
+		//! Axis of the cone that holds all face normals (Object-Space)
+		glm::vec3 cone_axis;
+
+		//! Sine of the cone's spread, 1 if faces point in all directions
+		float cone_cutoff;
+
+		//! Check if all faces point away from a viewer
+		/**
+		 * Conservative, for any point of the bounding sphere.
+		 * @param eye Position of viewer (Object-Space)
+		 */
+		inline bool is_back_facing(const glm::vec3 & eye) const {
+			glm::vec3 v = bounds.center - eye;
+			return glm::dot(v, cone_axis) >= cone_cutoff * glm::length(v) + bounds.radius;
+		}
+
+		//! Check if all faces point towards a viewer
+		inline bool is_front_facing(const glm::vec3 & eye) const {
+			glm::vec3 v = bounds.center - eye;
+			return -glm::dot(v, cone_axis) >= cone_cutoff * glm::length(v) + bounds.radius;
+		}
+	};
+
+	//! Type of a list of meshlets
+	typedef thrust::host_vector<meshlet> meshlets_type;
+
+	//! Calculate the bounds and normal cone of a meshlet from its data
+	template<class RenderableType>
+	void calculate_meshlet_bounds(const RenderableType & object, meshlet & m) {
+		// Bounding sphere, centered on the bounding box
+		aabb box;
+		for(size_t v = m.first_vertex;v < m.first_vertex + m.vertex_count;v++)
+			box.extend(glm::vec3(VA_ATTRIBUTE(object.vertices[v], POSITION)));
+		m.bounds = sphere(box.center(), 0);
+		for(size_t v = m.first_vertex;v < m.first_vertex + m.vertex_count;v++)
+			m.bounds.radius = std::max(m.bounds.radius,
+					glm::length(glm::vec3(VA_ATTRIBUTE(object.vertices[v], POSITION)) - m.bounds.center));
+
+		// Cone axis is the average direction of face normals
+		std::vector<glm::vec3> normals;
+		glm::vec3 sum(0.0f);
+		for(size_t e = m.first_element;e < m.first_element + m.element_count;e++) {
+			const indices3_t & indices = object.element_indices[e];
+			glm::vec3 p0(VA_ATTRIBUTE(object.vertices[indices.x], POSITION));
+			glm::vec3 p1(VA_ATTRIBUTE(object.vertices[indices.y], POSITION));
+			glm::vec3 p2(VA_ATTRIBUTE(object.vertices[indices.z], POSITION));
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(n);
+			if (length == 0)
+				continue;
+			normals.push_back(n / length);
+			sum += normals.back();
+		}
+
+		// Disable cone culling unless all faces are within ~85 degrees of axis
+		m.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+		m.cone_cutoff = 1.0f;
+		float sum_length = glm::length(sum);
+		if (normals.empty() || sum_length == 0)
+			return;
+
+		m.cone_axis = sum / sum_length;
+		float min_dot = 1.0f;
+		for(size_t i = 0;i < normals.size();i++)
+			min_dot = std::min(min_dot, glm::dot(normals[i], m.cone_axis));
+		if (min_dot > 0.1f)
+			m.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+	}
+}
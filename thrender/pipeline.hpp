@@ -1,6 +1,12 @@
 #pragma once
 #include "./vertex_processor.hpp"
+#include "./primitive_processor.hpp"
 #include "./fragment_processor.hpp"
+#include "./visibility_processor.hpp"
+#include "./render_batch.hpp"
+#include "./scene.hpp"
+#include "./lod.hpp"
+#include "./shader_hooks.hpp"
 
 namespace thrender {
 
@@ -18,21 +24,239 @@ namespace thrender {
 		//! Type of fragment shader
 		typedef FragmentShader fragment_shader_type;
 
+		//! Type of shader for depth only rendering
+		/**
+		 * It follows the same rasterization path as the fragment
+		 * shader, so that depth is equal on both passes.
+		 */
+		typedef details::depth_only_fg_shader<
+			details::has_packet_operator<fragment_shader_type, renderable_type>::value> depth_shader_type;
+
 		vertex_shader_type  & vx_shader;
 
 		fragment_shader_type & fg_shader;
 
+		//! When depth is tested and written relative to shading
+		/**
+		 * Must be depth_test_mode::late if fragment shader discards.
+		 */
+		depth_test_mode depth_mode;
+
+		//! Elements per chunk of chunked geometry processing, 0 to disable
+		/**
+		 * Only meshes ordered for locality benefit from chunks.
+		 * @see process_geometry()
+		 */
+		size_t chunk_size;
+
+		//! Maximum error in pixels, when selecting levels of detail
+		float lod_threshold;
+
 		//! Execute pipeline to render one frame
 		pipeline(vertex_shader_type & _vx_shader, fragment_shader_type & _fg_shader) :
 			vx_shader(_vx_shader),
-			fg_shader(_fg_shader)
+			fg_shader(_fg_shader),
+			depth_mode(depth_test_mode::early),
+			chunk_size(0),
+			lod_threshold(1.0f)
 		{
 
 		}
 
+		//! Render object
+		/**
+		 * The transformation of the vertex shader is not known, so
+		 * the object and its meshlets are never culled.
+		 */
 		void draw(renderable_type & object, render_context & context){
-			process_vertices<vertex_shader_type, renderable_type>(object, vx_shader, context);
-			process_fragments<fragment_shader_type, renderable_type>(object, fg_shader, context);
+			draw_object(object, 0, context);
+		}
+
+		//! Render object that the vertex shader transforms with a model matrix
+		/**
+		 * The matrix is only used to cull the object against the view
+		 * frustum, when object culling is enabled on the context.
+		 */
+		void draw(renderable_type & object, const glm::mat4 & model_mat, render_context & context){
+			draw_object(object, &model_mat, context);
+		}
+
+		//! Render the level of detail of an object that fits its size on screen
+		/**
+		 * The coarsest level whose error is below lod_threshold
+		 * pixels is drawn.
+		 * @param model_mat Transformation that the vertex shader
+		 * applies to the object.
+		 */
+		void draw(lod_chain<renderable_type> & lods, const glm::mat4 & model_mat, render_context & context){
+			draw(lods.level(lods.select(context, model_mat, lod_threshold)), model_mat, context);
+		}
+
+		//! Render many instances of object at once
+		/**
+		 * All instances go through each stage in one parallel pass.
+		 * Shaders get the data of their instance with the instance()
+		 * function of their control.
+		 * @param instance_data Array with the data of each instance
+		 * @param count Number of instances
+		 */
+		template<class InstanceType>
+		void draw_instanced(renderable_type & object, const InstanceType * instance_data, size_t count, render_context & context){
+			prepare_shaders(context);
+			object.prepare_for_rendering(context, instance_data, count);
+			details::run_geometry(object, vx_shader, context, chunk_size);
+			details::run_fragments<fragment_shader_type, renderable_type>(object, fg_shader, context, depth_mode);
+			finish_shaders(context);
+		}
+
+		//! Render all objects of a batch at once
+		/**
+		 * Each stage runs once across all objects of the batch,
+		 * which are drawn in the order they were added. Shaders
+		 * get the uniforms of their object with the instance()
+		 * function of their control.
+		 */
+		void draw_batch(render_batch<renderable_type> & batch, render_context & context){
+			prepare_shaders(context);
+			batch.prepare_for_rendering(context);
+			details::run_geometry(batch, vx_shader, context, chunk_size);
+			details::run_fragments<fragment_shader_type, render_batch<renderable_type> >(batch, fg_shader, context, depth_mode);
+			finish_shaders(context);
+		}
+
+		//! Render the objects of a scene that are visible by the camera of context
+		/**
+		 * The scene is culled in the batch, which is then drawn
+		 * with draw_batch(). Shaders get the transforms of their
+		 * object with instance<shaders::instance_transform>() of their
+		 * control, so instanced_vx_shader draws a scene as is.
+		 * @see scene::cull()
+		 */
+		void draw_scene(scene<renderable_type> & objects, render_batch<renderable_type> & batch, render_context & context){
+			objects.cull(context.cam, batch);
+			draw_batch(batch, context);
+		}
+
+		//! Render only the depth of object, without shading
+		/**
+		 * Used as a depth pre-pass. Drawing objects again with
+		 * depth_function::equal on the context, shades only the
+		 * fragments that are visible. As with draw(), the object is
+		 * never culled without a model matrix.
+		 */
+		void draw_depth(renderable_type & object, render_context & context){
+			draw_depth_object(object, 0, context);
+		}
+
+		//! Render only the depth of object, that is transformed with a model matrix
+		void draw_depth(renderable_type & object, const glm::mat4 & model_mat, render_context & context){
+			draw_depth_object(object, &model_mat, context);
+		}
+
+		//! Render only the depth of the level of detail that fits on screen
+		/**
+		 * The same level is selected as in draw(), for the same
+		 * context and transformation.
+		 */
+		void draw_depth(lod_chain<renderable_type> & lods, const glm::mat4 & model_mat, render_context & context){
+			draw_depth(lods.level(lods.select(context, model_mat, lod_threshold)), model_mat, context);
+		}
+
+		//! Render object in the visibility buffer, without shading
+		/**
+		 * Only depth and visibility buffers are written. After all
+		 * objects are drawn, resolve() shades each visible pixel once.
+		 * As with draw(), the object is never culled without a model
+		 * matrix.
+		 * @throw std::logic_error If object was already drawn in the
+		 * visibility buffer since it was cleared.
+		 */
+		void draw_visibility(renderable_type & object, render_context & context){
+			draw_visibility_object(object, 0, context);
+		}
+
+		//! Render object in the visibility buffer, that is transformed with a model matrix
+		/**
+		 * @throw std::logic_error If object was already drawn in the
+		 * visibility buffer since it was cleared.
+		 */
+		void draw_visibility(renderable_type & object, const glm::mat4 & model_mat, render_context & context){
+			draw_visibility_object(object, &model_mat, context);
+		}
+
+		//! Shade each pixel of the visibility buffer once
+		/**
+		 * All objects drawn with draw_visibility() since the
+		 * framebuffers were cleared are resolved in one pass.
+		 */
+		void resolve(render_context & context){
+			resolve_visibility<renderable_type, fragment_shader_type>(fg_shader, context);
+		}
+
+	private:
+
+		//! Call the prepare hooks of both shaders, once per draw
+		void prepare_shaders(render_context & context) {
+			details::prepare_shader(vx_shader, context);
+			details::prepare_shader(fg_shader, context);
+		}
+
+		//! Call the finish hooks of both shaders, once per draw
+		void finish_shaders(render_context & context) {
+			details::finish_shader(vx_shader, context);
+			details::finish_shader(fg_shader, context);
+		}
+
+		//! Render object, culled only if its model matrix is given
+		void draw_object(renderable_type & object, const glm::mat4 * model_mat, render_context & context){
+			if (is_object_culled(object, model_mat, context))
+				return;
+			prepare_shaders(context);
+			object.prepare_for_rendering(context);
+			process_object_geometry(object, model_mat, context);
+			details::run_fragments<fragment_shader_type, renderable_type>(object, fg_shader, context, depth_mode);
+			finish_shaders(context);
+		}
+
+		//! Render only the depth of object, culled only if its model matrix is given
+		void draw_depth_object(renderable_type & object, const glm::mat4 * model_mat, render_context & context){
+			if (is_object_culled(object, model_mat, context))
+				return;
+			depth_shader_type depth_shader;
+			details::prepare_shader(vx_shader, context);
+			object.prepare_for_rendering(context);
+			process_object_geometry(object, model_mat, context);
+			details::run_fragments<depth_shader_type, renderable_type>(object, depth_shader, context, depth_test_mode::early);
+			details::finish_shader(vx_shader, context);
+		}
+
+		//! Render object in the visibility buffer, culled only if its model matrix is given
+		void draw_visibility_object(renderable_type & object, const glm::mat4 * model_mat, render_context & context){
+			details::check_visibility_redraw(object, context);
+			if (is_object_culled(object, model_mat, context))
+				return;
+			details::prepare_shader(vx_shader, context);
+			object.prepare_for_rendering(context);
+			process_object_geometry(object, model_mat, context);
+			process_visibility<renderable_type>(object, context);
+			details::finish_shader(vx_shader, context);
+		}
+
+		//! Check if an object is outside the view frustum
+		/**
+		 * @param model_mat Transformation of the object, or 0 if it
+		 * is not known and the object can not be culled.
+		 */
+		inline bool is_object_culled(const renderable_type & object, const glm::mat4 * model_mat, const render_context & context) const {
+			return model_mat && !context.is_object_visible(object.bounding_box(), *model_mat);
+		}
+
+		//! Process geometry of a single object, per meshlet when it can be culled
+		void process_object_geometry(renderable_type & object, const glm::mat4 * model_mat, render_context & context) {
+			if (model_mat && context.object_culling && object.has_meshlets())
+				details::run_meshlets(object, vx_shader, context, *model_mat);
+			else
+				details::run_geometry(object, vx_shader, context, chunk_size);
 		}
 
 	};
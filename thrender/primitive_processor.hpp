@@ -1,40 +1,443 @@
 #pragma once
 
+#include <algorithm>
+#include "./types.hpp"
 #include "./math.hpp"
-#include "./triangle.hpp"
-#include "./render_state.hpp"
+#include "./render_context.hpp"
+#include "./renderable.hpp"
+#include "./triangle_setup.hpp"
+#include "./clipping.hpp"
+#include "./vertex_processor.hpp"
+#include "./shader_hooks.hpp"
+#include <thrust/copy.h>
+#include <thrust/fill.h>
+#include <thrust/for_each.h>
+#include <thrust/transform.h>
+#include <thrust/iterator/counting_iterator.h>
 
 namespace thrender {
 
-	struct primitives_proc_kernel {
+	//! Kernel for triangle setup
+	/**
+	 * Computes the edge functions and the attribute planes
+	 * of one triangle from its processed vertices. Planes are
+	 * setup only for the Attributes that the vertex shader outputs.
+	 * Runs once per element id and writes its setup and state.
+	 */
+	template<class RenderableType, class Attributes = typename details::all_attributes<typename RenderableType::vertex_type>::type>
+	struct primitive_processor_kernel {
 
-		const mesh & m;
-		const thrust::host_vector<glm::vec4> & ws_vertices;
-		render_context & rstate;
+		//! Type of renderable object
+		typedef RenderableType renderable_type;
 
-		primitives_proc_kernel(const thrust::host_vector<glm::vec4> & v,
-				const mesh & _m, thrender::render_context & _rstate) :
-				m(_m), ws_vertices(v), rstate(_rstate) {
+		//! Type of vertex
+		typedef typename renderable_type::vertex_type vertex_type;
+
+		//! Type of triangle setup
+		typedef typename renderable_type::triangle_setup_type setup_type;
+
+		//! Reference to renderable object
+		renderable_type & object;
+
+		//! Reference to context
+		render_context & context;
+
+		//! Construct the kernel for a specific object and context
+		primitive_processor_kernel(renderable_type & _object, render_context & _context)
+		:
+			object(_object),
+			context(_context)
+		{}
+
+		void operator()(primitive_id_t id) const {
+			typename renderable_type::intermediate_buffer_type & ib = object.intermediate_buffer();
+			ib.setup_states[id] = setup_element(ib.elements[id].indices, ib.setups[id], ib.setup_bounds[id]);
+		}
+
+		//! Setup an element from the ids of its processed vertices
+		setup_state setup_element(const indices3_t & indices, setup_type & setup, triangle_bounds & bounds) const {
+
+			// If any vertex is discarded, the whole triangle is.
+			const typename renderable_type::intermediate_buffer_type & ib = object.intermediate_buffer();
+			if (ib.discarded_vertices[indices[0]]
+				|| ib.discarded_vertices[indices[1]]
+				|| ib.discarded_vertices[indices[2]])
+			{
+				return setup_state::rejected;
+			}
+
+			// Outside of a clip plane, or crossing one
+			clip_code_t code0 = ib.clip_codes[indices[0]];
+			clip_code_t code1 = ib.clip_codes[indices[1]];
+			clip_code_t code2 = ib.clip_codes[indices[2]];
+			if (code0 & code1 & code2)
+				return setup_state::rejected;
+			if (code0 | code1 | code2)
+				return setup_state::clipped;
+
+			return setup_triangle(details::triangle_soa_vertices<typename renderable_type::intermediate_buffer_type::soa_vertices_type>(
+					ib.processed_vertices, indices), setup, bounds);
+		}
+
+		//! Setup a triangle that is inside the clip volume
+		/**
+		 * @param vertices Source of the attributes of the vertices
+		 * @see details::attribute_planes_of
+		 */
+		template<class Source>
+		setup_state setup_triangle(const Source & vertices, setup_type & setup, triangle_bounds & bounds) const {
+			const glm::vec4 p0 = vertices.template attribute<POSITION>(0);
+			const glm::vec4 p1 = vertices.template attribute<POSITION>(1);
+			const glm::vec4 p2 = vertices.template attribute<POSITION>(2);
+
+			// Face culling
+			if (context.culling != cull_mode::none) {
+				bool is_front = math::signed_area(p0, p1, p2) > 0;
+				if (is_front == (context.culling == cull_mode::front))
+					return setup_state::rejected;
+			}
+
+			if (!setup.edges.setup(p0, p1, p2))
+				return setup_state::rejected;
+
+			bounds.bounding_box = triangle_bounding_box(p0, p1, p2);
+			bounds.depth_bounds.min = std::min(std::min(p0.z, p1.z), p2.z);
+			bounds.depth_bounds.max = std::max(std::max(p0.z, p1.z), p2.z);
+			setup.depth.setup(p0.z, p1.z, p2.z, setup.edges);
+
+			typedef details::attribute_planes_of<vertex_type, Attributes> planes_of;
+			if (context.interpolation == interpolation_mode::perspective) {
+				// Window space w holds 1/w of clip space
+				setup.inv_w.setup(p0.w, p1.w, p2.w, setup.edges);
+				planes_of::setup_perspective(setup.planes, vertices, glm::vec3(p0.w, p1.w, p2.w), setup.edges);
+			} else {
+				planes_of::setup(setup.planes, vertices, setup.edges);
+			}
+			return setup_state::visible;
+		}
+	};
+
+namespace details {
+
+	//! Predicate on setup states of triangles that survived rejection
+	/**
+	 * Clipped triangles are kept too, as a placeholder of the
+	 * triangles generated by clipping them.
+	 */
+	struct is_setup_visible {
+
+		inline bool operator()(setup_state state) const {
+			return state != setup_state::rejected;
 		}
+	};
+
+	//! Predicate on setup states of triangles that cross a clip plane
+	struct is_setup_clipped {
 
-		triangle operator()(const glm::ivec3 & tr) {
-			return triangle();
-					/*m,
-					ws_vertices,
-					tr.x, tr.y, tr.z,
-					m.render_buffer.discard_vertices[tr.x] || m.render_buffer.discard_vertices[tr.y]
-							|| m.render_buffer.discard_vertices[tr.z]);*/
+		inline bool operator()(setup_state state) const {
+			return state == setup_state::clipped;
 		}
 	};
 
-	// Process projected vertices and extract primitives.
-	thrust::host_vector<triangle> process_primitives(const mesh & m, thrender::render_context & rstate) {
-		thrust::host_vector<triangle> primitives(m.total_triangles());
+	//! Clip all triangles that cross a clip plane
+	/**
+	 * This is rare, so clipping runs serially. Each triangle is
+	 * clipped in homogeneous space and the resulting polygon is
+	 * split in a fan of triangles, that are setup and appended
+	 * after the elements of the object.
+	 */
+	template<class RenderableType, class Attributes = typename details::all_attributes<typename RenderableType::vertex_type>::type>
+	void clip_primitives(RenderableType & object, render_context & context) {
+		typedef typename RenderableType::intermediate_buffer_type intermediate_buffer_type;
+		typedef typename RenderableType::triangle_type triangle_type;
+		typedef typename RenderableType::triangle_setup_type setup_type;
+
+		intermediate_buffer_type & ib = object.intermediate_buffer();
+		size_t total_elements = ib.elements.size();
+		ib.clipped_vertices.clear();
+		ib.clipped_elements.clear();
+		ib.clipped_origins.clear();
+
+		// Find triangles that need clipping
+		thrust::counting_iterator<primitive_id_t> ids_begin(0);
+		ib.clipped_sources.resize(total_elements);
+		typename intermediate_buffer_type::element_ids_type::iterator sources_end = thrust::copy_if(
+				ids_begin, ids_begin + total_elements,		// Input
+				ib.setup_states.begin(),					// Stencil
+				ib.clipped_sources.begin(),					// Output
+				is_setup_clipped());
+		ib.clipped_sources.resize(sources_end - ib.clipped_sources.begin());
+		if (ib.clipped_sources.empty())
+			return;
+
+		primitive_processor_kernel<RenderableType, Attributes> kernel(object, context);
+		typename intermediate_buffer_type::element_ids_type::const_iterator it;
+		for(it = ib.clipped_sources.begin(); it != ib.clipped_sources.end(); it++) {
+			const triangle_type & tr = ib.elements[*it];
+
+			clip_polygon<typename RenderableType::vertex_type, Attributes> polygon;
+			clip_code_t code = 0;
+			for(size_t i = 0;i < 3;i++) {
+				typename RenderableType::vertex_type vertex;
+				ib.processed_vertices.get(tr.indices[i], vertex, Attributes());
+				polygon.push_back(vertex, ib.clip_positions[tr.indices[i]]);
+				code |= ib.clip_codes[tr.indices[i]];
+			}
+			polygon.clip(code, context);
+			if (polygon.size < 3)
+				continue;
 
+			size_t first_vertex = ib.clipped_vertices.size();
+			for(size_t i = 0;i < polygon.size;i++)
+				ib.clipped_vertices.push_back(polygon.vertices[i].vertex);
+
+			for(size_t i = 1;i + 1 < polygon.size;i++) {
+				indices3_t indices(first_vertex, first_vertex + i, first_vertex + i + 1);
+				ib.clipped_elements.push_back(triangle_type(indices));
+				ib.clipped_origins.push_back(*it);
+
+				setup_type setup;
+				triangle_bounds bounds;
+				ib.setup_states.push_back(kernel.setup_triangle(details::triangle_vertices<typename RenderableType::vertex_type>(
+						polygon.vertices[0].vertex, polygon.vertices[i].vertex, polygon.vertices[i + 1].vertex), setup, bounds));
+				ib.setups.push_back(setup);
+				ib.setup_bounds.push_back(bounds);
+			}
+		}
+	}
+
+	//! Setup a range of elements
+	/**
+	 * Planes are setup for the Attributes, attributes that are not
+	 * stored in processed vertices get planes of zero.
+	 */
+	template<class RenderableType, class Attributes = typename details::all_attributes<typename RenderableType::vertex_type>::type>
+	void setup_primitives(RenderableType & object, render_context & context, size_t first, size_t last) {
+		typename RenderableType::intermediate_buffer_type & ib = object.intermediate_buffer();
+		ib.interpolated_attributes = details::attribute_mask(Attributes()) & ib.processed_vertices.stored_attributes();
+
+		thrust::counting_iterator<primitive_id_t> ids_begin(first);
+		thrust::for_each(
+				ids_begin, ids_begin + (last - first),
+				primitive_processor_kernel<RenderableType, Attributes>(object, context));
+	}
+
+	//! Allocate setups, bounds and states of all elements
+	template<class RenderableType>
+	void begin_primitives(RenderableType & object) {
+		typename RenderableType::intermediate_buffer_type & ib = object.intermediate_buffer();
+		ib.setups.resize(ib.elements.size());
+		ib.setup_bounds.resize(ib.elements.size());
+		ib.setup_states.resize(ib.elements.size());
+	}
+
+	//! Mark a range of elements as rejected, without setting them up
+	template<class RenderableType>
+	void reject_primitives(RenderableType & object, size_t first, size_t last) {
+		typename RenderableType::intermediate_buffer_type & ib = object.intermediate_buffer();
+		thrust::fill(ib.setup_states.begin() + first, ib.setup_states.begin() + last, setup_state::rejected);
+	}
+
+	//! Kernel that tests if meshlets may be visible
+	struct meshlet_cull_kernel {
+
+		//! View frustum (Object-Space)
+		frustum view;
+
+		//! Position of viewer (Object-Space)
+		glm::vec3 eye;
+
+		//! Faces that are culled
+		cull_mode culling;
+
+		//! Construct kernel
+		/**
+		 * @param model_mat Transformation of the object to world space
+		 */
+		meshlet_cull_kernel(const render_context & context, const glm::mat4 & model_mat)
+		:
+			view(context.cam.projection_mat * context.cam.view_mat * model_mat),
+			eye(glm::inverse(context.cam.view_mat * model_mat)[3]),
+			culling(context.culling)
+		{}
+
+		unsigned char operator()(const meshlet & m) const {
+			if (!view.intersects(m.bounds))
+				return 0;
+			if (culling == cull_mode::back && m.is_back_facing(eye))
+				return 0;
+			if (culling == cull_mode::front && m.is_front_facing(eye))
+				return 0;
+			return 1;
+		}
+	};
+
+	//! Clip primitives and compact the visible ones, after all elements are setup
+	template<class RenderableType, class Attributes = typename details::all_attributes<typename RenderableType::vertex_type>::type>
+	void finish_primitives(RenderableType & object, render_context & context) {
+		typename RenderableType::intermediate_buffer_type & ib = object.intermediate_buffer();
+		clip_primitives<RenderableType, Attributes>(object, context);
+
+		// Stream compaction of visible triangles
+		thrust::counting_iterator<primitive_id_t> ids_begin(0);
+		ib.visible_elements.resize(ib.elements.size());
+		typename RenderableType::intermediate_buffer_type::element_ids_type::iterator visible_end = thrust::copy_if(
+				ids_begin, ids_begin + ib.elements.size(),	// Input
+				ib.setup_states.begin(),					// Stencil
+				ib.visible_elements.begin(),				// Output
+				is_setup_visible());
+		ib.visible_elements.resize(visible_end - ib.visible_elements.begin());
+	}
+}
+
+	//! Process projected vertices and setup primitives for rasterization
+	/**
+	 * Runs once per triangle, in parallel, after vertex processing.
+	 * Triangles crossing a clip plane are then clipped. Ids of the
+	 * triangles that survived setup are compacted in a dense list,
+	 * so later stages never visit a rejected triangle.
+	 *
+	 * @tparam Attributes Attributes whose planes are setup, all by
+	 * default. Use details::output_attributes of the vertex shader
+	 * to skip attributes that are not varyings.
+	 */
+	template<class RenderableType, class Attributes = typename details::all_attributes<typename RenderableType::vertex_type>::type>
+	void process_primitives(RenderableType & object, render_context & context) {
+		details::begin_primitives(object);
+		details::setup_primitives<RenderableType, Attributes>(object, context, 0, object.intermediate_buffer().elements.size());
+		details::finish_primitives<RenderableType, Attributes>(object, context);
+	}
+
+namespace details {
+
+	//! Process vertices and primitives of an object, without calling shader hooks
+	/**
+	 * @see thrender::process_geometry()
+	 */
+	template<class VertexShader, class RenderableType>
+	void run_geometry(RenderableType & object, VertexShader & shader, render_context & context,
+			size_t chunk_elements) {
+		typedef typename output_attributes<VertexShader, typename RenderableType::vertex_type>::type attributes;
+		typename RenderableType::intermediate_buffer_type & ib = object.intermediate_buffer();
+		if (chunk_elements == 0) {
+			run_vertex_shader(object, shader, context, 0, ib.total_vertices());
+			process_primitives<RenderableType, attributes>(object, context);
+			return;
+		}
+
+		size_t total_elements = ib.elements.size();
+		size_t processed_end = 0;
+		begin_primitives(object);
+		for(size_t first = 0;first < total_elements;first += chunk_elements) {
+			size_t last = std::min(first + chunk_elements, total_elements);
+
+			// Vertices referenced by the chunk
+			size_t vertices_end = processed_end;
+			for(size_t e = first;e < last;e++) {
+				const indices3_t & indices = ib.elements[e].indices;
+				vertices_end = std::max(vertices_end, size_t(std::max(std::max(indices.x, indices.y), indices.z)) + 1);
+			}
+
+			processed_end = run_vertex_shader(object, shader, context, processed_end, vertices_end);
+			setup_primitives<RenderableType, attributes>(object, context, first, last);
+		}
+
+		// Vertices that no element references
+		run_vertex_shader(object, shader, context, processed_end, ib.total_vertices());
+		finish_primitives<RenderableType, attributes>(object, context);
+	}
+
+	//! Process vertices and primitives of the meshlets that may be visible, without calling shader hooks
+	/**
+	 * @see thrender::process_meshlets()
+	 */
+	template<class VertexShader, class RenderableType>
+	void run_meshlets(RenderableType & object, VertexShader & shader, render_context & context,
+			const glm::mat4 & model_mat) {
+		typedef typename output_attributes<VertexShader, typename RenderableType::vertex_type>::type attributes;
+		typename RenderableType::intermediate_buffer_type & ib = object.intermediate_buffer();
+		const meshlets_type & meshlets = object.meshlets();
+		begin_primitives(object);
+
+		ib.meshlet_visible.resize(meshlets.size());
 		thrust::transform(
-				m.triangles.begin(), m.triangles.end(),		// Input
-				primitives.begin(),							// Output
-				primitives_proc_kernel(m.render_buffer.projected_vertices, m, rstate));
-		return primitives;
+				meshlets.begin(), meshlets.end(),	// Input
+				ib.meshlet_visible.begin(),			// Output
+				meshlet_cull_kernel(context, model_mat));
+
+		size_t processed_end = 0;
+		for(size_t first = 0;first < meshlets.size();) {
+			size_t last = first + 1;
+			while(last < meshlets.size() && ib.meshlet_visible[last] == ib.meshlet_visible[first])
+				last++;
+
+			const meshlet & m_first = meshlets[first];
+			const meshlet & m_last = meshlets[last - 1];
+			size_t first_element = m_first.first_element;
+			size_t last_element = m_last.first_element + m_last.element_count;
+			if (ib.meshlet_visible[first]) {
+				// Packets may have processed the first vertices already
+				size_t first_vertex = std::max(processed_end, size_t(m_first.first_vertex));
+				size_t last_vertex = m_last.first_vertex + m_last.vertex_count;
+				processed_end = run_vertex_shader(object, shader, context, first_vertex, last_vertex);
+				setup_primitives<RenderableType, attributes>(object, context, first_element, last_element);
+			} else {
+				reject_primitives(object, first_element, last_element);
+			}
+			first = last;
+		}
+		finish_primitives<RenderableType, attributes>(object, context);
+	}
+}
+
+	//! Process vertices and primitives of an object prepared for rendering
+	/**
+	 * With chunked processing, elements are processed in chunks of
+	 * consecutive elements. Before the setup of a chunk, all vertices
+	 * up to the highest index it references are processed, so that
+	 * recently processed vertices are still in cache when they are
+	 * setup. Vertices after the highest index of the last chunk are
+	 * processed at the end, so each vertex is processed once, whether
+	 * it is referenced or not, and the output is the same as without
+	 * chunks. Processed vertices are allocated for the whole object
+	 * as usual.
+	 *
+	 * Chunking requires a mesh ordered for locality, whose vertices
+	 * are numbered in the order elements first use them, like the
+	 * output of utils::optimize_mesh(). Otherwise the first chunk may
+	 * reference a high index and process most vertices at once.
+	 *
+	 * The prepare and finish hooks of the shader are called before
+	 * and after the vertices.
+	 *
+	 * @param chunk_elements Number of elements per chunk, 0 to
+	 * process all vertices and then all primitives.
+	 */
+	template<class VertexShader, class RenderableType>
+	void process_geometry(RenderableType & object, VertexShader & shader, render_context & context,
+			size_t chunk_elements = 0) {
+		details::prepare_shader(shader, context);
+		details::run_geometry(object, shader, context, chunk_elements);
+		details::finish_shader(shader, context);
+	}
+
+	//! Process vertices and primitives of the meshlets that may be visible
+	/**
+	 * Meshlets outside of the view frustum, or whose faces are all
+	 * culled by the context, are rejected before their vertices are
+	 * processed. Consecutive meshlets that pass are processed at once.
+	 * The object must have valid meshlets and be prepared for a
+	 * single draw. The prepare and finish hooks of the shader are
+	 * called before and after the vertices.
+	 *
+	 * @param model_mat Transformation that the vertex shader applies
+	 * to the object, before the camera view and projection.
+	 */
+	template<class VertexShader, class RenderableType>
+	void process_meshlets(RenderableType & object, VertexShader & shader, render_context & context,
+			const glm::mat4 & model_mat) {
+		details::prepare_shader(shader, context);
+		details::run_meshlets(object, shader, context, model_mat);
+		details::finish_shader(shader, context);
 	}
 }
@@ -1,18 +1,89 @@
 #pragma once
 
 #include <limits>
+#include <algorithm>
 #include <boost/array.hpp>
 #include "./types.hpp"
 #include "./math.hpp"
 
 namespace thrender {
+
+	//! Algorithms available to scan convert triangles
+	enum class raster_algorithm {
+		half_space,			//!< Incremental edge functions (default)
+		scanline_bresenham	//!< Bresenham contour and per pixel barycoords
+	};
+
 namespace details {
 
+	//! Edge functions of a triangle, normalized to barycentric coordinates
+	/**
+	 * Each edge function is a plane e(x,y) = a*x + b*y + c that is zero on
+	 * one edge of the triangle and one on the opposite vertex. Evaluated on
+	 * a pixel they give its barycentric coordinates directly, while moving
+	 * one pixel right or down only costs an addition.
+	 */
+	struct edge_equations {
+
+		//! Change of each edge function per pixel on x-axis
+		glm::vec3 a;
+
+		//! Change of each edge function per pixel on y-axis
+		glm::vec3 b;
+
+		//! Minimum accepted value per edge (top-left fill rule)
+		glm::vec3 bias;
+
+		//! The point where functions are evaluated from (first vertex)
+		glm::vec2 origin;
+
+		//! Calculate edge functions from the window space vertices
+		/**
+		 * @return False if the triangle is degenerate and covers no area.
+		 */
+		template<class Vec>
+		bool setup(const Vec & p0, const Vec & p1, const Vec & p2) {
+			float area = math::signed_area(p0, p1, p2);
+			if (fabsf(area) < std::numeric_limits<float>::epsilon())
+				return false;
+
+			float inv_area = 1.0f / area;
+			a = glm::vec3(p1.y - p2.y, p2.y - p0.y, p0.y - p1.y) * inv_area;
+			b = glm::vec3(p2.x - p1.x, p0.x - p2.x, p1.x - p0.x) * inv_area;
+			origin = glm::vec2(p0.x, p0.y);
+
+			// Pixels exactly on an edge belong only to the top or left edges
+			for(int i = 0;i < 3;i++)
+				bias[i] = (a[i] > 0 || (a[i] == 0 && b[i] > 0)) ? 0 : std::numeric_limits<float>::min();
+			return true;
+		}
+
+		//! Evaluate all edge functions (barycentric coordinates) at a point
+		inline glm::vec3 evaluate(float x, float y) const {
+			return a * (x - origin.x) + b * (y - origin.y) + glm::vec3(1, 0, 0);
+		}
+
+		//! Check if the evaluated edge functions are inside the triangle
+		inline bool inside(const glm::vec3 & l) const {
+			return l.x >= bias.x && l.y >= bias.y && l.z >= bias.z;
+		}
+	};
+
 	//! Structure to hold (convex) polygon vertical limits
+	/**
+	 * Limits are tracked only for the rows of one tile, so the
+	 * storage is bound to the tile size and not the framebuffer.
+	 */
 	struct polygon_vertical_limits {
 
 		//! Type of array
-		typedef boost::array<window_size_t, thrender::max_framebuffer_height> array_type;
+		typedef boost::array<window_size_t, thrender::tile_size> array_type;
+
+		//! The first tracked row
+		window_size_t top;
+
+		//! Total tracked rows
+		window_size_t rows;
 
 		//! Leftmost limits
 		array_type leftmost;
@@ -20,10 +91,16 @@ namespace details {
 		//! Rightmost limits
 		array_type rightmost;
 
-		//! Clear limits by setting default values on them
-		void clear() {
-			thrust::fill(leftmost.begin(), leftmost.end(), std::numeric_limits<window_size_t>::max());
-			thrust::fill(rightmost.begin(), rightmost.end(), std::numeric_limits<window_size_t>::min());
+		//! Clear limits of the tracked rows by setting default values on them
+		/**
+		 * @param _top The first row to track
+		 * @param _rows The number of rows to track (at most tile_size)
+		 */
+		void clear(window_size_t _top, window_size_t _rows) {
+			top = _top;
+			rows = _rows;
+			std::fill(leftmost.begin(), leftmost.begin() + rows, std::numeric_limits<window_size_t>::max());
+			std::fill(rightmost.begin(), rightmost.begin() + rows, std::numeric_limits<window_size_t>::min());
 		}
 	};
 
@@ -36,11 +113,14 @@ namespace details {
 			limits(_limits)
 		{}
 
-		bool operator()(window_size_t x, window_size_t y) {
-			if (x < limits.leftmost[y])
-				limits.leftmost[y] = x;
-			if (x > limits.rightmost[y])
-				limits.rightmost[y] = x;
+		bool operator()(int x, int y) {
+			if (y < int(limits.top) || y >= int(limits.top + limits.rows) || x < 0)
+				return true;
+			window_size_t row = y - limits.top;
+			if (window_size_t(x) < limits.leftmost[row])
+				limits.leftmost[row] = x;
+			if (window_size_t(x) > limits.rightmost[row])
+				limits.rightmost[row] = x;
 			return true;
 		}
 	};
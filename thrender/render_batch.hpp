@@ -0,0 +1,158 @@
+#pragma once
+
+#include "./renderable.hpp"
+
+namespace thrender {
+
+	//! A list of renderable objects that are drawn together
+	/**
+	 * Vertices and elements of all objects are gathered in one
+	 * intermediate buffer, so that each stage of the pipeline runs
+	 * once, in parallel, across the whole batch. It can be passed
+	 * to all stages in place of a renderable object.
+	 *
+	 * Each object comes with its own uniforms, which shaders get
+	 * as instance data. Objects and uniforms are referenced, they
+	 * must outlive the batch.
+	 */
+	template<class RenderableType>
+	struct render_batch {
+
+		//! Type of batched objects
+		typedef RenderableType renderable_type;
+
+		//! The type of vertex
+		typedef typename renderable_type::vertex_type vertex_type;
+
+		//! The type of vertex id
+		typedef typename renderable_type::vertex_id_type vertex_id_type;
+
+		//! Vertex array type
+		typedef typename renderable_type::vertex_array_type vertex_array_type;
+
+		//! Primitive data type (triangle)
+		typedef typename renderable_type::triangle_type triangle_type;
+
+		//! Type of triangle setup
+		typedef typename renderable_type::triangle_setup_type triangle_setup_type;
+
+		//! Type of a packet of vertices, for vertex shaders that process packets
+		typedef typename renderable_type::vertex_packet_type vertex_packet_type;
+
+		//! Type of intermediate render buffer
+		typedef typename renderable_type::intermediate_buffer_type intermediate_buffer_type;
+
+		//! Construct an empty batch
+		render_batch()
+		:
+			m_is_dirty(true)
+		{}
+
+		//! Append an object to the batch
+		/**
+		 * @param object The object to be drawn
+		 * @param uniforms Data of this draw, accessed by shaders
+		 * with the instance() function of their control.
+		 */
+		template<class UniformsType>
+		void add(renderable_type & object, const UniformsType * uniforms) {
+			item_type item;
+			item.object = &object;
+			item.uniforms = uniforms;
+			item.revision = object.elements_revision();
+			m_items.push_back(item);
+			m_is_dirty = true;
+		}
+
+		//! Remove all objects
+		void clear() {
+			m_items.clear();
+			m_is_dirty = true;
+		}
+
+		//! Get the number of objects
+		inline size_t size() const {
+			return m_items.size();
+		}
+
+		//! Prepare batch for rendering
+		/**
+		 * Buffers are rebuilt only when objects are added or
+		 * removed, the elements of an object are updated, or the
+		 * arena of the context gives the batch another buffer.
+		 */
+		void prepare_for_rendering(render_context & context) {
+			bool kept = m_intermediate_buffer.acquire(context.arena);
+			intermediate_buffer_type & ib = intermediate_buffer();
+			typename items_type::iterator it;
+			for(it = m_items.begin();it != m_items.end(); it++) {
+				if (it->revision != it->object->elements_revision()) {
+					it->revision = it->object->elements_revision();
+					m_is_dirty = true;
+				}
+			}
+
+			if (!kept || m_is_dirty || ib.draws.size() != m_items.size()) {
+				ib.begin_draws();
+				for(it = m_items.begin();it != m_items.end(); it++) {
+					ib.add_draw(it->object->vertices, it->object->vertex_streams(),
+							it->object->element_indices, it->uniforms);
+				}
+				ib.end_draws();
+				m_is_dirty = false;
+			}
+			ib.clear();
+		}
+
+		//! Get the intermediate buffer of the current draw
+		/**
+		 * @see renderable::intermediate_buffer()
+		 */
+		inline intermediate_buffer_type & intermediate_buffer() {
+			return *m_intermediate_buffer;
+		}
+
+		//! Get the intermediate buffer of the current draw
+		inline const intermediate_buffer_type & intermediate_buffer() const {
+			return *m_intermediate_buffer;
+		}
+
+		//! Copy vertices of all objects to the structure of arrays layout
+		void update_vertex_streams() {
+			typename items_type::iterator it;
+			for(it = m_items.begin();it != m_items.end(); it++)
+				it->object->update_vertex_streams();
+		}
+
+	private:
+
+		//! An object of the batch
+		struct item_type {
+
+			//! The object
+			renderable_type * object;
+
+			//! Uniforms of the object
+			const void * uniforms;
+
+			//! The revision of object elements that buffers are built for
+			/**
+			 * Vertices are read from the object on every draw, so
+			 * buffers depend only on its elements.
+			 */
+			size_t revision;
+		};
+
+		//! Type of items container
+		typedef thrust::host_vector<item_type> items_type;
+
+		//! All objects of the batch
+		items_type m_items;
+
+		//! Intermediate render buffer of all objects, held from the frame arena
+		arena_buffer<intermediate_buffer_type> m_intermediate_buffer;
+
+		//! Flag if the list of objects has been changed
+		bool m_is_dirty;
+	};
+}
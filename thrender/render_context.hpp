@@ -3,7 +3,12 @@
 #include "./framebuffer_array.hpp"
 #include "./camera.hpp"
 #include "./types.hpp"
+#include "./simd.hpp"
 #include "./viewport.hpp"
+#include "./tiling.hpp"
+#include "./raster.hpp"
+#include "./triangle_setup.hpp"
+#include "./frame_arena.hpp"
 
 namespace thrender {
 
@@ -43,6 +48,11 @@ namespace thrender {
 			return z * m_half_distance + m_half_sum;
 		}
 
+		//! Translate NDC z values of a packet to window space
+		inline simd::float4 translate_to_window_space(const simd::float4 & z) const {
+			return z * simd::float4(m_half_distance) + simd::float4(m_half_sum);
+		}
+
 	private:
 
 		//! Depth buffer value for near plane
@@ -59,6 +69,12 @@ namespace thrender {
 
 	};
 
+	//! Comparison of fragment depth against the stored one
+	enum class depth_function {
+		greater_equal,	//!< Pass if not less than stored depth (default)
+		equal			//!< Pass only on equal depth, for shading after a depth pre-pass
+	};
+
 	//! Rendering context
 	/**
 	 * It holds all the needed objects and information
@@ -72,16 +88,107 @@ namespace thrender {
 		viewport vp;
 		depth_range_tk depth_range;
 
+		//! Algorithm used to scan convert triangles
+		raster_algorithm rasterizer;
+
+		//! Interpolation of vertex attributes over primitives
+		interpolation_mode interpolation;
+
+		//! Which faces are dropped before rasterization
+		cull_mode culling;
+
+		//! Depth test function
+		depth_function depth_func;
+
+		//! If true, draws of objects outside of the view frustum are skipped
+		/**
+		 * Objects are tested before vertex processing, with their
+		 * bounding box and the model matrix given to the draw. Objects
+		 * with meshlets are also culled per meshlet, against the
+		 * frustum and the face culling mode.
+		 */
+		bool object_culling;
+
+		//! Primitives binned per screen tile of the framebuffer
+		details::tile_bins bins;
+
+		//! Intermediate buffers of the draws of current frame
+		frame_arena arena;
+
 		render_context(camera & _camera, framebuffer_array & _fb) :
 			fb(_fb),
 			cam(_camera),
 			vp(0, 0, fb.width(), fb.height()),
-			depth_range(0, 1)
-		{}
+			depth_range(0, 1),
+			rasterizer(raster_algorithm::half_space),
+			interpolation(interpolation_mode::linear),
+			culling(cull_mode::none),
+			depth_func(depth_function::greater_equal),
+			object_culling(false)
+		{
+			bins.resize(fb.width(), fb.height());
+		}
 
 
 		inline camera & get_camera() {
 			return cam;
 		}
+
+		//! Release the intermediate buffers of all draws at once
+		/**
+		 * Call after the last pass of a frame, e.g. after resolving
+		 * the visibility buffer. Buffers are reused by the draws of
+		 * the next frames.
+		 */
+		void end_frame() {
+			arena.reset();
+		}
+
+		//! Check if an object may be visible and must be drawn
+		/**
+		 * @param box Bounding box of the object (Object-Space)
+		 * @param model_mat Transformation of the object to world space
+		 */
+		inline bool is_object_visible(const aabb & box, const glm::mat4 & model_mat = glm::mat4(1.0f)) const {
+			if (!object_culling)
+				return true;
+			return frustum(cam.projection_mat * cam.view_mat * model_mat).intersects(box);
+		}
+
+		//! Translate clip coordinates to window space
+		/**
+		 * The w component is replaced by 1/w of clip space, which
+		 * is needed for perspective correct interpolation.
+		 */
+		template<class V>
+		inline void translate_to_window_space(V & pos) const {
+
+			// normalized device coordinates
+			float inv_w = 1.0f / pos.w;
+			pos = pos * inv_w;
+			pos.w = inv_w;
+
+			// window space
+			pos.x = vp.left() + (pos.x * vp.half_width()) + vp.half_width();
+			pos.y = vp.top() + (pos.y * vp.half_height()) + vp.half_height();
+			pos.z = depth_range.translate_to_window_space(pos.z);
+		}
+
+		//! Translate clip coordinates of a packet to window space
+		/**
+		 * Operations are the same as for a single position, so
+		 * that a vertex lands on the same window space position
+		 * on both paths.
+		 */
+		inline void translate_to_window_space(simd::soa<glm::vec4> & pos) const {
+			simd::float4 inv_w = simd::float4(1.0f) / pos.c[3];
+			simd::float4 half_width(float(vp.half_width()));
+			simd::float4 half_height(float(vp.half_height()));
+
+			pos.c[0] = simd::float4(float(vp.left())) + (pos.c[0] * inv_w * half_width) + half_width;
+			pos.c[1] = simd::float4(float(vp.top())) + (pos.c[1] * inv_w * half_height) + half_height;
+			pos.c[2] = depth_range.translate_to_window_space(pos.c[2] * inv_w);
+			pos.c[3] = inv_w;
+		}
 	};
 }
@@ -1,12 +1,61 @@
 #pragma once
 
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
 #include "./vertex_array.hpp"
 #include "./triangle.hpp"
+#include "./triangle_setup.hpp"
+#include "./bounds.hpp"
+#include "./meshlet.hpp"
+#include "./render_context.hpp"
+#include "./frame_arena.hpp"
 
 namespace thrender{
 
 namespace details {
 
+	//! A range of ids whose data have changed
+	struct dirty_range {
+
+		//! The first id of the range
+		size_t first;
+
+		//! The id after the last one of the range
+		size_t last;
+
+		//! Construct an empty range
+		dirty_range()
+		:
+			first(0),
+			last(0)
+		{}
+
+		//! Check if range is empty
+		inline bool empty() const {
+			return first >= last;
+		}
+
+		//! Extend range to include another one
+		void extend(size_t _first, size_t _last) {
+			if (_first >= _last)
+				return;
+			if (empty()) {
+				first = _first;
+				last = _last;
+			} else {
+				first = std::min(first, _first);
+				last = std::max(last, _last);
+			}
+		}
+
+		//! Make range empty
+		inline void clear() {
+			first = last = 0;
+		}
+	};
+
 	//! Buffer needed per vertex for intermediate processing
 	template<class VertexArrayType, class PrimitiveType>
 	struct rendable_intermediate_buffer {
@@ -14,62 +63,450 @@ namespace details {
 		//! Type of vertex_array object
 		typedef VertexArrayType vertex_array_type;
 
+		//! Type of vertex
+		typedef typename vertex_array_type::vertex_type vertex_type;
+
+		//! Type of input vertices container
+		typedef typename vertex_array_type::vertices_type vertices_type;
+
+		//! Type of input vertices in structure of arrays layout
+		typedef typename vertex_array_type::soa_vertices_type soa_vertices_type;
+
+		//! Type of element indices container
+		typedef thrust::host_vector<indices3_t> indices_type;
+
 		//! Type of discarded vertices
 		typedef thrust::host_vector<bool> discarded_vertices_type;
 
+		//! Type of clip space positions
+		typedef thrust::host_vector<glm::vec4> clip_positions_type;
+
+		//! Type of clip codes
+		typedef thrust::host_vector<clip_code_t> clip_codes_type;
+
 		//! Type of primitive
 		typedef PrimitiveType primitive_type;
 
 		//! Type of elements container
 		typedef thrust::host_vector< primitive_type > elements_type;
 
-		//! A vector with all processed vertices
-		typename vertex_array_type::vertices_type processed_vertices;
+		//! Type of triangle setup
+		typedef triangle_setup<typename primitive_type::vertex_type> setup_type;
+
+		//! Type of triangle setups container
+		typedef thrust::host_vector< setup_type > setups_type;
+
+		//! Type of triangle bounds container
+		typedef thrust::host_vector< triangle_bounds > setup_bounds_type;
+
+		//! Type of setup states container
+		typedef thrust::host_vector< setup_state > setup_states_type;
+
+		//! Type of container with ids of elements
+		typedef thrust::host_vector< primitive_id_t > element_ids_type;
+
+		//! Range of processed vertices and elements drawn from one source
+		struct draw_range {
+
+			//! Input vertices of the source
+			const vertices_type * vertices;
+
+			//! Input vertices of the source in structure of arrays layout
+			/**
+			 * Empty if the source does not keep them, packets are
+			 * then gathered from the vertices.
+			 */
+			const soa_vertices_type * vertex_streams;
+
+			//! Element indices of the source
+			const indices_type * indices;
+
+			//! Data of the draw, given to shaders as instance data
+			const void * uniforms;
+
+			//! Id of the first processed vertex of the range
+			/**
+			 * It is always the first vertex of a packet.
+			 */
+			size_t first_vertex;
+
+			//! Id of the first element of the range
+			size_t first_element;
+
+			//! Id of the first packet of vertices of the range
+			size_t first_packet;
+		};
+
+		//! Type of draw ranges container
+		typedef thrust::host_vector< draw_range > draws_type;
+
+		//! Type of container with the draw of each packet or element
+		typedef thrust::host_vector< draw_id_t > draw_ids_type;
+
+		//! All processed vertices, in structure of arrays layout
+		/**
+		 * Vertex shaders write their output attributes here, packet
+		 * shaders with one aligned store per component. Draws start
+		 * on a whole packet, so no packet spans two draws and ids
+		 * between draws are padding that no element references.
+		 */
+		soa_vertices_type processed_vertices;
 
 		//! A bitmap with all discarded vertices
 		discarded_vertices_type discarded_vertices;
 
-		//! A vector with all mesh elements of projected vectors
+		//! Clip space position of all processed vertices
+		clip_positions_type clip_positions;
+
+		//! Clip code of all processed vertices
+		clip_codes_type clip_codes;
+
+		//! The elements of all draws, indexing processed vertices
 		elements_type elements;
 
+		//! Vertices generated by clipping in current frame
+		typename vertex_array_type::vertices_type clipped_vertices;
+
+		//! Elements generated by clipping in current frame
+		/**
+		 * Their ids follow the ids of elements and they index
+		 * clipped vertices.
+		 */
+		elements_type clipped_elements;
+
+		//! The id of the element that each clipped element comes from
+		element_ids_type clipped_origins;
+
+		//! Ids of elements that cross a clip plane in current frame
+		element_ids_type clipped_sources;
+
+		//! The setup of each element, computed by the primitive processor
+		setups_type setups;
+
+		//! The bounds of each element, computed along with its setup
+		setup_bounds_type setup_bounds;
+
+		//! The state of each element after setup
+		/**
+		 * Kept apart from setups, as it is all that compaction
+		 * and binning read for rejected elements.
+		 */
+		setup_states_type setup_states;
+
+		//! Ids of elements that survived setup, in submission order
+		element_ids_type visible_elements;
+
+		//! Flag per meshlet that passed culling in current frame
+		thrust::host_vector<unsigned char> meshlet_visible;
+
+		//! The visibility buffer id of the first element
+		visibility_pixel_t visibility_base;
+
+		//! Bit mask of the attributes whose planes are setup
+		/**
+		 * Fragment controls check it on debug builds.
+		 */
+		size_t interpolated_attributes;
+
+		//! The draws that buffers are built for, in submission order
+		/**
+		 * Vertices and elements of each draw follow those of the
+		 * previous one, so that every stage processes all draws
+		 * at once. Draws are instances of one object, or the
+		 * objects of a batch.
+		 */
+		draws_type draws;
+
+		//! The draw of each packet of vertices
+		/**
+		 * Built only when there is more than one draw, so that
+		 * stages get the draw of a packet without a search.
+		 */
+		draw_ids_type packet_draws;
+
+		//! The draw of each element, built along with packet_draws
+		draw_ids_type element_draws;
+
+		//! Number of packets of vertices of all draws
+		size_t total_packets;
+
+		//! Construct empty buffers
+		rendable_intermediate_buffer()
+		:
+			visibility_base(default_visibility_clear_value),
+			interpolated_attributes(0),
+			total_packets(0),
+			m_total_vertices(0),
+			m_total_elements(0)
+		{}
+
+		//! Copying gives empty buffers
+		/**
+		 * Draws point to the sources they are built for, which are
+		 * not those of a copied object. The copy has no draws and
+		 * is rebuilt before it is rendered.
+		 */
+		rendable_intermediate_buffer(const rendable_intermediate_buffer &)
+		:
+			visibility_base(default_visibility_clear_value),
+			interpolated_attributes(0),
+			total_packets(0),
+			m_total_vertices(0),
+			m_total_elements(0)
+		{}
+
+		//! Assignment drops the draws, like copying
+		rendable_intermediate_buffer & operator=(const rendable_intermediate_buffer &) {
+			begin_draws();
+			return *this;
+		}
+
 		//! Clear and prepare intermediate buffer for rendering.
-		void clear(size_t vertices_sz, size_t elements_sz) {
-			processed_vertices.resize(vertices_sz);
-			discarded_vertices.resize(vertices_sz, false);
-			thrust::fill(discarded_vertices.begin(), discarded_vertices.end(), false);
+		/**
+		 * Discarded flags are not reset here, as the vertex
+		 * processor writes the flag of every vertex.
+		 */
+		void clear() {
+			processed_vertices.resize(m_total_vertices);
+			discarded_vertices.resize(m_total_vertices, false);
+			clip_positions.resize(m_total_vertices);
+			clip_codes.resize(m_total_vertices, 0);
+		}
+
+		//! Free the memory beyond the current size of all buffers
+		/**
+		 * Called by the frame arena on buffers that changed owner,
+		 * so that capacity does not outlive the object it grew for.
+		 */
+		void shrink_to_fit() {
+			processed_vertices.shrink_to_fit();
+			discarded_vertices.shrink_to_fit();
+			clip_positions.shrink_to_fit();
+			clip_codes.shrink_to_fit();
+			elements.shrink_to_fit();
+			clipped_vertices.shrink_to_fit();
+			clipped_elements.shrink_to_fit();
+			clipped_origins.shrink_to_fit();
+			clipped_sources.shrink_to_fit();
+			setups.shrink_to_fit();
+			setup_bounds.shrink_to_fit();
+			setup_states.shrink_to_fit();
+			visible_elements.shrink_to_fit();
+			meshlet_visible.shrink_to_fit();
+			draws.shrink_to_fit();
+			packet_draws.shrink_to_fit();
+			element_draws.shrink_to_fit();
+		}
+
+		//! Get the number of processed vertices of all draws
+		/**
+		 * It includes the padding of draws to whole packets.
+		 */
+		inline size_t total_vertices() const {
+			return m_total_vertices;
 		}
 
-		void rebuild(size_t vertices_sz , thrust::host_vector<indices3_t> & itriangles) {
-			processed_vertices.resize(vertices_sz);
-			discarded_vertices.resize(vertices_sz);
-			elements.clear();
+		//! Get an element or a clipped element by its id
+		inline const primitive_type & element(primitive_id_t id) const {
+			if (id < elements.size())
+				return elements[id];
+			return clipped_elements[id - elements.size()];
+		}
+
+		//! Get the window space position of a vertex of an element or a clipped element
+		/**
+		 * @param index The index of the 3 vertices (zero based)
+		 */
+		inline glm::vec4 element_position(primitive_id_t id, size_t index) const {
+			if (id < elements.size())
+				return processed_vertices.template attribute<POSITION>(elements[id].indices[index]);
+			return VA_ATTRIBUTE(clipped_vertices[clipped_elements[id - elements.size()].indices[index]], POSITION);
+		}
+
+		//! Get the draw that a processed vertex belongs to
+		inline size_t draw_of_vertex(size_t vertex_id) const {
+			return draw_of_packet(packet_of_vertex(vertex_id));
+		}
+
+		//! Get the draw that an element or a clipped element belongs to
+		inline size_t draw_of_element(primitive_id_t id) const {
+			if (element_draws.empty())
+				return 0;
+			if (id >= elements.size())
+				id = clipped_origins[id - elements.size()];
+			return element_draws[id];
+		}
+
+		//! Get the draw that a packet of vertices belongs to
+		inline size_t draw_of_packet(size_t packet) const {
+			return packet_draws.empty() ? 0 : packet_draws[packet];
+		}
+
+		//! Get the packet that a processed vertex belongs to
+		inline size_t packet_of_vertex(size_t vertex_id) const {
+			return vertex_id / soa_vertices_type::lanes;
+		}
+
+		//! Get the id after the last vertex of a packet
+		/**
+		 * It includes the padding of the last packet of a draw.
+		 */
+		inline size_t packet_end(size_t packet) const {
+			return (packet + 1) * soa_vertices_type::lanes;
+		}
+
+		//! Get the data of a draw
+		template<class InstanceType>
+		inline const InstanceType & instance(size_t draw_id) const {
+			return *static_cast<const InstanceType *>(draws[draw_id].uniforms);
+		}
+
+		//! Point the data of each draw to an element of an array
+		/**
+		 * @param instance_data The array, or 0 to clear data of all draws
+		 * @param stride Size of each element
+		 */
+		void set_instance_data(const void * instance_data, size_t stride) {
+			for(size_t i = 0;i < draws.size();i++)
+				draws[i].uniforms = instance_data ? static_cast<const char *>(instance_data) + i * stride : 0;
+		}
+
+		//! Start building buffers for a new list of draws
+		void begin_draws() {
+			draws.clear();
+			packet_draws.clear();
+			element_draws.clear();
+			total_packets = 0;
+			m_total_vertices = 0;
+			m_total_elements = 0;
+		}
+
+		//! Append a draw of a source
+		/**
+		 * Sources must outlive the buffers built for them.
+		 * @throw std::length_error If the total vertices of all draws
+		 * can not be indexed by vertex_index_t
+		 */
+		void add_draw(const vertices_type & vertices, const soa_vertices_type & vertex_streams,
+				const indices_type & indices, const void * uniforms) {
+			draw_range range;
+			range.vertices = &vertices;
+			range.vertex_streams = &vertex_streams;
+			range.indices = &indices;
+			range.uniforms = uniforms;
+			size_t packets = (vertices.size() + soa_vertices_type::lanes - 1) / soa_vertices_type::lanes;
+			if ((total_packets + packets) * soa_vertices_type::lanes > size_t(std::numeric_limits<vertex_index_t>::max()) + 1)
+				throw std::length_error("Total vertices of draws exceed the range of vertex indices");
 
-			thrust::host_vector<indices3_t>::iterator it_index;
-			for(it_index = itriangles.begin();it_index != itriangles.end(); it_index++) {
-				indices3_t & indices = *it_index;
-				elements.push_back( primitive_type(processed_vertices, indices, false) );
+			range.first_vertex = total_packets * soa_vertices_type::lanes;
+			range.first_element = m_total_elements;
+			range.first_packet = total_packets;
+			draws.push_back(range);
+
+			total_packets += packets;
+			m_total_vertices = total_packets * soa_vertices_type::lanes;
+			m_total_elements += indices.size();
+		}
+
+		//! Allocate buffers and build the elements of all draws
+		void end_draws() {
+			clear();
+			elements.resize(m_total_elements);
+
+			typename draws_type::const_iterator it_draw;
+			for(it_draw = draws.begin();it_draw != draws.end(); it_draw++) {
+				indices3_t offset(vertex_index_t(it_draw->first_vertex));
+				for(size_t e = 0;e < it_draw->indices->size();e++)
+					elements[it_draw->first_element + e].indices = (*it_draw->indices)[e] + offset;
+			}
+			setups.resize(elements.size());
+			setup_bounds.resize(elements.size());
+			setup_states.resize(elements.size());
+			visible_elements.reserve(elements.size());
+
+			if (draws.size() > 1) {
+				packet_draws.resize(total_packets);
+				element_draws.resize(elements.size());
+				for(size_t d = 0;d < draws.size();d++) {
+					size_t packets = (d + 1 < draws.size() ? draws[d + 1].first_packet : total_packets) - draws[d].first_packet;
+					std::fill_n(packet_draws.begin() + draws[d].first_packet, packets, draw_id_t(d));
+					std::fill_n(element_draws.begin() + draws[d].first_element, draws[d].indices->size(), draw_id_t(d));
+				}
+			}
+		}
+
+		//! Rebuild a range of the elements of all draws of a source
+		/**
+		 * The number of indices of the source must be the same
+		 * as when buffers were built.
+		 * @param first The first changed index of the source
+		 * @param last The index after the last changed one
+		 */
+		void update_elements(const indices_type & indices, size_t first, size_t last) {
+			last = std::min(last, indices.size());
+			typename draws_type::const_iterator it_draw;
+			for(it_draw = draws.begin();it_draw != draws.end(); it_draw++) {
+				if (it_draw->indices != &indices)
+					continue;
+				indices3_t offset(vertex_index_t(it_draw->first_vertex));
+				for(size_t e = first;e < last;e++)
+					elements[it_draw->first_element + e].indices = indices[e] + offset;
 			}
 		}
+
+	private:
+
+		//! Number of processed vertices of all draws, padded to whole packets
+		size_t m_total_vertices;
+
+		//! Number of elements of all draws
+		size_t m_total_elements;
 	};
 }; //! details
 
-	template<class VertexAttributesTuple>
+	//! An object made of triangles
+	/**
+	 * @param VertexAttributesTuple A thrust::tuple<> that holds
+	 * all attributes per vertex.
+	 * @param VertexIdType Unsigned integer type for the ids of
+	 * processed vertices. It must be at least as wide as the indices
+	 * of elements (vertex_index_t), which limit the total vertices of
+	 * all instances drawn at once.
+	 */
+	template<class VertexAttributesTuple, class VertexIdType = vertex_id_t>
 	struct renderable {
 
+		static_assert(std::is_integral<VertexIdType>::value && std::is_unsigned<VertexIdType>::value,
+				"vertex id must be an unsigned integer");
+		static_assert(sizeof(VertexIdType) >= sizeof(vertex_index_t),
+				"vertex id must hold any vertex index of elements");
+
 		//! The type of vertex
 		typedef VertexAttributesTuple vertex_type;
 
+		//! The type of vertex id
+		typedef VertexIdType vertex_id_type;
+
 		//! Vertex array type
 		typedef vertex_array<vertex_type> vertex_array_type;
 
 		//! Primitive data type (triangle)
 		typedef triangle<vertex_type> triangle_type;
 
+		//! Type of triangle setup
+		typedef triangle_setup<vertex_type> triangle_setup_type;
+
+		//! Type of a packet of vertices, for vertex shaders that process packets
+		typedef typename vertex_array_type::packet_type vertex_packet_type;
+
+		//! Type of vertices in structure of arrays layout
+		typedef typename vertex_array_type::soa_vertices_type soa_vertices_type;
+
 		//! All vertices packed together
 		typename vertex_array_type::vertices_type vertices;
 
-		// Intermediate render buffer
-		details::rendable_intermediate_buffer< vertex_array_type, triangle_type> intermediate_buffer;
+		//! Type of intermediate render buffer
+		typedef details::rendable_intermediate_buffer< vertex_array_type, triangle_type> intermediate_buffer_type;
 
 		//! Indices of vertices per element
 		thrust::host_vector<indices3_t> element_indices;
@@ -84,31 +521,340 @@ namespace details {
 		:
 			vertices(vertices_sz),
 			element_indices(elements_sz),
-			m_is_dirty(true)
+			m_is_dirty(true),
+			m_revision(1),
+			m_elements_revision(1),
+			m_keep_vertex_streams(false),
+			m_vertex_streams_revision(0),
+			m_bounds_revision(0),
+			m_meshlets_revision(0)
 		{}
 
 		//! Prepare object for rendering
 		/**
 		 * @brief This function is called by rendering
 		 * pipeline every time before object gets rendered
+		 * The intermediate buffer is acquired from the arena of the
+		 * context. Buffers are rebuilt if it is not the one that the
+		 * object held before.
+		 * @param instances Number of instances that will be rendered,
+		 * buffers are rebuilt when it changes.
 		 */
-		void prepare_for_rendering() {
-			if(m_is_dirty) {
-				intermediate_buffer.rebuild(vertices.size(), element_indices);
+		void prepare_for_rendering(render_context & context, size_t instances = 1) {
+			bool kept = m_intermediate_buffer.acquire(context.arena);
+			intermediate_buffer_type & ib = intermediate_buffer();
+			if(!kept || m_is_dirty || ib.draws.size() != instances) {
+				ib.begin_draws();
+				for(size_t i = 0;i < instances;i++)
+					ib.add_draw(vertices, m_vertex_streams, element_indices, 0);
+				ib.end_draws();
 				m_is_dirty = false;
+			} else if (!m_dirty_elements.empty()) {
+				ib.update_elements(element_indices, m_dirty_elements.first, m_dirty_elements.last);
 			}
-			intermediate_buffer.clear(vertices.size(), element_indices.size());
+			m_dirty_elements.clear();
+			ib.set_instance_data(0, 0);
+			ib.clear();
+		}
+
+		//! Prepare object for rendering many instances
+		/**
+		 * @param instance_data Array with the data of each instance
+		 * @param instances Number of instances
+		 */
+		template<class InstanceType>
+		void prepare_for_rendering(render_context & context, const InstanceType * instance_data, size_t instances) {
+			prepare_for_rendering(context, instances);
+			intermediate_buffer().set_instance_data(instance_data, sizeof(InstanceType));
+		}
+
+		//! Get the intermediate buffer of the current draw
+		/**
+		 * Valid after prepare_for_rendering(), until the frame of
+		 * the context ends.
+		 */
+		inline intermediate_buffer_type & intermediate_buffer() {
+			return *m_intermediate_buffer;
+		}
+
+		//! Get the intermediate buffer of the current draw
+		inline const intermediate_buffer_type & intermediate_buffer() const {
+			return *m_intermediate_buffer;
+		}
+
+		//! Give up the intermediate buffer, when object is not drawn
+		/**
+		 * Stages that run later in the frame, like resolving the
+		 * visibility buffer, skip the object.
+		 */
+		inline void release_intermediate_buffer() {
+			m_intermediate_buffer.release();
+		}
+
+		//! Check if object holds an intermediate buffer
+		inline bool has_intermediate_buffer() const {
+			return m_intermediate_buffer.is_acquired();
 		}
 
 		//! Mark object's data as changed
+		/**
+		 * All buffers and cached data of the object are rebuilt. It
+		 * is needed when the number of vertices or elements changes.
+		 */
 		void data_updated() {
 			m_is_dirty = true;
+			m_revision++;
+			m_elements_revision++;
+			m_dirty_vertices.clear();
+			m_dirty_elements.clear();
+		}
+
+		//! Mark a range of vertices as changed
+		/**
+		 * Meant for small edits of big objects, only the changed
+		 * range is copied to the structure of arrays layout and only
+		 * the meshlets that hold it recalculate their bounds. Bounds
+		 * of the object are recalculated when they are next needed.
+		 * Vertices are still processed and elements set up for the
+		 * whole object on every draw, as they depend on the transforms
+		 * of the frame. The number of vertices must not change.
+		 * @param first The id of the first changed vertex
+		 * @param count Number of changed vertices
+		 */
+		void vertices_updated(size_t first, size_t count) {
+			bool streams_valid = m_vertex_streams_revision == m_revision;
+			bool meshlets_valid = has_meshlets();
+			m_revision++;
+
+			if (streams_valid) {
+				m_dirty_vertices.extend(first, first + count);
+				m_vertex_streams_revision = m_revision;
+			}
+			if (meshlets_valid) {
+				update_meshlets(first, std::min(first + count, size_t(vertices.size())), 0, 0);
+				m_meshlets_revision = m_revision;
+			}
+		}
+
+		//! Mark a range of element indices as changed
+		/**
+		 * Only the changed elements are rebuilt in the intermediate
+		 * buffer, bounds and vertex streams are kept. Meshlets are
+		 * kept too, with the normal cones of the changed ones
+		 * recalculated, unless a changed element references vertices
+		 * out of its meshlet. The number of elements must not change.
+		 * @param first The first changed element
+		 * @param count Number of changed elements
+		 */
+		void elements_updated(size_t first, size_t count) {
+			bool streams_valid = m_vertex_streams_revision == m_revision;
+			bool bounds_valid = m_bounds_revision == m_revision;
+			bool meshlets_valid = has_meshlets();
+			m_revision++;
+			m_elements_revision++;
+
+			m_dirty_elements.extend(first, first + count);
+			if (streams_valid)
+				m_vertex_streams_revision = m_revision;
+			if (bounds_valid)
+				m_bounds_revision = m_revision;
+			if (meshlets_valid && update_meshlets(0, 0, first, std::min(first + count, size_t(element_indices.size()))))
+				m_meshlets_revision = m_revision;
+		}
+
+		//! Get the revision of object's data, it changes on every update
+		inline size_t revision() const {
+			return m_revision;
+		}
+
+		//! Get the revision of element indices
+		/**
+		 * It changes on data_updated() and elements_updated() only.
+		 */
+		inline size_t elements_revision() const {
+			return m_elements_revision;
+		}
+
+		//! Keep a copy of vertices in structure of arrays layout
+		/**
+		 * Vertex shaders that process packets load them from the copy
+		 * with one aligned load per component, instead of gathering
+		 * them from vertices. The copy doubles the memory of vertices,
+		 * so it is off by default. It pays off for objects that are
+		 * drawn many times per update of their vertices.
+		 */
+		void keep_vertex_streams(bool keep) {
+			m_keep_vertex_streams = keep;
+			if (!keep) {
+				m_vertex_streams = soa_vertices_type();
+				m_vertex_streams_revision = 0;
+				m_dirty_vertices.clear();
+			}
+		}
+
+		//! Check if object keeps a copy of vertices in structure of arrays layout
+		inline bool keeps_vertex_streams() const {
+			return m_keep_vertex_streams;
+		}
+
+		//! Copy vertices to the structure of arrays layout, if they have changed
+		/**
+		 * Needed only by vertex shaders that process packets of
+		 * vertices, and only if object keeps vertex streams.
+		 */
+		void update_vertex_streams() {
+			if (!m_keep_vertex_streams)
+				return;
+			if (m_vertex_streams_revision != m_revision) {
+				m_vertex_streams.assign(vertices);
+				m_vertex_streams_revision = m_revision;
+			} else if (!m_dirty_vertices.empty()) {
+				m_vertex_streams.update(vertices, m_dirty_vertices.first,
+						std::min(m_dirty_vertices.last, size_t(vertices.size())));
+			}
+			m_dirty_vertices.clear();
+		}
+
+		//! Get vertices in structure of arrays layout
+		/**
+		 * Empty unless object keeps vertex streams.
+		 */
+		inline const soa_vertices_type & vertex_streams() const {
+			return m_vertex_streams;
+		}
+
+		//! Get the bounding box of vertex positions (Object-Space)
+		/**
+		 * It is cached and recalculated after data_updated() or
+		 * vertices_updated().
+		 */
+		const aabb & bounding_box() const {
+			update_bounds();
+			return m_bounding_box;
+		}
+
+		//! Get the bounding sphere of vertex positions (Object-Space)
+		/**
+		 * It is centered on the bounding box and it is cached as well.
+		 */
+		const sphere & bounding_sphere() const {
+			update_bounds();
+			return m_bounding_sphere;
+		}
+
+		//! Set the meshlets that vertices and elements are clustered in
+		/**
+		 * They are valid for the current data. Partial updates keep
+		 * them, data_updated() drops them.
+		 * @see utils::build_meshlets()
+		 */
+		void set_meshlets(const meshlets_type & _meshlets) {
+			m_meshlets = _meshlets;
+			m_meshlets_revision = m_revision;
+		}
+
+		//! Check if object has meshlets that are valid for its data
+		inline bool has_meshlets() const {
+			return !m_meshlets.empty() && m_meshlets_revision == m_revision;
+		}
+
+		//! Get the meshlets of object
+		inline const meshlets_type & meshlets() const {
+			return m_meshlets;
 		}
 
 	private:
 
+		//! Intermediate render buffer, held from the frame arena
+		arena_buffer<intermediate_buffer_type> m_intermediate_buffer;
+
 		//! Flag if object data has been changed
 		bool m_is_dirty;
 
+		//! Revision of object data
+		size_t m_revision;
+
+		//! Revision of element indices
+		size_t m_elements_revision;
+
+		//! Vertices changed since vertex streams were updated
+		details::dirty_range m_dirty_vertices;
+
+		//! Elements changed since the intermediate buffer was updated
+		details::dirty_range m_dirty_elements;
+
+		//! Flag if vertices are kept in structure of arrays layout too
+		bool m_keep_vertex_streams;
+
+		//! Vertices in structure of arrays layout
+		soa_vertices_type m_vertex_streams;
+
+		//! The revision of data that m_vertex_streams holds
+		size_t m_vertex_streams_revision;
+
+		//! Cached bounding box
+		mutable aabb m_bounding_box;
+
+		//! Cached bounding sphere
+		mutable sphere m_bounding_sphere;
+
+		//! The revision of data that bounds were calculated for
+		mutable size_t m_bounds_revision;
+
+		//! Meshlets of object
+		meshlets_type m_meshlets;
+
+		//! The revision of data that meshlets were built for
+		size_t m_meshlets_revision;
+
+		//! Recalculate bounds, if data have changed
+		void update_bounds() const {
+			if (m_bounds_revision == m_revision)
+				return;
+
+			m_bounding_box = aabb();
+			typename vertex_array_type::vertices_type::const_iterator it;
+			for(it = vertices.begin();it != vertices.end(); it++)
+				m_bounding_box.extend(glm::vec3(VA_ATTRIBUTE(*it, POSITION)));
+
+			m_bounding_sphere = sphere();
+			if (!m_bounding_box.empty()) {
+				m_bounding_sphere.center = m_bounding_box.center();
+				m_bounding_sphere.radius = 0;
+				for(it = vertices.begin();it != vertices.end(); it++) {
+					m_bounding_sphere.radius = std::max(m_bounding_sphere.radius,
+							glm::length(glm::vec3(VA_ATTRIBUTE(*it, POSITION)) - m_bounding_sphere.center));
+				}
+			}
+			m_bounds_revision = m_revision;
+		}
+
+		//! Recalculate the meshlets that hold changed vertices or elements
+		/**
+		 * @return False if a changed element is not in a meshlet or
+		 * references vertices out of its meshlet
+		 */
+		bool update_meshlets(size_t first_vertex, size_t last_vertex, size_t first_element, size_t last_element) {
+			size_t covered = 0;
+			for(size_t i = 0;i < m_meshlets.size();i++) {
+				meshlet & m = m_meshlets[i];
+				size_t vertex_end = m.first_vertex + m.vertex_count;
+				size_t element_begin = std::max(first_element, size_t(m.first_element));
+				size_t element_end = std::min(last_element, size_t(m.first_element + m.element_count));
+				for(size_t e = element_begin;e < element_end;e++) {
+					for(size_t k = 0;k < 3;k++) {
+						if (element_indices[e][k] < m.first_vertex || element_indices[e][k] >= vertex_end)
+							return false;
+					}
+				}
+				bool changed = element_begin < element_end;
+				if (changed)
+					covered += element_end - element_begin;
+				if (changed || (first_vertex < vertex_end && m.first_vertex < last_vertex))
+					calculate_meshlet_bounds(*this, m);
+			}
+			return covered == last_element - first_element;
+		}
+
 	};
 }
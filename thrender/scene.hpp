@@ -0,0 +1,475 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <thrust/host_vector.h>
+#include <thrust/for_each.h>
+#include <thrust/copy.h>
+#include <thrust/fill.h>
+#include <thrust/iterator/counting_iterator.h>
+#include "./types.hpp"
+#include "./bounds.hpp"
+#include "./render_batch.hpp"
+#include "./shaders.hpp"
+
+namespace thrender {
+namespace details {
+
+	//! Node of a bounding volume hierarchy
+	/**
+	 * Nodes are stored in depth first order. The left child of an
+	 * inner node follows it, the right child is at right_child.
+	 * Children are always after their parent.
+	 */
+	struct bvh_node {
+
+		//! Bounds of all objects under node (World-Space)
+		aabb box;
+
+		//! Index of the right child, for inner nodes
+		boost::uint32_t right_child;
+
+		//! First entry in the ordered objects, for leaves
+		boost::uint32_t first;
+
+		//! Number of objects, zero for inner nodes
+		boost::uint32_t count;
+
+		//! Check if node is a leaf
+		inline bool is_leaf() const {
+			return count > 0;
+		}
+	};
+
+	//! Type of a list of nodes
+	typedef thrust::host_vector<bvh_node> bvh_nodes_type;
+
+	//! Traverse subtrees of the hierarchy and flag visible objects
+	struct scene_cull_kernel {
+
+		//! Nodes of hierarchy
+		const bvh_node * nodes;
+
+		//! Object ids ordered by leaves
+		const boost::uint32_t * order;
+
+		//! Bounds of each object (World-Space)
+		const aabb * boxes;
+
+		//! Visibility flag per object
+		unsigned char * visible;
+
+		//! Frustum to test with (World-Space)
+		const frustum & view;
+
+		//! Construct kernel
+		scene_cull_kernel(const bvh_node * _nodes, const boost::uint32_t * _order, const aabb * _boxes, unsigned char * _visible, const frustum & _view)
+		:
+			nodes(_nodes),
+			order(_order),
+			boxes(_boxes),
+			visible(_visible),
+			view(_view)
+		{}
+
+		//! Flag all objects under a node as visible
+		void accept(boost::uint32_t node_id) const {
+			// Leaves of a subtree cover a contiguous range of order
+			boost::uint32_t first = node_id, last = node_id;
+			while(!nodes[first].is_leaf())
+				first++;
+			while(!nodes[last].is_leaf())
+				last = nodes[last].right_child;
+			for(boost::uint32_t i = nodes[first].first;i < nodes[last].first + nodes[last].count;i++)
+				visible[order[i]] = 1;
+		}
+
+		//! Traverse the subtree of a node
+		void operator()(boost::uint32_t root) const {
+			boost::uint32_t stack[64];
+			size_t depth = 0;
+			stack[depth++] = root;
+			while(depth) {
+				boost::uint32_t node_id = stack[--depth];
+				const bvh_node & node = nodes[node_id];
+				if (!view.intersects(node.box))
+					continue;
+
+				if (node.is_leaf()) {
+					for(boost::uint32_t i = node.first;i < node.first + node.count;i++)
+						visible[order[i]] = view.intersects(boxes[order[i]]);
+				} else if (view.contains(node.box)) {
+					accept(node_id);
+				} else {
+					stack[depth++] = node.right_child;
+					stack[depth++] = node_id + 1;
+				}
+			}
+		}
+	};
+}
+
+	//! A collection of objects, placed in world with a model matrix
+	/**
+	 * Objects are kept in a bounding volume hierarchy of their world
+	 * space bounds, so that culling a large scene visits only the
+	 * branches that intersect the view frustum. The hierarchy is
+	 * rebuilt when objects are added, and refitted when objects move
+	 * or their data is updated.
+	 *
+	 * Moved and updated objects are kept in a dirty list, so that
+	 * culling only recalculates their bounds. Changes of object data
+	 * must be reported with object_updated().
+	 *
+	 * Objects are referenced, they must outlive the scene.
+	 */
+	template<class RenderableType>
+	struct scene {
+
+		//! Type of objects
+		typedef RenderableType renderable_type;
+
+		//! Type of a list of object ids
+		typedef thrust::host_vector<size_t> object_ids_type;
+
+		//! Maximum objects per leaf of hierarchy
+		static const size_t leaf_size = 4;
+
+		//! Minimum subtrees to traverse in parallel
+		static const size_t parallel_subtrees = 64;
+
+		//! Construct an empty scene
+		scene()
+		:
+			m_needs_rebuild(false),
+			m_needs_refit(false)
+		{}
+
+		//! Add an object to the scene
+		/**
+		 * @return The id of object in the scene
+		 */
+		size_t add(renderable_type & object, const glm::mat4 & model_mat) {
+			item_type item;
+			item.object = &object;
+			item.is_dirty = false;
+			m_items.push_back(item);
+			shaders::instance_transform transform;
+			transform.model_mat = model_mat;
+			m_transforms.push_back(transform);
+			m_boxes.push_back(aabb());
+			m_users[&object].push_back(m_items.size() - 1);
+			mark_dirty(m_items.size() - 1);
+			m_needs_rebuild = true;
+			return m_items.size() - 1;
+		}
+
+		//! Remove all objects
+		void clear() {
+			m_items.clear();
+			m_transforms.clear();
+			m_boxes.clear();
+			m_nodes.clear();
+			m_order.clear();
+			m_dirty.clear();
+			m_users.clear();
+			m_needs_rebuild = true;
+		}
+
+		//! Get the number of objects
+		inline size_t size() const {
+			return m_items.size();
+		}
+
+		//! Get an object by id
+		inline renderable_type & object(size_t id) const {
+			return *m_items[id].object;
+		}
+
+		//! Get the model matrix of an object
+		inline const glm::mat4 & transform(size_t id) const {
+			return m_transforms[id].model_mat;
+		}
+
+		//! Move an object in the world
+		/**
+		 * Hierarchy is refitted on the next cull.
+		 */
+		void set_transform(size_t id, const glm::mat4 & model_mat) {
+			m_transforms[id].model_mat = model_mat;
+			mark_dirty(id);
+		}
+
+		//! Report that the data of an object changed
+		/**
+		 * Bounds of every placement of the object are recalculated,
+		 * and the hierarchy refitted, on the next cull.
+		 */
+		void object_updated(const renderable_type & object) {
+			typename users_type::const_iterator it = m_users.find(&object);
+			if (it == m_users.end())
+				return;
+			for(size_t i = 0;i < it->second.size();i++)
+				mark_dirty(it->second[i]);
+		}
+
+		//! Get the bounds of whole scene (World-Space)
+		aabb bounds() {
+			update();
+			return m_nodes.empty() ? aabb() : m_nodes[0].box;
+		}
+
+		//! Bring hierarchy up to date with objects
+		/**
+		 * Rebuilds after objects were added, otherwise refits the
+		 * bounds of objects that moved or were updated.
+		 */
+		void update() {
+			for(size_t i = 0;i < m_dirty.size();i++) {
+				item_type & item = m_items[m_dirty[i]];
+				m_boxes[m_dirty[i]] = item.object->bounding_box().transformed(m_transforms[m_dirty[i]].model_mat);
+				item.is_dirty = false;
+				m_needs_refit = true;
+			}
+			m_dirty.clear();
+
+			if (m_needs_rebuild) {
+				build();
+			} else if (m_needs_refit) {
+				refit();
+			}
+			m_needs_rebuild = m_needs_refit = false;
+		}
+
+		//! Find the objects that may be visible in a frustum
+		/**
+		 * Subtrees of the hierarchy are traversed in parallel.
+		 * @param view The frustum to test with (World-Space)
+		 * @param visible_ids Ids of visible objects, in increasing order
+		 */
+		void cull(const frustum & view, object_ids_type & visible_ids) {
+			update();
+			visible_ids.clear();
+			if (m_nodes.empty())
+				return;
+
+			m_visible.resize(m_items.size());
+			thrust::fill(m_visible.begin(), m_visible.end(), 0);
+
+			// Split the hierarchy in subtrees, breadth first
+			details::scene_cull_kernel kernel(&m_nodes[0], &m_order[0], &m_boxes[0], &m_visible[0], view);
+			m_subtrees.clear();
+			m_subtrees.push_back(0);
+			size_t next = 0;
+			while(next < m_subtrees.size() && m_subtrees.size() - next < parallel_subtrees) {
+				boost::uint32_t node_id = m_subtrees[next++];
+				const details::bvh_node & node = m_nodes[node_id];
+				if (node.is_leaf() || !view.intersects(node.box)) {
+					kernel(node_id);
+				} else if (view.contains(node.box)) {
+					kernel.accept(node_id);
+				} else {
+					m_subtrees.push_back(node_id + 1);
+					m_subtrees.push_back(node.right_child);
+				}
+			}
+
+			thrust::for_each(m_subtrees.begin() + next, m_subtrees.end(), kernel);
+
+			// Compact ids of visible objects
+			thrust::counting_iterator<size_t> ids_begin(0);
+			visible_ids.resize(m_items.size());
+			object_ids_type::iterator visible_end = thrust::copy_if(
+					ids_begin, ids_begin + m_items.size(),	// Input
+					m_visible.begin(),						// Stencil
+					visible_ids.begin(),					// Output
+					is_flag_set());
+			visible_ids.resize(visible_end - visible_ids.begin());
+		}
+
+		//! Find the objects that may be visible by a camera
+		template<class CameraType>
+		void cull(const CameraType & cam, object_ids_type & visible_ids) {
+			cull(cam.view_frustum(), visible_ids);
+		}
+
+		//! Fill a batch with the objects that may be visible by a camera
+		/**
+		 * The batch is cleared first. Shaders get the transforms of
+		 * their object with instance<shaders::instance_transform>() of
+		 * their control, whose mvp matrix is updated for the camera
+		 * here, once per visible object. As the model matrix comes
+		 * first, instance<glm::mat4>() gets the model matrix alone.
+		 * The batch references the transforms of the scene, so it
+		 * must be filled again after objects are added.
+		 */
+		template<class CameraType>
+		void cull(const CameraType & cam, render_batch<renderable_type> & batch) {
+			cull(cam, m_visible_ids);
+			batch.clear();
+			glm::mat4 vp_mat = cam.projection_mat * cam.view_mat;
+			object_ids_type::const_iterator it;
+			for(it = m_visible_ids.begin();it != m_visible_ids.end(); it++) {
+				m_transforms[*it].update(vp_mat);
+				batch.add(*m_items[*it].object, &m_transforms[*it]);
+			}
+		}
+
+	private:
+
+		//! An object of the scene
+		struct item_type {
+
+			//! The object
+			renderable_type * object;
+
+			//! Flag if the item is in the dirty list
+			bool is_dirty;
+		};
+
+		//! Predicate for non zero flags
+		struct is_flag_set {
+			inline bool operator()(unsigned char flag) const {
+				return flag != 0;
+			}
+		};
+
+		//! Type of items container
+		typedef thrust::host_vector<item_type> items_type;
+
+		//! Type of the ids of the items of each object
+		typedef std::map<const renderable_type *, std::vector<size_t> > users_type;
+
+		//! Add an item to the dirty list, once
+		void mark_dirty(size_t id) {
+			if (m_items[id].is_dirty)
+				return;
+			m_items[id].is_dirty = true;
+			m_dirty.push_back(id);
+		}
+
+		//! Compare objects by the center of their bounds on an axis
+		struct center_compare {
+
+			//! Bounds of all objects
+			const thrust::host_vector<aabb> & boxes;
+
+			//! Axis to compare on
+			int axis;
+
+			center_compare(const thrust::host_vector<aabb> & _boxes, int _axis)
+			:
+				boxes(_boxes),
+				axis(_axis)
+			{}
+
+			inline bool operator()(boost::uint32_t a, boost::uint32_t b) const {
+				return boxes[a].center()[axis] < boxes[b].center()[axis];
+			}
+		};
+
+		//! Build hierarchy from scratch
+		void build() {
+			m_nodes.clear();
+			m_order.resize(m_items.size());
+			for(size_t i = 0;i < m_order.size();i++)
+				m_order[i] = boost::uint32_t(i);
+			if (m_items.empty())
+				return;
+
+			m_nodes.reserve(2 * (m_items.size() / leaf_size + 1));
+			build_node(0, boost::uint32_t(m_items.size()));
+		}
+
+		//! Build the node of a range of ordered objects
+		boost::uint32_t build_node(boost::uint32_t first, boost::uint32_t last) {
+			boost::uint32_t node_id = boost::uint32_t(m_nodes.size());
+			m_nodes.push_back(details::bvh_node());
+
+			aabb box, centers;
+			for(boost::uint32_t i = first;i < last;i++) {
+				box.extend(m_boxes[m_order[i]]);
+				if (!m_boxes[m_order[i]].empty())
+					centers.extend(m_boxes[m_order[i]].center());
+			}
+			m_nodes[node_id].box = box;
+
+			if (last - first <= leaf_size || centers.empty()) {
+				m_nodes[node_id].first = first;
+				m_nodes[node_id].count = last - first;
+				m_nodes[node_id].right_child = 0;
+				return node_id;
+			}
+
+			// Split at the median of the longest axis of centers
+			glm::vec3 extent = centers.max - centers.min;
+			int axis = 0;
+			if (extent.y > extent[axis]) axis = 1;
+			if (extent.z > extent[axis]) axis = 2;
+			boost::uint32_t middle = first + (last - first) / 2;
+			std::nth_element(
+					m_order.begin() + first, m_order.begin() + middle, m_order.begin() + last,
+					center_compare(m_boxes, axis));
+
+			build_node(first, middle);
+			boost::uint32_t right_child = build_node(middle, last);
+			m_nodes[node_id].first = 0;
+			m_nodes[node_id].count = 0;
+			m_nodes[node_id].right_child = right_child;
+			return node_id;
+		}
+
+		//! Recalculate bounds of nodes, keeping the hierarchy
+		void refit() {
+			// Children are after their parents
+			for(size_t i = m_nodes.size();i-- > 0;) {
+				details::bvh_node & node = m_nodes[i];
+				node.box = aabb();
+				if (node.is_leaf()) {
+					for(boost::uint32_t j = node.first;j < node.first + node.count;j++)
+						node.box.extend(m_boxes[m_order[j]]);
+				} else {
+					node.box.extend(m_nodes[i + 1].box);
+					node.box.extend(m_nodes[node.right_child].box);
+				}
+			}
+		}
+
+		//! All objects of the scene
+		items_type m_items;
+
+		//! Transforms of each object, passed as uniforms to shaders
+		thrust::host_vector<shaders::instance_transform> m_transforms;
+
+		//! Bounds of each object (World-Space)
+		thrust::host_vector<aabb> m_boxes;
+
+		//! Nodes of hierarchy
+		details::bvh_nodes_type m_nodes;
+
+		//! Object ids ordered by the leaves that hold them
+		thrust::host_vector<boost::uint32_t> m_order;
+
+		//! Visibility flag per object, of the last cull
+		thrust::host_vector<unsigned char> m_visible;
+
+		//! Roots of subtrees that are traversed in parallel
+		thrust::host_vector<boost::uint32_t> m_subtrees;
+
+		//! Ids of visible objects, when culling in a batch
+		object_ids_type m_visible_ids;
+
+		//! Ids of items whose bounds must be recalculated
+		object_ids_type m_dirty;
+
+		//! Ids of the items of each object
+		users_type m_users;
+
+		//! Flag if objects were added or removed
+		bool m_needs_rebuild;
+
+		//! Flag if objects were moved
+		bool m_needs_refit;
+	};
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+#include "./render_context.hpp"
+
+namespace thrender {
+namespace details {
+
+	//! Check if a shader has a prepare(render_context &) hook
+	template<class Shader>
+	struct has_prepare_hook {
+
+		template<class S>
+		static std::true_type test(int, decltype(std::declval<S &>().prepare(std::declval<render_context &>())) * = 0);
+
+		template<class S>
+		static std::false_type test(...);
+
+		//! std::true_type if the hook exists
+		typedef decltype(test<Shader>(0)) type;
+
+		static const bool value = type::value;
+	};
+
+	//! Check if a shader has a finish(render_context &) hook
+	template<class Shader>
+	struct has_finish_hook {
+
+		template<class S>
+		static std::true_type test(int, decltype(std::declval<S &>().finish(std::declval<render_context &>())) * = 0);
+
+		template<class S>
+		static std::false_type test(...);
+
+		//! std::true_type if the hook exists
+		typedef decltype(test<Shader>(0)) type;
+
+		static const bool value = type::value;
+	};
+
+	template<class Shader>
+	inline void prepare_shader(Shader & shader, render_context & context, std::true_type) {
+		shader.prepare(context);
+	}
+
+	template<class Shader>
+	inline void prepare_shader(Shader &, render_context &, std::false_type) {}
+
+	//! Call the prepare hook of a shader, if it has one
+	/**
+	 * Called once per draw, before any vertex or fragment is
+	 * processed. Shaders bake there uniforms that are derived
+	 * from others, like the model view projection matrix.
+	 */
+	template<class Shader>
+	inline void prepare_shader(Shader & shader, render_context & context) {
+		prepare_shader(shader, context, typename has_prepare_hook<Shader>::type());
+	}
+
+	template<class Shader>
+	inline void finish_shader(Shader & shader, render_context & context, std::true_type) {
+		shader.finish(context);
+	}
+
+	template<class Shader>
+	inline void finish_shader(Shader &, render_context &, std::false_type) {}
+
+	//! Call the finish hook of a shader, if it has one
+	/**
+	 * Called once per draw, after all fragments are processed.
+	 */
+	template<class Shader>
+	inline void finish_shader(Shader & shader, render_context & context) {
+		finish_shader(shader, context, typename has_finish_hook<Shader>::type());
+	}
+}
+}
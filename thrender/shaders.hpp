@@ -12,6 +12,10 @@
 #define FB_PIXEL(buffer) \
 	buffer[api.framebuffer_y][api.framebuffer_x]
 
+//! Macro to write the pixels of the current quad inside a packet fragment shader
+#define FB_PACKET_STORE(buffer, values) \
+	api.store(buffer, values)
+
 namespace thrender {
 namespace shaders {
 
@@ -46,21 +50,30 @@ struct phong_material {
 
 //! Vertex shader base class
 /**
- * TODO: Add this base class for declaring extra hooks
- * like pre-processing, post-processing etc.
+ * Declares the hooks that pipeline calls once per draw. Shaders
+ * do not have to derive from it, the hooks are detected at compile
+ * time on any shader, vertex or fragment.
  */
 struct vx_shader {
 
+	//! Called before the vertices of a draw are processed
 	virtual void prepare(render_context & ctx) {
 
 	}
 
+	//! Called after the fragments of a draw are processed
+	virtual void finish(render_context & ctx) {
+
+	}
+
 	virtual ~vx_shader(){}
 };
 
 //! Implementation of a Gouraud shading (per vertex)
 /**
- * It will calculate per vertex
+ * It will calculate per vertex, in world space. Normals are transformed
+ * with the inverse transpose of the model matrix, baked once per draw,
+ * so they stay perpendicular to surfaces under non uniform scale.
  */
 struct gouraud_vx_shader {
 
@@ -82,28 +95,95 @@ struct gouraud_vx_shader {
 	//! The material of the object
 	phong_material material;
 
+	//! Only the vertex color is interpolated
+	typedef varyings<COLOR> varyings_type;
+
 	template<class RenderableType>
 	void operator()(const typename RenderableType::vertex_type & vin, typename RenderableType::vertex_type & vout, vertex_processing_control<RenderableType> & vcontrol){
 		const glm::vec4 & posIn = VA_ATTRIBUTE(vin, POSITION);
 		glm::vec4 & posOut = VA_ATTRIBUTE(vout, POSITION);
 		const glm::vec4 & normIn = VA_ATTRIBUTE(vin, NORMAL);
 
-		posOut = glm::normalize(mProjection * mView * mModel * posIn);
+		posOut = glm::normalize(m_mvp * posIn);
 		vcontrol.translate_to_window_space(posOut);
 		vcontrol.viewport_clip(posOut);
 
-		glm::vec4 vNormal_ws = glm::normalize(mModel * normIn);
-		glm::vec4 vPos_ws = glm::normalize(mModel * posIn);
-		glm::vec4 vLightDirection = glm::normalize(vPos_ws - light.position_ws);
-		glm::vec4 vCameraDirection = glm::normalize(vPos_ws - vCameraPos_ws);
-		glm::vec4 vReflectedLight = glm::normalize(glm::reflect(-vLightDirection, vNormal_ws));
+		VA_ATTRIBUTE(vout, COLOR) = lit_color(glm::vec3(mModel * posIn), glm::vec3(m_mNormal * normIn));
+	}
+
+	template<class RenderableType>
+	void operator()(const typename RenderableType::vertex_packet_type & vin, typename RenderableType::vertex_packet_type & vout, vertex_packet_control<RenderableType> & vcontrol){
+		const simd::soa<glm::vec4> & posIn = VA_ATTRIBUTE(vin, POSITION);
+		simd::soa<glm::vec4> & posOut = VA_ATTRIBUTE(vout, POSITION);
+
+		posOut = simd::normalize(m_mvp * posIn);
+		vcontrol.translate_to_window_space(posOut);
+		vcontrol.viewport_clip(posOut);
+
+		VA_ATTRIBUTE(vout, COLOR) = lit_color(simd::xyz(mModel * posIn), simd::xyz(m_mNormal * VA_ATTRIBUTE(vin, NORMAL)));
+	}
+
+	//! Bake the uniforms that are the same for all vertices of a draw
+	void prepare(render_context &) {
+		m_mvp = mProjection * mView * mModel;
+		m_mNormal = glm::transpose(glm::inverse(mModel));
+		m_vLightPos_ws = glm::vec3(light.position_ws);
+		m_vCameraPos_ws = glm::vec3(vCameraPos_ws);
+		m_cDiffuse = light.diffuse_color * material.diffuse_color;
+		m_cSpecular = light.specular_color * material.specular_color;
+	}
+
+private:
+
+	//! Baked model view projection matrix
+	glm::mat4 m_mvp;
+
+	//! Baked normal matrix, the inverse transpose of the model matrix
+	/**
+	 * The translation of the model matrix ends in the last row, so
+	 * the xyz of transformed normals do not depend on their w.
+	 */
+	glm::mat4 m_mNormal;
+
+	//! Baked light position in world space
+	glm::vec3 m_vLightPos_ws;
+
+	//! Baked camera position in world space
+	glm::vec3 m_vCameraPos_ws;
+
+	//! Baked diffuse color of light on material
+	color_pixel_t m_cDiffuse;
+
+	//! Baked specular color of light on material
+	color_pixel_t m_cSpecular;
+
+	//! Phong lighting of a vertex in world space
+	glm::vec4 lit_color(const glm::vec3 & vPos_ws, const glm::vec3 & normIn) const {
+		glm::vec3 vNormal_ws = glm::normalize(normIn);
+		glm::vec3 vLightDirection = glm::normalize(vPos_ws - m_vLightPos_ws);
+		glm::vec3 vCameraDirection = glm::normalize(vPos_ws - m_vCameraPos_ws);
+		glm::vec3 vReflectedLight = glm::reflect(-vLightDirection, vNormal_ws);
 
 		float fDiffuseIntensity = glm::max(0.0f, glm::dot( vNormal_ws, vLightDirection ));
 		float fSpecularIntensity = glm::pow(glm::max(0.0f, glm::dot(vReflectedLight, vCameraDirection)), material.shininess);
 
-		glm::vec4 cDiffuse = light.diffuse_color * material.diffuse_color * fDiffuseIntensity;
-		glm::vec4 cSpecular = light.specular_color * material.specular_color * fSpecularIntensity;
-		VA_ATTRIBUTE(vout, COLOR) = material.emissive_color + cDiffuse + cSpecular;
+		return material.emissive_color + m_cDiffuse * fDiffuseIntensity + m_cSpecular * fSpecularIntensity;
+	}
+
+	//! Phong lighting of a packet of vertices in world space
+	simd::soa<glm::vec4> lit_color(const simd::soa<glm::vec3> & vPos_ws, const simd::soa<glm::vec3> & normIn) const {
+		typedef simd::soa<glm::vec3> vec3_packet;
+		vec3_packet vNormal_ws = simd::normalize(normIn);
+		vec3_packet vLightDirection = simd::normalize(vPos_ws - vec3_packet(m_vLightPos_ws));
+		vec3_packet vCameraDirection = simd::normalize(vPos_ws - vec3_packet(m_vCameraPos_ws));
+		vec3_packet vReflectedLight = simd::reflect(vec3_packet(glm::vec3(0.0f)) - vLightDirection, vNormal_ws);
+
+		simd::float4 fDiffuseIntensity = simd::dot(vNormal_ws, vLightDirection).max(0.0f);
+		simd::float4 fSpecularIntensity = simd::pow(simd::dot(vReflectedLight, vCameraDirection).max(0.0f), material.shininess);
+
+		return simd::soa<glm::vec4>(material.emissive_color)
+			+ simd::soa<glm::vec4>(m_cDiffuse) * fDiffuseIntensity
+			+ simd::soa<glm::vec4>(m_cSpecular) * fSpecularIntensity;
 	}
 };
 
@@ -118,6 +198,11 @@ struct gouraud_fg_shader {
 	void operator()(framebuffer_array & fb, const fragment_processing_control<RenderableType> & api) {
 		FB_PIXEL(fb.color_buffer()) = INTERPOLATE(COLOR);
 	}
+
+	template<class RenderableType>
+	void operator()(framebuffer_array & fb, const fragment_packet_control<RenderableType> & api) {
+		FB_PACKET_STORE(fb.color_buffer(), INTERPOLATE(COLOR));
+	}
 };
 
 //! Default vertex shader
@@ -130,6 +215,9 @@ struct default_vx_shader {
 	//! Model view projection matrix
 	glm::mat4 mvp_mat;
 
+	//! Only the vertex color is interpolated
+	typedef varyings<COLOR> varyings_type;
+
 	template<class RenderableType>
 	void operator()(const typename RenderableType::vertex_type & vin, typename RenderableType::vertex_type & vout, vertex_processing_control<RenderableType> & vcontrol){
 		const glm::vec4 & posIn = VA_ATTRIBUTE(vin, POSITION);
@@ -142,6 +230,68 @@ struct default_vx_shader {
 		// translate to window space
 
 		vcontrol.viewport_clip(posOut);
+		VA_ATTRIBUTE(vout, COLOR) = VA_ATTRIBUTE(vin, COLOR);
+	}
+
+	template<class RenderableType>
+	void operator()(const typename RenderableType::vertex_packet_type & vin, typename RenderableType::vertex_packet_type & vout, vertex_packet_control<RenderableType> & vcontrol){
+		simd::soa<glm::vec4> & posOut = VA_ATTRIBUTE(vout, POSITION);
+
+		posOut = mvp_mat * VA_ATTRIBUTE(vin, POSITION);
+		vcontrol.translate_to_window_space(posOut);
+		vcontrol.viewport_clip(posOut);
+		VA_ATTRIBUTE(vout, COLOR) = VA_ATTRIBUTE(vin, COLOR);
+	}
+};
+
+//! Per instance data of instanced_vx_shader
+struct instance_transform {
+
+	//! Model transformation matrix of the instance
+	glm::mat4 model_mat;
+
+	//! Model view projection matrix of the instance
+	/**
+	 * It is computed once per instance by update(), so that
+	 * vertices are transformed with a single matrix product.
+	 */
+	glm::mat4 mvp_mat;
+
+	//! Update the mvp matrix for a view projection matrix
+	inline void update(const glm::mat4 & vp_mat) {
+		mvp_mat = vp_mat * model_mat;
+	}
+};
+
+//! Default vertex shader for instanced rendering
+/**
+ * Same as default_vx_shader, with the mvp matrix taken from the
+ * instance_transform of each instance. The matrices of all instances
+ * must be updated with the view projection matrix before drawing.
+ */
+struct instanced_vx_shader {
+
+	//! Only the vertex color is interpolated
+	typedef varyings<COLOR> varyings_type;
+
+	template<class RenderableType>
+	void operator()(const typename RenderableType::vertex_type & vin, typename RenderableType::vertex_type & vout, vertex_processing_control<RenderableType> & vcontrol){
+		glm::vec4 & posOut = VA_ATTRIBUTE(vout, POSITION);
+
+		posOut = vcontrol.template instance<instance_transform>().mvp_mat * VA_ATTRIBUTE(vin, POSITION);
+		vcontrol.translate_to_window_space(posOut);
+		vcontrol.viewport_clip(posOut);
+		VA_ATTRIBUTE(vout, COLOR) = VA_ATTRIBUTE(vin, COLOR);
+	}
+
+	template<class RenderableType>
+	void operator()(const typename RenderableType::vertex_packet_type & vin, typename RenderableType::vertex_packet_type & vout, vertex_packet_control<RenderableType> & vcontrol){
+		simd::soa<glm::vec4> & posOut = VA_ATTRIBUTE(vout, POSITION);
+
+		posOut = vcontrol.template instance<instance_transform>().mvp_mat * VA_ATTRIBUTE(vin, POSITION);
+		vcontrol.translate_to_window_space(posOut);
+		vcontrol.viewport_clip(posOut);
+		VA_ATTRIBUTE(vout, COLOR) = VA_ATTRIBUTE(vin, COLOR);
 	}
 };
 
@@ -155,6 +305,11 @@ struct default_fg_shader {
 	void operator()(framebuffer_array & fb, const fragment_processing_control<RenderableType> & api) {
 		FB_PIXEL(fb.color_buffer()) = INTERPOLATE(COLOR);
 	}
+
+	template<class RenderableType>
+	void operator()(framebuffer_array & fb, const fragment_packet_control<RenderableType> & api) {
+		FB_PACKET_STORE(fb.color_buffer(), INTERPOLATE(COLOR));
+	}
 };
 }
 }
@@ -0,0 +1,454 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <new>
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) && !defined(THRENDER_NO_SIMD)
+#	define THRENDER_SIMD_SSE
+#	include <xmmintrin.h>
+#endif
+
+namespace thrender {
+namespace simd {
+
+	//! Alignment in bytes of memory that is read and written with aligned packets
+	static const size_t alignment = 16;
+
+	//! Allocator of memory aligned to simd::alignment
+	/**
+	 * Used by the containers of structure of arrays streams, so
+	 * that whole packets are loaded and stored with aligned access.
+	 */
+	template<class T>
+	struct aligned_allocator {
+
+		typedef T value_type;
+		typedef T * pointer;
+		typedef const T * const_pointer;
+		typedef T & reference;
+		typedef const T & const_reference;
+		typedef size_t size_type;
+		typedef ptrdiff_t difference_type;
+
+		template<class U>
+		struct rebind {
+			typedef aligned_allocator<U> other;
+		};
+
+		aligned_allocator() {}
+
+		template<class U>
+		aligned_allocator(const aligned_allocator<U> &) {}
+
+		//! Allocate aligned memory for n values
+		/**
+		 * The address of the whole block is kept right before
+		 * the aligned memory, to be freed by deallocate().
+		 */
+		pointer allocate(size_type n, const void * = 0) {
+			char * block = static_cast<char *>(::operator new(n * sizeof(T) + alignment + sizeof(void *)));
+			uintptr_t aligned = (reinterpret_cast<uintptr_t>(block) + sizeof(void *) + alignment - 1) & ~uintptr_t(alignment - 1);
+			reinterpret_cast<void **>(aligned)[-1] = block;
+			return reinterpret_cast<pointer>(aligned);
+		}
+
+		//! Free memory of allocate()
+		void deallocate(pointer p, size_type) {
+			::operator delete(reinterpret_cast<void **>(p)[-1]);
+		}
+
+		inline size_type max_size() const {
+			return (size_type(-1) - alignment - sizeof(void *)) / sizeof(T);
+		}
+
+		inline void construct(pointer p, const T & value) {
+			new(p) T(value);
+		}
+
+		inline void destroy(pointer p) {
+			p->~T();
+		}
+
+		template<class U>
+		inline bool operator==(const aligned_allocator<U> &) const {
+			return true;
+		}
+
+		template<class U>
+		inline bool operator!=(const aligned_allocator<U> &) const {
+			return false;
+		}
+	};
+
+	//! Four single precision lanes
+	/**
+	 * Mapped on an SSE register when available, otherwise
+	 * on a plain array that compilers are free to vectorize.
+	 */
+	struct float4 {
+
+		//! Number of lanes
+		static const size_t lanes = 4;
+
+#ifdef THRENDER_SIMD_SSE
+		//! Type of native storage
+		typedef __m128 native_type;
+
+		//! Native storage
+		native_type v;
+
+		//! Uninitialized lanes
+		float4() {}
+
+		//! Broadcast a value to all lanes
+		float4(float s) : v(_mm_set1_ps(s)) {}
+
+		//! Construct from lane values
+		float4(float l0, float l1, float l2, float l3) : v(_mm_setr_ps(l0, l1, l2, l3)) {}
+
+		//! Wrap native storage
+		explicit float4(native_type _v) : v(_v) {}
+
+		//! Read all lanes from memory
+		static inline float4 load(const float * in) {
+			return float4(_mm_loadu_ps(in));
+		}
+
+		//! Write all lanes to memory
+		inline void store(float * out) const {
+			_mm_storeu_ps(out, v);
+		}
+
+		//! Read all lanes from memory aligned to simd::alignment
+		static inline float4 load_aligned(const float * in) {
+			return float4(_mm_load_ps(in));
+		}
+
+		//! Write all lanes to memory aligned to simd::alignment
+		inline void store_aligned(float * out) const {
+			_mm_store_ps(out, v);
+		}
+
+		inline float4 & operator+=(const float4 & rv) {
+			v = _mm_add_ps(v, rv.v);
+			return *this;
+		}
+
+		inline float4 operator+(const float4 & rv) const {
+			return float4(_mm_add_ps(v, rv.v));
+		}
+
+		inline float4 operator-(const float4 & rv) const {
+			return float4(_mm_sub_ps(v, rv.v));
+		}
+
+		inline float4 operator*(const float4 & rv) const {
+			return float4(_mm_mul_ps(v, rv.v));
+		}
+
+		inline float4 operator/(const float4 & rv) const {
+			return float4(_mm_div_ps(v, rv.v));
+		}
+
+		//! Square root of all lanes
+		inline float4 sqrt() const {
+			return float4(_mm_sqrt_ps(v));
+		}
+
+		//! Greater of the values of each lane
+		inline float4 max(const float4 & rv) const {
+			return float4(_mm_max_ps(v, rv.v));
+		}
+
+		//! Get a bit mask of the lanes that are greater or equal than rv
+		inline int greater_equal_mask(const float4 & rv) const {
+			return _mm_movemask_ps(_mm_cmpge_ps(v, rv.v));
+		}
+#else
+		//! Type of native storage
+		typedef float native_type[4];
+
+		//! Native storage
+		native_type v;
+
+		//! Uninitialized lanes
+		float4() {}
+
+		//! Broadcast a value to all lanes
+		float4(float s) {
+			v[0] = v[1] = v[2] = v[3] = s;
+		}
+
+		//! Construct from lane values
+		float4(float l0, float l1, float l2, float l3) {
+			v[0] = l0; v[1] = l1; v[2] = l2; v[3] = l3;
+		}
+
+		//! Read all lanes from memory
+		static inline float4 load(const float * in) {
+			return float4(in[0], in[1], in[2], in[3]);
+		}
+
+		//! Write all lanes to memory
+		inline void store(float * out) const {
+			for(size_t i = 0;i < lanes;i++)
+				out[i] = v[i];
+		}
+
+		//! Read all lanes from memory aligned to simd::alignment
+		static inline float4 load_aligned(const float * in) {
+			return load(in);
+		}
+
+		//! Write all lanes to memory aligned to simd::alignment
+		inline void store_aligned(float * out) const {
+			store(out);
+		}
+
+		inline float4 & operator+=(const float4 & rv) {
+			for(size_t i = 0;i < lanes;i++)
+				v[i] += rv.v[i];
+			return *this;
+		}
+
+		inline float4 operator+(const float4 & rv) const {
+			return float4(v[0] + rv.v[0], v[1] + rv.v[1], v[2] + rv.v[2], v[3] + rv.v[3]);
+		}
+
+		inline float4 operator-(const float4 & rv) const {
+			return float4(v[0] - rv.v[0], v[1] - rv.v[1], v[2] - rv.v[2], v[3] - rv.v[3]);
+		}
+
+		inline float4 operator*(const float4 & rv) const {
+			return float4(v[0] * rv.v[0], v[1] * rv.v[1], v[2] * rv.v[2], v[3] * rv.v[3]);
+		}
+
+		inline float4 operator/(const float4 & rv) const {
+			return float4(v[0] / rv.v[0], v[1] / rv.v[1], v[2] / rv.v[2], v[3] / rv.v[3]);
+		}
+
+		//! Square root of all lanes
+		inline float4 sqrt() const {
+			return float4(std::sqrt(v[0]), std::sqrt(v[1]), std::sqrt(v[2]), std::sqrt(v[3]));
+		}
+
+		//! Greater of the values of each lane
+		inline float4 max(const float4 & rv) const {
+			return float4(std::max(v[0], rv.v[0]), std::max(v[1], rv.v[1]), std::max(v[2], rv.v[2]), std::max(v[3], rv.v[3]));
+		}
+
+		//! Get a bit mask of the lanes that are greater or equal than rv
+		inline int greater_equal_mask(const float4 & rv) const {
+			int mask = 0;
+			for(size_t i = 0;i < lanes;i++)
+				mask |= (v[i] >= rv.v[i]) << i;
+			return mask;
+		}
+#endif
+	};
+
+	//! Access to the scalar components of a value type
+	/**
+	 * Specialized for all types that can be held in a soa.
+	 */
+	template<class T>
+	struct components_of;
+
+	//! Access to the scalar components of a glm vector
+	template<class Vec, size_t N>
+	struct vector_components {
+
+		//! Number of scalar components
+		static const size_t size = N;
+
+		//! Get the nth component
+		static inline float get(const Vec & value, size_t index) {
+			return value[index];
+		}
+
+		//! Set the nth component
+		static inline void set(Vec & value, size_t index, float c) {
+			value[index] = c;
+		}
+	};
+
+	template<>
+	struct components_of<float> {
+		static const size_t size = 1;
+
+		static inline float get(const float & value, size_t) {
+			return value;
+		}
+
+		static inline void set(float & value, size_t, float c) {
+			value = c;
+		}
+
+		//! Construct a value from components that are stride floats apart
+		static inline float load(const float * data, size_t) {
+			return data[0];
+		}
+	};
+
+	template<>
+	struct components_of<glm::vec2> : vector_components<glm::vec2, 2> {
+		static inline glm::vec2 load(const float * data, size_t stride) {
+			return glm::vec2(data[0], data[stride]);
+		}
+	};
+
+	template<>
+	struct components_of<glm::vec3> : vector_components<glm::vec3, 3> {
+		static inline glm::vec3 load(const float * data, size_t stride) {
+			return glm::vec3(data[0], data[stride], data[2 * stride]);
+		}
+	};
+
+	template<>
+	struct components_of<glm::vec4> : vector_components<glm::vec4, 4> {
+		static inline glm::vec4 load(const float * data, size_t stride) {
+			return glm::vec4(data[0], data[stride], data[2 * stride], data[3 * stride]);
+		}
+	};
+
+	//! Structure of arrays of a value type, one lane per pixel
+	/**
+	 * Each scalar component of the value is kept in its own
+	 * float4, so math on a soa<glm::vec4> processes four
+	 * pixels at once.
+	 */
+	template<class T>
+	struct soa {
+
+		//! Type of the value per lane
+		typedef T value_type;
+
+		//! Component access of the value type
+		typedef components_of<T> components;
+
+		//! Lanes of each component
+		float4 c[components::size];
+
+		//! Uninitialized lanes
+		soa() {}
+
+		//! Broadcast a value to all lanes
+		soa(const T & value) {
+			for(size_t i = 0;i < components::size;i++)
+				c[i] = float4(components::get(value, i));
+		}
+
+		//! Gather the values of all lanes
+		explicit soa(const T values[float4::lanes]) {
+			float lane_values[float4::lanes];
+			for(size_t i = 0;i < components::size;i++) {
+				for(size_t l = 0;l < float4::lanes;l++)
+					lane_values[l] = components::get(values[l], i);
+				c[i] = float4::load(lane_values);
+			}
+		}
+
+		//! Extract the values of all lanes
+		void extract(T out[float4::lanes]) const {
+			float lane_values[float4::lanes];
+			for(size_t i = 0;i < components::size;i++) {
+				c[i].store(lane_values);
+				for(size_t l = 0;l < float4::lanes;l++)
+					components::set(out[l], i, lane_values[l]);
+			}
+		}
+
+		inline soa & operator+=(const soa & rv) {
+			for(size_t i = 0;i < components::size;i++)
+				c[i] += rv.c[i];
+			return *this;
+		}
+
+		inline soa operator+(const soa & rv) const {
+			soa r;
+			for(size_t i = 0;i < components::size;i++)
+				r.c[i] = c[i] + rv.c[i];
+			return r;
+		}
+
+		inline soa operator-(const soa & rv) const {
+			soa r;
+			for(size_t i = 0;i < components::size;i++)
+				r.c[i] = c[i] - rv.c[i];
+			return r;
+		}
+
+		//! Component wise multiplication
+		inline soa operator*(const soa & rv) const {
+			soa r;
+			for(size_t i = 0;i < components::size;i++)
+				r.c[i] = c[i] * rv.c[i];
+			return r;
+		}
+
+		//! Multiply all components with a per lane factor
+		inline soa operator*(const float4 & factor) const {
+			soa r;
+			for(size_t i = 0;i < components::size;i++)
+				r.c[i] = c[i] * factor;
+			return r;
+		}
+	};
+
+	//! Transform four vectors by a matrix
+	inline soa<glm::vec4> operator*(const glm::mat4 & m, const soa<glm::vec4> & v) {
+		soa<glm::vec4> r;
+		for(size_t i = 0;i < 4;i++) {
+			r.c[i] = (float4(m[0][i]) * v.c[0] + float4(m[1][i]) * v.c[1])
+				+ (float4(m[2][i]) * v.c[2] + float4(m[3][i]) * v.c[3]);
+		}
+		return r;
+	}
+
+	//! Dot product of four pairs of vectors
+	template<class T>
+	inline float4 dot(const soa<T> & a, const soa<T> & b) {
+		float4 r = a.c[0] * b.c[0];
+		for(size_t i = 1;i < soa<T>::components::size;i++)
+			r += a.c[i] * b.c[i];
+		return r;
+	}
+
+	//! Normalize four vectors
+	template<class T>
+	inline soa<T> normalize(const soa<T> & v) {
+		return v * (float4(1.0f) / dot(v, v).sqrt());
+	}
+
+	//! Reflect four incident vectors on four normals
+	template<class T>
+	inline soa<T> reflect(const soa<T> & i, const soa<T> & n) {
+		return i - n * (float4(2.0f) * dot(n, i));
+	}
+
+	//! Raise all lanes to a power
+	/**
+	 * There is no vector instruction for it, lanes are raised one
+	 * at a time.
+	 */
+	inline float4 pow(const float4 & base, float exponent) {
+		float lane_values[float4::lanes];
+		base.store(lane_values);
+		for(size_t l = 0;l < float4::lanes;l++)
+			lane_values[l] = std::pow(lane_values[l], exponent);
+		return float4::load(lane_values);
+	}
+
+	//! Get the xyz components of four vectors
+	inline soa<glm::vec3> xyz(const soa<glm::vec4> & v) {
+		soa<glm::vec3> r;
+		for(size_t i = 0;i < 3;i++)
+			r.c[i] = v.c[i];
+		return r;
+	}
+}
+}
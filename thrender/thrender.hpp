@@ -1,7 +1,11 @@
 #pragma once
 
 #include "./vertex_processor.hpp"
-//#include "./primitive_processor.hpp"
+#include "./primitive_processor.hpp"
 #include "./fragment_processor.hpp"
+#include "./visibility_processor.hpp"
+#include "./render_batch.hpp"
+#include "./scene.hpp"
+#include "./lod.hpp"
 #include "./shaders.hpp"
 #include "./pipeline.hpp"
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <thrust/host_vector.h>
+#include "./types.hpp"
+
+namespace thrender {
+
+	//! Rectangle of a screen tile in window space
+	/**
+	 * The left and top sides are inclusive, while the right
+	 * and bottom are exclusive.
+	 */
+	struct tile_rect {
+
+		//! The left side of the tile (min x)
+		window_size_t left;
+
+		//! The top side of the tile (min y)
+		window_size_t top;
+
+		//! The right side of the tile (max x, exclusive)
+		window_size_t right;
+
+		//! The bottom side of the tile (max y, exclusive)
+		window_size_t bottom;
+
+		//! Check if a pixel is inside the tile
+		inline bool contains(window_size_t x, window_size_t y) const {
+			return x >= left && x < right && y >= top && y < bottom;
+		}
+	};
+
+namespace details {
+
+	//! Per tile lists of primitives (sort-middle binning)
+	/**
+	 * The framebuffer is split in square tiles of tile_size
+	 * pixels. Each primitive is appended to the bin of every tile
+	 * that its bounding box overlaps, in submission order. Tiles
+	 * can then be rasterized independently of each other, as no
+	 * two tiles share any pixel.
+	 */
+	struct tile_bins {
+
+		//! Type of a bin holding primitive ids
+		typedef thrust::host_vector<primitive_id_t> bin_type;
+
+		//! Type of the container of all bins
+		typedef thrust::host_vector<bin_type> bins_type;
+
+		//! Construct empty bins, with no tiles
+		tile_bins()
+		:
+			m_width(0),
+			m_height(0),
+			m_tiles_x(0),
+			m_tiles_y(0)
+		{}
+
+		//! Resize the tile grid to cover a framebuffer
+		/**
+		 * @param width The width of the covered framebuffer
+		 * @param height The height of the covered framebuffer
+		 */
+		void resize(window_size_t width, window_size_t height) {
+			m_width = width;
+			m_height = height;
+			m_tiles_x = (width + tile_size - 1) / tile_size;
+			m_tiles_y = (height + tile_size - 1) / tile_size;
+			m_bins.resize(m_tiles_x * m_tiles_y);
+		}
+
+		//! Drop all binned primitives
+		/**
+		 * The bins keep their storage, so steady state binning
+		 * does not allocate.
+		 */
+		void clear() {
+			for(bins_type::iterator it = m_bins.begin();it != m_bins.end();it++) {
+				it->clear();
+			}
+		}
+
+		//! Append a primitive to all tiles overlapping its bounding box
+		/**
+		 * @param bounding_box Bounding box in window space, as returned
+		 * by triangle_bounding_box()
+		 * @param id The id of the primitive
+		 * @param is_tile_visible Functor called with (column, row) of a
+		 * tile, that returns false if primitive must not be binned there.
+		 */
+		template<class TileTest>
+		void insert(const glm::vec4 & bounding_box, primitive_id_t id, TileTest is_tile_visible) {
+			if (!m_width || !m_height)
+				return;
+
+			float x_max = bounding_box[0] + bounding_box[2];
+			float y_max = bounding_box[1] + bounding_box[3];
+			if (x_max < 0 || y_max < 0 || bounding_box[0] >= m_width || bounding_box[1] >= m_height)
+				return;
+
+			size_t tx_begin = std::max(bounding_box[0], 0.0f) / tile_size;
+			size_t ty_begin = std::max(bounding_box[1], 0.0f) / tile_size;
+			size_t tx_end = std::min<size_t>(x_max, m_width - 1) / tile_size;
+			size_t ty_end = std::min<size_t>(y_max, m_height - 1) / tile_size;
+
+			for(size_t ty = ty_begin; ty <= ty_end; ty++) {
+				for(size_t tx = tx_begin; tx <= tx_end; tx++) {
+					if (is_tile_visible(tx, ty))
+						m_bins[ty * m_tiles_x + tx].push_back(id);
+				}
+			}
+		}
+
+		//! Get the rectangle of a tile
+		tile_rect rect(size_t tile_index) const {
+			tile_rect r;
+			r.left = (tile_index % m_tiles_x) * tile_size;
+			r.top = (tile_index / m_tiles_x) * tile_size;
+			r.right = std::min<size_t>(r.left + tile_size, m_width);
+			r.bottom = std::min<size_t>(r.top + tile_size, m_height);
+			return r;
+		}
+
+		//! Access the bin of a tile
+		inline const bin_type & operator[](size_t tile_index) const {
+			return m_bins[tile_index];
+		}
+
+		//! Get the total number of tiles
+		inline size_t total_tiles() const {
+			return m_bins.size();
+		}
+
+		//! Get the number of tile columns
+		inline size_t tiles_x() const {
+			return m_tiles_x;
+		}
+
+		//! Get the number of tile rows
+		inline size_t tiles_y() const {
+			return m_tiles_y;
+		}
+
+	private:
+
+		//! Width of the covered framebuffer
+		window_size_t m_width;
+
+		//! Height of the covered framebuffer
+		window_size_t m_height;
+
+		//! Number of tile columns
+		size_t m_tiles_x;
+
+		//! Number of tile rows
+		size_t m_tiles_y;
+
+		//! The bin of each tile, in row major order
+		bins_type m_bins;
+	};
+}
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <thrust/tuple.h>
+#include "./types.hpp"
+#include "./raster.hpp"
+
+namespace thrender {
+
+	//! Interpolation modes of vertex attributes
+	enum class interpolation_mode {
+		linear,		//!< Linear in window space (default)
+		perspective	//!< Perspective correct, linear in clip space
+	};
+
+	//! Face culling modes
+	/**
+	 * Front faces are those with counter-clock-wise
+	 * winding order in window space.
+	 */
+	enum class cull_mode {
+		none,	//!< Draw all triangles (default)
+		back,	//!< Drop clock-wise triangles
+		front	//!< Drop counter-clock-wise triangles
+	};
+
+	//! Plane equation of an attribute over window space
+	/**
+	 * The value at a point is value + ddx * x + ddy * y, where
+	 * x, y are relative to the origin of the triangle edges.
+	 */
+	template<class T>
+	struct attribute_plane {
+
+		//! Type of the interpolated value
+		typedef T value_type;
+
+		//! Value at origin
+		T value;
+
+		//! Change of value per pixel on x-axis
+		T ddx;
+
+		//! Change of value per pixel on y-axis
+		T ddy;
+
+		//! Calculate plane from the values on the three vertices
+		void setup(const T & v0, const T & v1, const T & v2, const details::edge_equations & edges) {
+			value = v0;
+			ddx = v0 * edges.a.x + v1 * edges.a.y + v2 * edges.a.z;
+			ddy = v0 * edges.b.x + v1 * edges.b.y + v2 * edges.b.z;
+		}
+
+		//! Evaluate plane at a point relative to origin
+		inline T evaluate(float x, float y) const {
+			return value + ddx * x + ddy * y;
+		}
+	};
+
+namespace details {
+
+	//! Tuple with one plane per attribute of a vertex type
+	template<class VertexType,
+		class Indices = typename make_index_sequence<thrust::tuple_size<VertexType>::value>::type>
+	struct attribute_planes_tuple;
+
+	template<class VertexType, size_t... I>
+	struct attribute_planes_tuple<VertexType, index_sequence<I...> > {
+		typedef thrust::tuple< attribute_plane< typename thrust::tuple_element<I, VertexType>::type >... > type;
+	};
+
+	//! Attribute planes for attributes of a vertex type
+	/**
+	 * Planes are always stored for all attributes, but only
+	 * those of the Indices attributes are setup. Attributes of
+	 * the three vertices are read from a source, that provides
+	 * attribute<A>(vertex) for the vertices 0, 1 and 2.
+	 */
+	template<class VertexType,
+		class Indices = typename make_index_sequence<thrust::tuple_size<VertexType>::value>::type>
+	struct attribute_planes_of;
+
+	template<class VertexType, size_t... I>
+	struct attribute_planes_of<VertexType, index_sequence<I...> > {
+
+		//! Tuple with one plane per vertex attribute
+		typedef typename attribute_planes_tuple<VertexType>::type type;
+
+		//! Setup planes of the attributes
+		template<class Source>
+		static void setup(type & planes, const Source & source, const edge_equations & edges) {
+			int expand[] = {0, (thrust::get<I>(planes).setup(
+					source.template attribute<I>(0), source.template attribute<I>(1), source.template attribute<I>(2), edges), 0)...};
+			(void)expand;
+		}
+
+		//! Setup planes of the attributes divided by the clip space w
+		template<class Source>
+		static void setup_perspective(type & planes, const Source & source, const glm::vec3 & inv_w, const edge_equations & edges) {
+			int expand[] = {0, (thrust::get<I>(planes).setup(
+					source.template attribute<I>(0) * inv_w.x, source.template attribute<I>(1) * inv_w.y,
+					source.template attribute<I>(2) * inv_w.z, edges), 0)...};
+			(void)expand;
+		}
+	};
+
+	//! Source of the attributes of three vertices given as tuples
+	template<class VertexType>
+	struct triangle_vertices {
+
+		//! The vertices
+		const VertexType * vertices[3];
+
+		triangle_vertices(const VertexType & v0, const VertexType & v1, const VertexType & v2) {
+			vertices[0] = &v0;
+			vertices[1] = &v1;
+			vertices[2] = &v2;
+		}
+
+		//! Get an attribute of a vertex
+		template<size_t A>
+		inline const typename thrust::tuple_element<A, VertexType>::type & attribute(size_t vertex) const {
+			return thrust::get<A>(*vertices[vertex]);
+		}
+	};
+
+	//! Source of the attributes of three vertices in structure of arrays layout
+	template<class SoaVerticesType>
+	struct triangle_soa_vertices {
+
+		//! The storage of vertices
+		const SoaVerticesType & storage;
+
+		//! The vertices in storage
+		const float * vertices[3];
+
+		triangle_soa_vertices(const SoaVerticesType & _storage, const indices3_t & indices)
+		:
+			storage(_storage)
+		{
+			for(size_t i = 0;i < 3;i++)
+				vertices[i] = storage.vertex_data(indices[i]);
+		}
+
+		//! Get an attribute of a vertex
+		template<size_t A>
+		inline typename thrust::tuple_element<A, typename SoaVerticesType::vertex_type>::type attribute(size_t vertex) const {
+			return storage.template attribute_at<A>(vertices[vertex]);
+		}
+	};
+}
+
+	//! State of a triangle after setup
+	enum class setup_state : unsigned char {
+		rejected,	//!< Triangle is discarded, culled or degenerate
+		visible,	//!< Triangle is setup for rasterization
+		clipped		//!< Triangle crosses a clip plane and is replaced by the clipped ones
+	};
+
+	//! Extent of a triangle in window space, precalculated at setup
+	/**
+	 * It is all that binning reads per triangle, so it is stored
+	 * in an array of its own, next to the triangle setups.
+	 */
+	struct triangle_bounds {
+
+		//! Bounding box in window space (x, y, width, height)
+		glm::vec4 bounding_box;
+
+		//! Minimum and maximum depth of the vertices
+		depth_bounds_t depth_bounds;
+	};
+
+	//! Per triangle data precalculated before rasterization
+	/**
+	 * It is computed once per triangle by the primitive processor
+	 * and holds everything the rasterizer and fragment shaders
+	 * need, so that no vertex is accessed per pixel. It is valid
+	 * only for triangles whose setup_state is visible, the state
+	 * is kept apart so that compaction does not touch setups, and
+	 * the bounds are kept apart so that binning does not either.
+	 * @see triangle_bounds
+	 */
+	template<class VertexType>
+	struct triangle_setup {
+
+		//! Type of vertex
+		typedef VertexType vertex_type;
+
+		//! Type of attribute planes
+		typedef typename details::attribute_planes_of<vertex_type>::type planes_type;
+
+		//! Edge functions of the triangle
+		details::edge_equations edges;
+
+		//! Plane of window space depth
+		attribute_plane<depth_pixel_t> depth;
+
+		//! Plane of 1/w (used only for perspective interpolation)
+		attribute_plane<float> inv_w;
+
+		//! Planes of all vertex attributes
+		/**
+		 * On perspective interpolation these are planes of attribute/w
+		 */
+		planes_type planes;
+	};
+}
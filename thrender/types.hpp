@@ -6,28 +6,78 @@
 namespace thrender {
 
 	//! Type of window dimension size
-	typedef unsigned short window_size_t;
+	typedef boost::uint32_t window_size_t;
 
-	//! Type of vertex id
-	typedef unsigned short vertex_id_t;
+	//! Default type of vertex id
+	/**
+	 * Each renderable type can select its own, see renderable.
+	 */
+	typedef boost::uint32_t vertex_id_t;
+
+	//! Type of primitive id
+	typedef boost::uint32_t primitive_id_t;
+
+	//! Type of the id of a draw, among the draws of an object or a batch
+	typedef boost::uint32_t draw_id_t;
 
 	//! Type of pitch
-	typedef unsigned short pitch_t;
+	typedef boost::uint32_t pitch_t;
+
+	//! Type of clip code, one bit per clip plane
+	typedef boost::uint8_t clip_code_t;
 
 	//! Type of depth pixel
 	typedef float depth_pixel_t;
 
+	//! Minimum and maximum depth of a region of pixels
+	struct depth_bounds_t {
+
+		//! Minimum depth in region
+		depth_pixel_t min;
+
+		//! Maximum depth in region
+		depth_pixel_t max;
+	};
+
 	//! Type of color pixel
 	typedef glm::vec4 color_pixel_t;
 
+	//! Type of visibility pixel, the id of the visible primitive
+	typedef primitive_id_t visibility_pixel_t;
+
 	//! Type of 3 part indices
 	typedef glm::uvec3 indices3_t;
 
+	//! Type of each vertex index of indices3_t
+	/**
+	 * It limits the total vertices of all draws held in one
+	 * intermediate buffer.
+	 */
+	typedef indices3_t::value_type vertex_index_t;
+
 	//! Maximum supported framebuffer height
-	static const size_t max_framebuffer_height = 1024;
+	/**
+	 * Window space coordinates are single precision floats, this
+	 * limit keeps enough sub-pixel precision for rasterization.
+	 */
+	static const size_t max_framebuffer_height = 16384;
 
 	//! Maximum supported framebuffer width
-	static const size_t max_framebuffer_width = 1024;
+	static const size_t max_framebuffer_width = 16384;
+
+	//! Side (in pixels) of the square screen tiles used for binning
+	static const window_size_t tile_size = 64;
+
+	//! Side (in pixels) of the square blocks of the hierarchical depth buffer
+	static const window_size_t hiz_block_size = 8;
+
+	//! Extent of the guard band in normalized device coordinates
+	/**
+	 * Primitives are clipped on x and y only when they exit this
+	 * range, the rest are scissored by the rasterizer. It is kept
+	 * small enough for window space coordinates to stay precise.
+	 */
+	static const float guard_band = 4.0f;
 
 	//! Default clear value for depth framebuffers
 	static const depth_pixel_t default_depth_clear_value = 0;
@@ -35,4 +85,22 @@ namespace thrender {
 	//! Default clear value for color framebuffers
 	static const color_pixel_t default_color_clear_value = color_pixel_t(0.2f, 0.2f, 0.25f, 1.0f);
 
+	//! Default clear value for visibility framebuffers (no primitive)
+	static const visibility_pixel_t default_visibility_clear_value = visibility_pixel_t(-1);
+
+namespace details {
+
+	//! Compile time sequence of indices
+	template<size_t... I>
+	struct index_sequence {};
+
+	//! Generate index_sequence<0, 1, ..., N-1>
+	template<size_t N, size_t... I>
+	struct make_index_sequence : make_index_sequence<N - 1, N - 1, I...> {};
+
+	template<size_t... I>
+	struct make_index_sequence<0, I...> {
+		typedef index_sequence<I...> type;
+	};
+}
 }
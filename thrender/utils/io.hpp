@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../renderable.hpp"
+#include "./mesh_optimizer.hpp"
 #include <assimp/Importer.hpp> // C++ importer interface
 #include <assimp/scene.h> 		// Output data structure
 #include <assimp/postprocess.h> // Post processing flags
@@ -22,9 +23,14 @@ namespace utils {
 	 *  - NORMAL (Homogenous vec4)
 	 *  - COLOR (RGBA vec4)
 	 *  - UV CORDS (vec2)
+	 *
+	 * @param optimize If true, the mesh is optimized for rendering
+	 * with optimize_mesh()
+	 * @param report If not null and mesh is optimized, it gets the
+	 * metrics of optimization
 	 */
 	template<class MeshType>
-	MeshType load_model(const std::string & fname) {
+	MeshType load_model(const std::string & fname, bool optimize = false, mesh_optimization_report * report = 0) {
 		// Create an instance of the Importer class
 		Assimp::Importer importer;
 		const aiScene* scene = importer.ReadFile( fname.c_str(),
@@ -69,6 +75,12 @@ namespace utils {
 			}
 
 		outm.data_updated();
+
+		if (optimize) {
+			mesh_optimization_report optimization = optimize_mesh(outm);
+			if (report)
+				*report = optimization;
+		}
 		return outm;
 	}
 }}
@@ -0,0 +1,431 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include "../renderable.hpp"
+
+namespace thrender {
+namespace utils {
+
+	//! Metrics of a mesh before and after optimization
+	struct mesh_optimization_report {
+
+		//! Number of degenerate and zero area elements that were dropped
+		size_t removed_elements;
+
+		//! Number of vertices that no element references any more
+		size_t removed_vertices;
+
+		//! Average cache miss ratio, vertex misses per element, before
+		double acmr_before;
+
+		//! Average cache miss ratio after
+		double acmr_after;
+
+		//! Fragments that pass the depth test per covered pixel, before
+		double overdraw_before;
+
+		//! Overdraw estimate after
+		double overdraw_after;
+	};
+
+	//! Options of mesh optimization
+	struct mesh_optimization_options {
+
+		//! Size of the simulated FIFO vertex cache
+		size_t cache_size;
+
+		//! Clusters are split where their cache miss ratio is not worse than this factor
+		float overdraw_threshold;
+
+		//! Resolution of the views that overdraw is estimated on
+		size_t overdraw_resolution;
+
+		//! Construct with defaults
+		mesh_optimization_options()
+		:
+			cache_size(16),
+			overdraw_threshold(1.05f),
+			overdraw_resolution(128)
+		{}
+	};
+
+	//! Simulated FIFO cache of processed vertices
+	class vertex_cache_simulator {
+	public:
+
+		//! Construct an empty cache
+		vertex_cache_simulator(size_t total_vertices, size_t cache_size)
+		:
+			m_timestamps(total_vertices, 0),
+			m_time(cache_size + 1),
+			m_cache_size(cache_size)
+		{}
+
+		//! Access a vertex, returns true on a miss
+		inline bool access(size_t vertex) {
+			if (m_time - m_timestamps[vertex] <= m_cache_size)
+				return false;
+			m_timestamps[vertex] = m_time++;
+			return true;
+		}
+
+		//! Count the misses of accessing the vertices of an element
+		inline size_t access(const indices3_t & indices) {
+			return size_t(access(indices.x)) + access(indices.y) + access(indices.z);
+		}
+
+		//! Forget all vertices
+		inline void reset() {
+			m_time += m_cache_size + 1;
+		}
+
+	private:
+
+		//! Time that each vertex entered the cache
+		std::vector<size_t> m_timestamps;
+
+		//! Current time, increased on each miss
+		size_t m_time;
+
+		//! Size of the cache
+		size_t m_cache_size;
+	};
+
+	//! Calculate the average cache miss ratio of elements
+	inline double calculate_acmr(const thrust::host_vector<indices3_t> & indices, size_t total_vertices, size_t cache_size) {
+		if (indices.empty())
+			return 0;
+
+		vertex_cache_simulator cache(total_vertices, cache_size);
+		size_t misses = 0;
+		for(size_t e = 0;e < indices.size();e++)
+			misses += cache.access(indices[e]);
+		return double(misses) / indices.size();
+	}
+
+	//! Estimate overdraw of elements, drawn in order with early depth test
+	/**
+	 * Elements are rasterized from the six axis aligned directions
+	 * around their bounds, with back faces culled.
+	 * @return Fragments that pass the depth test per covered pixel
+	 */
+	template<class RenderableType>
+	double estimate_overdraw(const RenderableType & object, const thrust::host_vector<indices3_t> & indices, size_t resolution) {
+		aabb box;
+		for(size_t v = 0;v < object.vertices.size();v++)
+			box.extend(glm::vec3(VA_ATTRIBUTE(object.vertices[v], POSITION)));
+		if (box.empty())
+			return 0;
+		glm::vec3 extent = box.max - box.min;
+		float scale = float(resolution - 1) / std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+
+		size_t shaded = 0, covered = 0;
+		std::vector<float> depth(resolution * resolution);
+		for(int view = 0;view < 6;view++) {
+			// Viewer looks along -axis, or +axis
+			int axis = view / 2, u_axis = (axis + 1) % 3, v_axis = (axis + 2) % 3;
+			float side = (view % 2) ? -1.0f : 1.0f;
+			std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::max());
+
+			for(size_t e = 0;e < indices.size();e++) {
+				glm::vec3 p[3];
+				for(int i = 0;i < 3;i++)
+					p[i] = (glm::vec3(VA_ATTRIBUTE(object.vertices[indices[e][i]], POSITION)) - box.min) * scale;
+
+				// Back faces point away from viewer
+				glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+				float facing = n[axis] * side;
+				if (facing <= 0)
+					continue;
+
+				float x[3], y[3], z[3];
+				for(int i = 0;i < 3;i++) {
+					x[i] = p[i][u_axis];
+					y[i] = p[i][v_axis];
+					z[i] = -side * p[i][axis];
+				}
+				float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+				if (area == 0)
+					continue;
+
+				int min_x = std::max(0, int(std::min(std::min(x[0], x[1]), x[2])));
+				int max_x = std::min(int(resolution) - 1, int(std::max(std::max(x[0], x[1]), x[2])) + 1);
+				int min_y = std::max(0, int(std::min(std::min(y[0], y[1]), y[2])));
+				int max_y = std::min(int(resolution) - 1, int(std::max(std::max(y[0], y[1]), y[2])) + 1);
+				for(int py = min_y;py <= max_y;py++) {
+					for(int px = min_x;px <= max_x;px++) {
+						float cx = px + 0.5f, cy = py + 0.5f;
+						float w0 = ((x[2] - x[1]) * (cy - y[1]) - (cx - x[1]) * (y[2] - y[1])) / area;
+						float w1 = ((x[0] - x[2]) * (cy - y[2]) - (cx - x[2]) * (y[0] - y[2])) / area;
+						float w2 = 1.0f - w0 - w1;
+						if (w0 < 0 || w1 < 0 || w2 < 0)
+							continue;
+
+						float z_pixel = w0 * z[0] + w1 * z[1] + w2 * z[2];
+						float & z_stored = depth[py * resolution + px];
+						if (z_pixel < z_stored) {
+							if (z_stored == std::numeric_limits<float>::max())
+								covered++;
+							z_stored = z_pixel;
+							shaded++;
+						}
+					}
+				}
+			}
+		}
+		return covered ? double(shaded) / covered : 0;
+	}
+
+	//! Reorder elements for vertex locality
+	/**
+	 * Implements Tipsify, from "Fast Triangle Reordering for Vertex
+	 * Locality and Reduced Overdraw" (Sander et al. 2007). Elements
+	 * are emitted in fans around vertices, choosing next the vertex
+	 * that will still be in cache.
+	 */
+	inline thrust::host_vector<indices3_t> optimize_vertex_cache(const thrust::host_vector<indices3_t> & indices,
+			size_t total_vertices, size_t cache_size) {
+		const size_t total_elements = indices.size();
+
+		// Elements that reference each vertex
+		std::vector<size_t> adjacency_offsets(total_vertices + 1, 0);
+		std::vector<size_t> adjacency(3 * total_elements);
+		for(size_t e = 0;e < total_elements;e++) {
+			for(int i = 0;i < 3;i++)
+				adjacency_offsets[indices[e][i] + 1]++;
+		}
+		for(size_t v = 0;v < total_vertices;v++)
+			adjacency_offsets[v + 1] += adjacency_offsets[v];
+		std::vector<size_t> live(total_vertices);
+		for(size_t v = 0;v < total_vertices;v++)
+			live[v] = adjacency_offsets[v + 1] - adjacency_offsets[v];
+		std::vector<size_t> adjacency_fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+		for(size_t e = 0;e < total_elements;e++) {
+			for(int i = 0;i < 3;i++)
+				adjacency[adjacency_fill[indices[e][i]]++] = e;
+		}
+
+		thrust::host_vector<indices3_t> out;
+		out.reserve(total_elements);
+		std::vector<bool> emitted(total_elements, false);
+		std::vector<size_t> timestamps(total_vertices, 0);
+		std::vector<size_t> dead_ends;
+		std::vector<size_t> candidates;
+		size_t time = cache_size + 1;
+		size_t cursor = 0;
+
+		// Fanning vertex, total_vertices when done
+		size_t fanning = 0;
+		while(fanning < total_vertices && live[fanning] == 0)
+			fanning++;
+
+		while(fanning < total_vertices) {
+			candidates.clear();
+			for(size_t a = adjacency_offsets[fanning];a < adjacency_offsets[fanning + 1];a++) {
+				size_t e = adjacency[a];
+				if (emitted[e])
+					continue;
+
+				for(int i = 0;i < 3;i++) {
+					size_t v = indices[e][i];
+					dead_ends.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - timestamps[v] > cache_size)
+						timestamps[v] = time++;
+				}
+				emitted[e] = true;
+				out.push_back(indices[e]);
+			}
+
+			// Candidate that will still be in cache after its fan
+			size_t next = total_vertices;
+			size_t best_priority = 0;
+			for(size_t c = 0;c < candidates.size();c++) {
+				size_t v = candidates[c];
+				if (live[v] == 0)
+					continue;
+				size_t priority = 0;
+				if (time - timestamps[v] + 2 * live[v] <= cache_size)
+					priority = time - timestamps[v];
+				if (next == total_vertices || priority > best_priority) {
+					best_priority = priority;
+					next = v;
+				}
+			}
+
+			// Dead end, pick a recent vertex or the next in order
+			while(next == total_vertices && !dead_ends.empty()) {
+				size_t v = dead_ends.back();
+				dead_ends.pop_back();
+				if (live[v] > 0)
+					next = v;
+			}
+			while(next == total_vertices && cursor < total_vertices) {
+				if (live[cursor] > 0)
+					next = cursor;
+				cursor++;
+			}
+			fanning = next;
+		}
+		return out;
+	}
+
+	//! Reorder clusters of elements so that outer faces are drawn first
+	/**
+	 * Elements must be already ordered for vertex locality. They are
+	 * split in clusters where the cache restarts or the miss ratio of
+	 * the cluster is close enough to the one of the whole cluster, then
+	 * clusters are sorted by how much they face away from the center
+	 * of the mesh, which approximates front to back order for any
+	 * view. From Sander et al. 2007, as well.
+	 */
+	template<class RenderableType>
+	thrust::host_vector<indices3_t> optimize_overdraw(const RenderableType & object, const thrust::host_vector<indices3_t> & indices,
+			size_t cache_size, float threshold) {
+		const size_t total_elements = indices.size();
+		if (total_elements == 0)
+			return indices;
+
+		// Hard boundaries, where all vertices of an element miss the cache
+		std::vector<size_t> hard_boundaries;
+		vertex_cache_simulator cache(object.vertices.size(), cache_size);
+		for(size_t e = 0;e < total_elements;e++) {
+			if (cache.access(indices[e]) == 3 || e == 0)
+				hard_boundaries.push_back(e);
+		}
+		hard_boundaries.push_back(total_elements);
+
+		// Soft boundaries, where the cluster so far is not worse than the whole cluster
+		std::vector<size_t> boundaries;
+		for(size_t h = 0;h + 1 < hard_boundaries.size();h++) {
+			size_t first = hard_boundaries[h], last = hard_boundaries[h + 1];
+			cache.reset();
+			size_t cluster_misses = 0;
+			for(size_t e = first;e < last;e++)
+				cluster_misses += cache.access(indices[e]);
+			float cluster_threshold = threshold * float(cluster_misses) / (last - first);
+
+			cache.reset();
+			size_t start = first, misses = 0;
+			boundaries.push_back(first);
+			for(size_t e = first;e < last;e++) {
+				misses += cache.access(indices[e]);
+				if (e + 1 < last && float(misses) / (e + 1 - start) <= cluster_threshold) {
+					start = e + 1;
+					misses = 0;
+					boundaries.push_back(start);
+					cache.reset();
+				}
+			}
+		}
+		boundaries.push_back(total_elements);
+
+		// Area weighted centroid of mesh and of each cluster
+		size_t total_clusters = boundaries.size() - 1;
+		std::vector<glm::vec3> centroids(total_clusters, glm::vec3(0.0f));
+		std::vector<glm::vec3> normals(total_clusters, glm::vec3(0.0f));
+		std::vector<float> areas(total_clusters, 0.0f);
+		glm::vec3 mesh_centroid(0.0f);
+		float mesh_area = 0;
+		for(size_t c = 0;c < total_clusters;c++) {
+			for(size_t e = boundaries[c];e < boundaries[c + 1];e++) {
+				glm::vec3 p0(VA_ATTRIBUTE(object.vertices[indices[e].x], POSITION));
+				glm::vec3 p1(VA_ATTRIBUTE(object.vertices[indices[e].y], POSITION));
+				glm::vec3 p2(VA_ATTRIBUTE(object.vertices[indices[e].z], POSITION));
+				glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+				float area = glm::length(n);
+				centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+				normals[c] += n;
+				areas[c] += area;
+			}
+			mesh_centroid += centroids[c];
+			mesh_area += areas[c];
+			if (areas[c] > 0)
+				centroids[c] /= areas[c];
+		}
+		if (mesh_area > 0)
+			mesh_centroid /= mesh_area;
+
+		std::vector<std::pair<float, size_t> > order(total_clusters);
+		for(size_t c = 0;c < total_clusters;c++) {
+			float length = glm::length(normals[c]);
+			float facing = length > 0 ? glm::dot(centroids[c] - mesh_centroid, normals[c] / length) : 0;
+			order[c] = std::make_pair(-facing, c);
+		}
+		std::stable_sort(order.begin(), order.end());
+
+		thrust::host_vector<indices3_t> out;
+		out.reserve(total_elements);
+		for(size_t c = 0;c < total_clusters;c++) {
+			size_t cluster = order[c].second;
+			for(size_t e = boundaries[cluster];e < boundaries[cluster + 1];e++)
+				out.push_back(indices[e]);
+		}
+		return out;
+	}
+
+	//! Optimize an object for rendering
+	/**
+	 * Degenerate and zero area elements are dropped, elements are
+	 * reordered for vertex locality and lower overdraw, and then
+	 * vertices are renumbered in the order elements first use them.
+	 * Vertices that no element uses are dropped. It is meant to run
+	 * once after loading, as elements and vertices are rewritten.
+	 */
+	template<class RenderableType>
+	mesh_optimization_report optimize_mesh(RenderableType & object,
+			const mesh_optimization_options & options = mesh_optimization_options()) {
+		typedef typename RenderableType::vertex_array_type::vertices_type vertices_type;
+		mesh_optimization_report report;
+		report.acmr_before = calculate_acmr(object.element_indices, object.vertices.size(), options.cache_size);
+		report.overdraw_before = estimate_overdraw(object, object.element_indices, options.overdraw_resolution);
+
+		// Drop degenerate elements
+		thrust::host_vector<indices3_t> indices;
+		indices.reserve(object.element_indices.size());
+		for(size_t e = 0;e < object.element_indices.size();e++) {
+			const indices3_t & tr = object.element_indices[e];
+			if (tr.x == tr.y || tr.y == tr.z || tr.z == tr.x)
+				continue;
+			glm::vec3 p0(VA_ATTRIBUTE(object.vertices[tr.x], POSITION));
+			glm::vec3 p1(VA_ATTRIBUTE(object.vertices[tr.y], POSITION));
+			glm::vec3 p2(VA_ATTRIBUTE(object.vertices[tr.z], POSITION));
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			if (n.x == 0 && n.y == 0 && n.z == 0)
+				continue;
+			indices.push_back(tr);
+		}
+		report.removed_elements = object.element_indices.size() - indices.size();
+
+		indices = optimize_vertex_cache(indices, object.vertices.size(), options.cache_size);
+		indices = optimize_overdraw(object, indices, options.cache_size, options.overdraw_threshold);
+
+		// Renumber vertices in order of first use
+		const size_t unused = std::numeric_limits<size_t>::max();
+		std::vector<size_t> remap(object.vertices.size(), unused);
+		vertices_type vertices;
+		vertices.reserve(object.vertices.size());
+		for(size_t e = 0;e < indices.size();e++) {
+			for(int i = 0;i < 3;i++) {
+				size_t & v = remap[indices[e][i]];
+				if (v == unused) {
+					v = vertices.size();
+					vertices.push_back(object.vertices[indices[e][i]]);
+				}
+				indices[e][i] = v;
+			}
+		}
+		report.removed_vertices = object.vertices.size() - vertices.size();
+
+		object.vertices = vertices;
+		object.element_indices = indices;
+		object.data_updated();
+
+		report.acmr_after = calculate_acmr(object.element_indices, object.vertices.size(), options.cache_size);
+		report.overdraw_after = estimate_overdraw(object, object.element_indices, options.overdraw_resolution);
+		return report;
+	}
+}}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "../renderable.hpp"
+
+namespace thrender {
+namespace utils {
+
+	//! Count the distinct vertices of an element that are not in a meshlet
+	/**
+	 * @param local Output index of vertices, negative if not in meshlet
+	 */
+	inline size_t count_new_vertices(const indices3_t & indices, const std::vector<boost::int64_t> & local) {
+		size_t new_vertices = 0;
+		for(int i = 0;i < 3;i++) {
+			bool repeated = (i > 0 && indices[i] == indices[0]) || (i > 1 && indices[i] == indices[1]);
+			if (local[indices[i]] < 0 && !repeated)
+				new_vertices++;
+		}
+		return new_vertices;
+	}
+
+	//! Partition an object in meshlets
+	/**
+	 * Meshlets are grown greedily from a seed element, adding next
+	 * the adjacent element that brings the fewest new vertices, until
+	 * a limit would be exceeded. Elements are rewritten in meshlet
+	 * order and vertices of each meshlet are copied to a consecutive
+	 * range, so vertices shared by neighbour meshlets are duplicated.
+	 * It is meant to run once after loading.
+	 *
+	 * @param max_vertices Maximum vertices per meshlet
+	 * @param max_elements Maximum elements per meshlet
+	 */
+	template<class RenderableType>
+	void build_meshlets(RenderableType & object, size_t max_vertices = 64, size_t max_elements = 128) {
+		typedef typename RenderableType::vertex_array_type::vertices_type vertices_type;
+		const size_t total_vertices = object.vertices.size();
+		const size_t total_elements = object.element_indices.size();
+
+		// Elements that reference each vertex
+		std::vector<size_t> adjacency_offsets(total_vertices + 1, 0);
+		std::vector<size_t> adjacency(3 * total_elements);
+		for(size_t e = 0;e < total_elements;e++) {
+			for(int i = 0;i < 3;i++)
+				adjacency_offsets[object.element_indices[e][i] + 1]++;
+		}
+		for(size_t v = 0;v < total_vertices;v++)
+			adjacency_offsets[v + 1] += adjacency_offsets[v];
+		std::vector<size_t> adjacency_fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+		for(size_t e = 0;e < total_elements;e++) {
+			for(int i = 0;i < 3;i++)
+				adjacency[adjacency_fill[object.element_indices[e][i]]++] = e;
+		}
+
+		vertices_type out_vertices;
+		thrust::host_vector<indices3_t> out_indices;
+		out_vertices.reserve(total_vertices);
+		out_indices.reserve(total_elements);
+
+		meshlets_type meshlets;
+		meshlet current = meshlet();
+
+		// Output index of input vertices that are in current meshlet
+		std::vector<boost::int64_t> local(total_vertices, -1);
+		std::vector<size_t> local_sources;
+		std::vector<bool> used(total_elements, false);
+		std::vector<size_t> candidates;
+		size_t next_unused = 0;
+
+		for(size_t emitted = 0;emitted < total_elements;emitted++) {
+
+			// Adjacent element with the fewest new vertices
+			size_t best = total_elements, best_new_vertices = 4;
+			for(size_t c = 0;c < candidates.size();c++) {
+				size_t e = candidates[c];
+				if (used[e])
+					continue;
+				size_t new_vertices = count_new_vertices(object.element_indices[e], local);
+				if (new_vertices < best_new_vertices) {
+					best = e;
+					best_new_vertices = new_vertices;
+				}
+			}
+
+			bool full = current.element_count == max_elements
+				|| (best != total_elements && current.vertex_count + best_new_vertices > max_vertices);
+			if (best == total_elements || full) {
+				while(used[next_unused])
+					next_unused++;
+				best = next_unused;
+				best_new_vertices = count_new_vertices(object.element_indices[best], local);
+				full = full || current.vertex_count + best_new_vertices > max_vertices;
+			}
+
+			if (full) {
+				meshlets.push_back(current);
+				for(size_t i = 0;i < local_sources.size();i++)
+					local[local_sources[i]] = -1;
+				local_sources.clear();
+				candidates.clear();
+				current = meshlet();
+				current.first_vertex = out_vertices.size();
+				current.first_element = out_indices.size();
+			}
+
+			const indices3_t & indices = object.element_indices[best];
+			indices3_t remapped;
+			for(int i = 0;i < 3;i++) {
+				if (local[indices[i]] < 0) {
+					local[indices[i]] = out_vertices.size();
+					local_sources.push_back(indices[i]);
+					out_vertices.push_back(object.vertices[indices[i]]);
+					current.vertex_count++;
+
+					for(size_t a = adjacency_offsets[indices[i]];a < adjacency_offsets[indices[i] + 1];a++) {
+						if (!used[adjacency[a]])
+							candidates.push_back(adjacency[a]);
+					}
+				}
+				remapped[i] = local[indices[i]];
+			}
+			used[best] = true;
+			out_indices.push_back(remapped);
+			current.element_count++;
+		}
+		if (current.element_count)
+			meshlets.push_back(current);
+
+		object.vertices = out_vertices;
+		object.element_indices = out_indices;
+		object.data_updated();
+
+		for(size_t i = 0;i < meshlets.size();i++)
+			calculate_meshlet_bounds(object, meshlets[i]);
+		object.set_meshlets(meshlets);
+	}
+}}
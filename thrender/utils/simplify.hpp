@@ -0,0 +1,363 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <map>
+#include <algorithm>
+#include <cmath>
+#include "../renderable.hpp"
+#include "../lod.hpp"
+
+namespace thrender {
+namespace utils {
+
+	//! Quadric of squared distances to a set of planes
+	struct quadric {
+
+		//! Upper triangle of the symmetric 4x4 matrix
+		double m[10];
+
+		//! Construct a zero quadric
+		quadric() {
+			std::fill(m, m + 10, 0.0);
+		}
+
+		//! Construct the quadric of a plane, n.p + d = 0, with a weight
+		quadric(const glm::vec3 & n, float d, float weight) {
+			double a = n.x, b = n.y, c = n.z, w = weight;
+			m[0] = w * a * a; m[1] = w * a * b; m[2] = w * a * c; m[3] = w * a * d;
+			m[4] = w * b * b; m[5] = w * b * c; m[6] = w * b * d;
+			m[7] = w * c * c; m[8] = w * c * d;
+			m[9] = w * d * d;
+		}
+
+		inline quadric & operator+=(const quadric & rv) {
+			for(int i = 0;i < 10;i++)
+				m[i] += rv.m[i];
+			return *this;
+		}
+
+		//! Sum of weighted squared distances of a point
+		inline double evaluate(const glm::vec3 & p) const {
+			double x = p.x, y = p.y, z = p.z;
+			double r = m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x
+				+ m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y
+				+ m[7] * z * z + 2 * m[8] * z
+				+ m[9];
+			return std::max(r, 0.0);
+		}
+	};
+
+	//! A collapse of a vertex into another
+	struct collapse_candidate {
+
+		//! Error of collapse
+		double cost;
+
+		//! Vertex that is removed
+		size_t from;
+
+		//! Vertex that from is merged into
+		size_t to;
+
+		//! Versions of vertices when the collapse was evaluated
+		size_t from_version, to_version;
+
+		//! Order by cost, cheapest first in a priority queue
+		inline bool operator<(const collapse_candidate & rv) const {
+			return cost > rv.cost;
+		}
+	};
+
+	//! Lexicographic order of vertices by position
+	struct position_less {
+
+		const std::vector<glm::vec3> & positions;
+
+		position_less(const std::vector<glm::vec3> & _positions)
+		:
+			positions(_positions)
+		{}
+
+		inline bool operator()(size_t a, size_t b) const {
+			const glm::vec3 & pa = positions[a], & pb = positions[b];
+			if (pa.x != pb.x) return pa.x < pb.x;
+			if (pa.y != pb.y) return pa.y < pb.y;
+			return pa.z < pb.z;
+		}
+	};
+
+	//! Queue the cheapest collapse of an edge
+	inline void push_collapses(std::priority_queue<collapse_candidate> & candidates, size_t a, size_t b,
+			const std::vector<quadric> & quadrics, const std::vector<glm::vec3> & positions,
+			const std::vector<bool> & locked, const std::vector<size_t> & versions) {
+		quadric q = quadrics[a];
+		q += quadrics[b];
+
+		collapse_candidate c;
+		c.cost = -1;
+		if (!locked[a]) {
+			c.cost = q.evaluate(positions[b]);
+			c.from = a;
+			c.to = b;
+		}
+		if (!locked[b]) {
+			double cost = q.evaluate(positions[a]);
+			if (c.cost < 0 || cost < c.cost) {
+				c.cost = cost;
+				c.from = b;
+				c.to = a;
+			}
+		}
+		if (c.cost < 0)
+			return;
+		c.from_version = versions[c.from];
+		c.to_version = versions[c.to];
+		candidates.push(c);
+	}
+
+	//! Simplify an object by collapsing edges
+	/**
+	 * Implements quadric error simplification (Garland and Heckbert
+	 * 1997) with half-edge collapses, so that vertices keep their
+	 * attributes. Borders are preserved with planes perpendicular to
+	 * their faces, and vertices whose position is shared by other
+	 * vertices (seams of attributes) are never removed.
+	 *
+	 * @param object The object to simplify
+	 * @param target_elements Number of elements to stop at
+	 * @param error Set to the maximum distance of a vertex that
+	 * collapses moved from the planes of the original elements and
+	 * borders that were merged into it (Object-Space). Collapse costs
+	 * are weighted sums of squared distances, which are only used to
+	 * order collapses.
+	 * @return The simplified object, vertices that are no longer used
+	 * are dropped.
+	 */
+	template<class RenderableType>
+	RenderableType simplify_mesh(const RenderableType & object, size_t target_elements, float & error) {
+		const size_t total_vertices = object.vertices.size();
+		const size_t total_elements = object.element_indices.size();
+		std::vector<glm::vec3> positions(total_vertices);
+		for(size_t v = 0;v < total_vertices;v++)
+			positions[v] = glm::vec3(VA_ATTRIBUTE(object.vertices[v], POSITION));
+
+		std::vector<indices3_t> elements(object.element_indices.begin(), object.element_indices.end());
+		std::vector<bool> alive(total_elements, true);
+		std::vector<std::vector<size_t> > adjacency(total_vertices);
+		std::vector<quadric> quadrics(total_vertices);
+
+		// Planes of elements and borders, n.p + d = 0 as (n, d)
+		std::vector<glm::vec4> planes;
+		std::vector<std::vector<size_t> > vertex_planes(total_vertices);
+		size_t alive_elements = 0;
+		for(size_t e = 0;e < total_elements;e++) {
+			const indices3_t & tr = elements[e];
+			glm::vec3 n = glm::cross(positions[tr.y] - positions[tr.x], positions[tr.z] - positions[tr.x]);
+			float length = glm::length(n);
+			if (tr.x == tr.y || tr.y == tr.z || tr.z == tr.x || length == 0) {
+				alive[e] = false;
+				continue;
+			}
+			n /= length;
+			quadric q(n, -glm::dot(n, positions[tr.x]), 1.0f);
+			planes.push_back(glm::vec4(n, -glm::dot(n, positions[tr.x])));
+			for(int i = 0;i < 3;i++) {
+				quadrics[tr[i]] += q;
+				adjacency[tr[i]].push_back(e);
+				vertex_planes[tr[i]].push_back(planes.size() - 1);
+			}
+			alive_elements++;
+		}
+
+		// Borders are edges of only one element
+		std::map<std::pair<size_t, size_t>, int> edge_uses;
+		for(size_t e = 0;e < total_elements;e++) {
+			if (!alive[e])
+				continue;
+			for(int i = 0;i < 3;i++) {
+				size_t a = elements[e][i], b = elements[e][(i + 1) % 3];
+				edge_uses[std::make_pair(std::min(a, b), std::max(a, b))]++;
+			}
+		}
+		const float border_weight = 10.0f;
+		for(size_t e = 0;e < total_elements;e++) {
+			if (!alive[e])
+				continue;
+			const indices3_t & tr = elements[e];
+			glm::vec3 n = glm::normalize(glm::cross(positions[tr.y] - positions[tr.x], positions[tr.z] - positions[tr.x]));
+			for(int i = 0;i < 3;i++) {
+				size_t a = tr[i], b = tr[(i + 1) % 3];
+				if (edge_uses[std::make_pair(std::min(a, b), std::max(a, b))] != 1)
+					continue;
+				glm::vec3 edge = positions[b] - positions[a];
+				float length = glm::length(edge);
+				if (length == 0)
+					continue;
+				glm::vec3 side = glm::normalize(glm::cross(edge, n));
+				quadric q(side, -glm::dot(side, positions[a]), border_weight);
+				quadrics[a] += q;
+				quadrics[b] += q;
+				planes.push_back(glm::vec4(side, -glm::dot(side, positions[a])));
+				vertex_planes[a].push_back(planes.size() - 1);
+				vertex_planes[b].push_back(planes.size() - 1);
+			}
+		}
+
+		// Vertices that share their position with others are locked
+		std::vector<bool> locked(total_vertices, false);
+		{
+			std::vector<size_t> sorted(total_vertices);
+			for(size_t v = 0;v < total_vertices;v++)
+				sorted[v] = v;
+			std::sort(sorted.begin(), sorted.end(), position_less(positions));
+			for(size_t i = 1;i < total_vertices;i++) {
+				if (positions[sorted[i]] == positions[sorted[i - 1]])
+					locked[sorted[i]] = locked[sorted[i - 1]] = true;
+			}
+		}
+
+		// Queue of collapses, stale entries are detected by versions
+		std::vector<size_t> versions(total_vertices, 0);
+		std::priority_queue<collapse_candidate> candidates;
+		for(size_t e = 0;e < total_elements;e++) {
+			if (!alive[e])
+				continue;
+			for(int i = 0;i < 3;i++)
+				push_collapses(candidates, elements[e][i], elements[e][(i + 1) % 3], quadrics, positions, locked, versions);
+		}
+
+		float max_distance = 0;
+		std::vector<size_t> neighbours;
+		while(alive_elements > target_elements && !candidates.empty()) {
+			collapse_candidate c = candidates.top();
+			candidates.pop();
+			if (c.from_version != versions[c.from] || c.to_version != versions[c.to])
+				continue;
+
+			// Reject collapses that flip an element
+			bool flips = false;
+			for(size_t a = 0;a < adjacency[c.from].size() && !flips;a++) {
+				size_t e = adjacency[c.from][a];
+				const indices3_t & tr = elements[e];
+				if (!alive[e] || tr.x == c.to || tr.y == c.to || tr.z == c.to)
+					continue;
+				glm::vec3 p[3], moved[3];
+				for(int i = 0;i < 3;i++) {
+					p[i] = moved[i] = positions[tr[i]];
+					if (tr[i] == c.from)
+						moved[i] = positions[c.to];
+				}
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+				flips = glm::dot(before, after) <= 0;
+			}
+			if (flips)
+				continue;
+
+			// Collapse from into to
+			quadrics[c.to] += quadrics[c.from];
+
+			// Distance of the merged vertex from the planes of both
+			std::vector<size_t> & merged = vertex_planes[c.to];
+			merged.insert(merged.end(), vertex_planes[c.from].begin(), vertex_planes[c.from].end());
+			std::sort(merged.begin(), merged.end());
+			merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+			std::vector<size_t>().swap(vertex_planes[c.from]);
+			for(size_t i = 0;i < merged.size();i++) {
+				const glm::vec4 & plane = planes[merged[i]];
+				max_distance = std::max(max_distance, std::fabs(glm::dot(glm::vec3(plane), positions[c.to]) + plane.w));
+			}
+
+			for(size_t a = 0;a < adjacency[c.from].size();a++) {
+				size_t e = adjacency[c.from][a];
+				if (!alive[e])
+					continue;
+				indices3_t & tr = elements[e];
+				if (tr.x == c.to || tr.y == c.to || tr.z == c.to) {
+					alive[e] = false;
+					alive_elements--;
+					continue;
+				}
+				for(int i = 0;i < 3;i++) {
+					if (tr[i] == c.from)
+						tr[i] = c.to;
+				}
+				adjacency[c.to].push_back(e);
+			}
+			adjacency[c.from].clear();
+			versions[c.from]++;
+			versions[c.to]++;
+
+			// Update collapses around the vertex
+			neighbours.clear();
+			for(size_t a = 0;a < adjacency[c.to].size();a++) {
+				size_t e = adjacency[c.to][a];
+				if (!alive[e])
+					continue;
+				for(int i = 0;i < 3;i++) {
+					if (elements[e][i] != c.to)
+						neighbours.push_back(elements[e][i]);
+				}
+			}
+			std::sort(neighbours.begin(), neighbours.end());
+			neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+			for(size_t n = 0;n < neighbours.size();n++)
+				push_collapses(candidates, c.to, neighbours[n], quadrics, positions, locked, versions);
+		}
+		error = max_distance;
+
+		// Compact elements and vertices that are still used
+		const size_t unused = size_t(-1);
+		std::vector<size_t> remap(total_vertices, unused);
+		size_t used_vertices = 0;
+		for(size_t e = 0;e < total_elements;e++) {
+			if (!alive[e])
+				continue;
+			for(int i = 0;i < 3;i++) {
+				if (remap[elements[e][i]] == unused)
+					remap[elements[e][i]] = used_vertices++;
+			}
+		}
+
+		RenderableType simplified(used_vertices, alive_elements);
+		for(size_t v = 0;v < total_vertices;v++) {
+			if (remap[v] != unused)
+				simplified.vertices[remap[v]] = object.vertices[v];
+		}
+		size_t out_element = 0;
+		for(size_t e = 0;e < total_elements;e++) {
+			if (alive[e])
+				simplified.element_indices[out_element++] = indices3_t(remap[elements[e].x], remap[elements[e].y], remap[elements[e].z]);
+		}
+		simplified.data_updated();
+		return simplified;
+	}
+
+	//! Build a chain of simplified levels of an object
+	/**
+	 * Each level has a fraction of the elements of the previous one.
+	 * Simplification stops early if a level cannot be reduced further.
+	 *
+	 * @param levels Maximum number of levels after the object itself
+	 * @param reduction Elements of each level relative to the previous
+	 */
+	template<class RenderableType>
+	lod_chain<RenderableType> build_lod_chain(RenderableType & object, size_t levels = 4, float reduction = 0.5f) {
+		lod_chain<RenderableType> chain(object);
+		float total_error = 0;
+		for(size_t l = 1;l <= levels;l++) {
+			RenderableType & previous = chain.level(chain.size() - 1);
+			size_t target = size_t(previous.element_indices.size() * reduction);
+			float error;
+			RenderableType simplified = simplify_mesh(previous, target, error);
+			if (simplified.element_indices.size() >= previous.element_indices.size() || simplified.element_indices.empty())
+				break;
+
+			// Errors of levels accumulate
+			total_error += error;
+			chain.add_level(simplified, total_error);
+		}
+		return chain;
+	}
+}}
@@ -1,18 +1,27 @@
 #pragma once
 
 #include "../renderable.hpp"
+#include "./mesh_optimizer.hpp"
 #include <sstream>
 #include <glm/gtx/string_cast.hpp>
 
 namespace thrender {
 namespace utils {
 
-	template<class A>
-	inline std::string to_string(const renderable<A> & m) {
+	template<class A, class I>
+	inline std::string to_string(const renderable<A, I> & m) {
 		std::stringstream ss;
 		ss << "Renderable[Vertices: " << m.vertices.size() << ", Triangles:" << m.element_indices.size() << "]";
 		return ss.str();
 	}
 
+	inline std::string to_string(const mesh_optimization_report & r) {
+		std::stringstream ss;
+		ss << "MeshOptimization[Removed triangles: " << r.removed_elements << ", Removed vertices: " << r.removed_vertices
+			<< ", ACMR: " << r.acmr_before << " -> " << r.acmr_after
+			<< ", Overdraw: " << r.overdraw_before << " -> " << r.overdraw_after << "]";
+		return ss.str();
+	}
+
 
 }}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <type_traits>
+#include <thrust/tuple.h>
+#include "./types.hpp"
+#include "./vertex_array.hpp"
+
+namespace thrender {
+
+	//! Declaration of the attributes that a vertex shader outputs
+	/**
+	 * A vertex shader declares the attributes that fragment shaders
+	 * read with a typedef, e.g. typedef varyings<COLOR> varyings_type.
+	 * Only POSITION, which is always implied, and the declared
+	 * attributes are stored in processed vertices and interpolated
+	 * over primitives. Other attributes are not stored at all, and
+	 * interpolating them in a fragment shader fails an assertion on
+	 * debug builds.
+	 *
+	 * The output vertex of a shader with a declaration starts
+	 * uninitialized, so the shader must write every attribute it
+	 * outputs, copying those it passes through. Shaders without a
+	 * declaration output all attributes, starting from a copy of
+	 * the input vertex.
+	 */
+	template<size_t... Attributes>
+	struct varyings {
+
+		//! Sequence of declared attributes
+		typedef details::index_sequence<Attributes...> indices_type;
+	};
+
+namespace details {
+
+	//! Sequence of all attributes of a vertex type
+	template<class VertexType>
+	struct all_attributes {
+		typedef typename make_index_sequence<thrust::tuple_size<VertexType>::value>::type type;
+	};
+
+	//! Check if a shader declares its varyings
+	template<class Shader>
+	struct has_varyings {
+
+		template<class S>
+		static std::true_type test(int, typename S::varyings_type * = 0);
+
+		template<class S>
+		static std::false_type test(...);
+
+		//! std::true_type if the declaration exists
+		typedef decltype(test<Shader>(0)) type;
+
+		static const bool value = type::value;
+	};
+
+	template<size_t First, class Indices>
+	struct prepend_index;
+
+	template<size_t First, size_t... I>
+	struct prepend_index<First, index_sequence<I...> > {
+		typedef index_sequence<First, I...> type;
+	};
+
+	//! Attributes of processed vertices that a vertex shader outputs
+	template<class Shader, class VertexType, class HasVaryings = typename has_varyings<Shader>::type>
+	struct output_attributes {
+		typedef typename all_attributes<VertexType>::type type;
+	};
+
+	template<class Shader, class VertexType>
+	struct output_attributes<Shader, VertexType, std::true_type> {
+		typedef typename prepend_index<POSITION, typename Shader::varyings_type::indices_type>::type type;
+	};
+
+	//! Attributes that are copied from the input vertex before a vertex shader runs
+	/**
+	 * All of them for shaders without declared varyings, none for
+	 * the others, which write all of their outputs.
+	 */
+	template<class Shader, class VertexType, class HasVaryings = typename has_varyings<Shader>::type>
+	struct pass_through_attributes {
+		typedef typename all_attributes<VertexType>::type type;
+	};
+
+	template<class Shader, class VertexType>
+	struct pass_through_attributes<Shader, VertexType, std::true_type> {
+		typedef index_sequence<> type;
+	};
+
+	//! Get the bit mask of a set of attributes
+	template<size_t... I>
+	inline size_t attribute_mask(index_sequence<I...>) {
+		size_t mask = 0;
+		int expand[] = {0, (mask |= size_t(1) << I, 0)...};
+		(void)expand;
+		return mask;
+	}
+
+	//! Copy a set of attributes between vertices
+	template<class Indices>
+	struct copy_attributes;
+
+	template<size_t... I>
+	struct copy_attributes<index_sequence<I...> > {
+
+		//! Copy attributes of a vertex or of a packet of vertices
+		template<class VertexType>
+		static inline void copy(const VertexType & in, VertexType & out) {
+			int expand[] = {0, (thrust::get<I>(out) = thrust::get<I>(in), 0)...};
+			(void)expand;
+		}
+	};
+}
+}
@@ -1,11 +1,280 @@
 #pragma once
 
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <thrust/host_vector.h>
 #include <thrust/tuple.h>
+#include "./types.hpp"
+#include "./simd.hpp"
 
 
 namespace thrender {
+namespace details {
+
+	//! Vertices in structure of arrays layout, blocked per packet
+	/**
+	 * Vertices are kept in blocks of one packet. A block holds the
+	 * lanes of every scalar component of the stored attributes one
+	 * after the other, so packets of consecutive vertices are loaded
+	 * and stored with one aligned vector access per component, while
+	 * the attributes of one vertex are still a few cache lines apart
+	 * for the stages that read them per triangle. Only the attributes
+	 * given to resize() are stored, size is padded to whole packets.
+	 */
+	template<class VertexType,
+		class Indices = typename make_index_sequence<thrust::tuple_size<VertexType>::value>::type>
+	struct soa_vertices;
+
+	template<class VertexType, size_t... I>
+	struct soa_vertices<VertexType, index_sequence<I...> > {
+
+		//! Type of vertex
+		typedef VertexType vertex_type;
+
+		//! Number of vertices per packet
+		static const size_t lanes = simd::float4::lanes;
+
+		//! Type of a packet of vertices, one soa per attribute
+		typedef thrust::tuple< simd::soa< typename thrust::tuple_element<I, vertex_type>::type >... > packet_type;
+
+		//! Type of the storage of all blocks
+		typedef thrust::host_vector<float, simd::aligned_allocator<float> > data_type;
+
+		//! Construct empty
+		soa_vertices()
+		:
+			m_size(0),
+			m_stride(0)
+		{
+			clear_offsets();
+		}
+
+		//! Get the number of vertices
+		inline size_t size() const {
+			return m_size;
+		}
+
+		//! Get the number of packets that cover all vertices
+		inline size_t total_packets() const {
+			return (m_size + lanes - 1) / lanes;
+		}
+
+		//! Check if an attribute is stored
+		inline bool is_stored(size_t attribute) const {
+			return m_offsets[attribute] != not_stored;
+		}
+
+		//! Get a bit mask of the stored attributes
+		size_t stored_attributes() const {
+			size_t mask = 0;
+			for(size_t a = 0;a < total_attributes;a++) {
+				if (is_stored(a))
+					mask |= size_t(1) << a;
+			}
+			return mask;
+		}
+
+		//! Change the number of vertices, keeping the stored attributes
+		void resize(size_t sz) {
+			m_size = sz;
+			m_data.resize(total_packets() * m_stride);
+		}
+
+		//! Change the number of vertices and the stored attributes
+		/**
+		 * Values are kept only if the stored attributes are the same.
+		 */
+		template<size_t... A>
+		void resize(size_t sz, index_sequence<A...>) {
+			clear_offsets();
+			m_stride = 0;
+			int expand[] = {0, (m_offsets[A] = m_stride, m_stride += components_of_attribute<A>::size * lanes, 0)...};
+			(void)expand;
+
+			m_size = sz;
+			m_data.resize(total_packets() * m_stride);
+		}
+
+		//! Free the memory beyond the current number of vertices
+		void shrink_to_fit() {
+			m_data.shrink_to_fit();
+		}
+
+		//! Copy vertices from an array of structures
+		template<class VerticesType>
+		void assign(const VerticesType & vertices) {
+			resize(vertices.size(), index_sequence<I...>());
+			update(vertices, 0, m_size);
+		}
+
+		//! Copy a range of vertices that were already assigned
+		/**
+		 * @param first The first vertex to copy
+		 * @param last The vertex after the last one to copy
+		 */
+		template<class VerticesType>
+		void update(const VerticesType & vertices, size_t first, size_t last) {
+			for(size_t v = first;v < last;v++)
+				set(v, vertices[v], index_sequence<I...>());
+		}
+
+		//! Load a packet of vertices
+		/**
+		 * Only the stored attributes are loaded.
+		 */
+		inline void load(size_t packet, packet_type & out) const {
+			int expand[] = {0, (load_attribute<I>(packet, thrust::get<I>(out)), 0)...};
+			(void)expand;
+		}
+
+		//! Gather a packet of vertices from an array of structures
+		/**
+		 * Used when vertices are not kept in structure of arrays
+		 * layout. Lanes past the last vertex repeat it.
+		 * @param first The first vertex of the packet
+		 * @param count Number of vertices in the packet, at least one
+		 */
+		template<class VerticesType>
+		static inline void gather(const VerticesType & vertices, size_t first, size_t count, packet_type & out) {
+			const vertex_type * lane_vertices[lanes];
+			for(size_t l = 0;l < lanes;l++)
+				lane_vertices[l] = &vertices[first + std::min(l, count - 1)];
+			int expand[] = {0, (gather_attribute<I>(lane_vertices, thrust::get<I>(out)), 0)...};
+			(void)expand;
+		}
+
+		//! Store some attributes of a packet of vertices
+		/**
+		 * All lanes are written, other attributes are left untouched.
+		 */
+		template<size_t... A>
+		inline void store(size_t packet, const packet_type & in, index_sequence<A...>) {
+			int expand[] = {0, (store_attribute<A>(packet, thrust::get<A>(in)), 0)...};
+			(void)expand;
+		}
+
+		//! Set some attributes of a vertex
+		template<size_t... A>
+		inline void set(size_t index, const vertex_type & in, index_sequence<A...>) {
+			int expand[] = {0, (set_attribute<A>(index, thrust::get<A>(in)), 0)...};
+			(void)expand;
+		}
+
+		//! Get some attributes of a vertex
+		/**
+		 * Other attributes of the output vertex are left untouched.
+		 */
+		template<size_t... A>
+		inline void get(size_t index, vertex_type & out, index_sequence<A...>) const {
+			int expand[] = {0, (get_attribute<A>(index, thrust::get<A>(out)), 0)...};
+			(void)expand;
+		}
+
+		//! Get one attribute of a vertex
+		template<size_t A>
+		inline typename thrust::tuple_element<A, vertex_type>::type attribute(size_t index) const {
+			return attribute_at<A>(vertex_data(index));
+		}
+
+		//! Get the position of a vertex in the blocks
+		/**
+		 * Stages that read several attributes of a vertex locate
+		 * it once, and then read them with attribute_at().
+		 */
+		inline const float * vertex_data(size_t index) const {
+			return &m_data[(index / lanes) * m_stride + index % lanes];
+		}
+
+		//! Get one attribute of a vertex located by vertex_data()
+		/**
+		 * Attributes that are not stored read as zero.
+		 */
+		template<size_t A>
+		inline typename thrust::tuple_element<A, vertex_type>::type attribute_at(const float * vertex) const {
+			typedef typename thrust::tuple_element<A, vertex_type>::type value_type;
+			if (!is_stored(A))
+				return value_type(0);
+			return components_of_attribute<A>::load(vertex + m_offsets[A], lanes);
+		}
+
+	private:
+
+		//! Number of attributes of vertex type
+		static const size_t total_attributes = sizeof...(I);
+
+		//! Offset of attributes that are not stored
+		static const size_t not_stored = size_t(-1);
+
+		//! Component access of an attribute
+		template<size_t A>
+		struct components_of_attribute : simd::components_of< typename thrust::tuple_element<A, vertex_type>::type > {};
+
+		//! Mark all attributes as not stored
+		void clear_offsets() {
+			for(size_t a = 0;a < total_attributes;a++)
+				m_offsets[a] = not_stored;
+		}
+
+		//! Get the first lane of the first component of an attribute in a block
+		template<size_t A>
+		inline float * attribute_data(size_t packet) {
+			return &m_data[packet * m_stride + m_offsets[A]];
+		}
+
+		template<size_t A>
+		inline const float * attribute_data(size_t packet) const {
+			return &m_data[packet * m_stride + m_offsets[A]];
+		}
+
+		template<size_t A, class T>
+		inline void load_attribute(size_t packet, simd::soa<T> & out) const {
+			if (!is_stored(A))
+				return;
+			const float * data = attribute_data<A>(packet);
+			for(size_t i = 0;i < components_of_attribute<A>::size;i++)
+				out.c[i] = simd::float4::load_aligned(data + i * lanes);
+		}
+
+		template<size_t A, class T>
+		static inline void gather_attribute(const vertex_type * const lane_vertices[lanes], simd::soa<T> & out) {
+			T lane_values[lanes];
+			for(size_t l = 0;l < lanes;l++)
+				lane_values[l] = thrust::get<A>(*lane_vertices[l]);
+			out = simd::soa<T>(lane_values);
+		}
+
+		template<size_t A, class T>
+		inline void store_attribute(size_t packet, const simd::soa<T> & in) {
+			float * data = attribute_data<A>(packet);
+			for(size_t i = 0;i < components_of_attribute<A>::size;i++)
+				in.c[i].store_aligned(data + i * lanes);
+		}
+
+		template<size_t A, class T>
+		inline void set_attribute(size_t index, const T & in) {
+			float * data = attribute_data<A>(index / lanes) + index % lanes;
+			for(size_t i = 0;i < components_of_attribute<A>::size;i++)
+				data[i * lanes] = components_of_attribute<A>::get(in, i);
+		}
+
+		template<size_t A, class T>
+		inline void get_attribute(size_t index, T & out) const {
+			out = attribute_at<A>(vertex_data(index));
+		}
+
+		//! All blocks
+		data_type m_data;
+
+		//! Number of vertices
+		size_t m_size;
+
+		//! Number of floats per block
+		size_t m_stride;
+
+		//! Offset of each attribute in a block, in floats
+		size_t m_offsets[total_attributes];
+	};
+}
 
 
 	//! A descriptive class of vertex_array datatype
@@ -25,6 +294,12 @@ namespace thrender {
 		//! The type of vector that hold all vertices
 		typedef thrust::host_vector<vertex_type> vertices_type;
 
+		//! The type of vertices in structure of arrays layout
+		typedef details::soa_vertices<vertex_type> soa_vertices_type;
+
+		//! The type of a packet of vertices processed together
+		typedef typename soa_vertices_type::packet_type packet_type;
+
 		//! Get the total number of attributes
 		inline static size_t total_attributes() {
 			return thrust::tuple_size<vertex_type>::value;
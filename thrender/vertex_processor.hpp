@@ -1,9 +1,16 @@
 #pragma once
 
+#include <algorithm>
 #include "./types.hpp"
 #include "./render_context.hpp"
 #include "./renderable.hpp"
-#include <thrust/iterator/zip_iterator.h>
+#include "./clipping.hpp"
+#include "./varyings.hpp"
+#include "./shader_hooks.hpp"
+#include <type_traits>
+#include <utility>
+#include <thrust/for_each.h>
+#include <thrust/iterator/counting_iterator.h>
 
 namespace thrender {
 
@@ -22,8 +29,14 @@ namespace thrender {
 		//! Type of vertex
 		typedef typename renderable_type::vertex_type vertex_type;
 
+		//! Type of vertex id
+		typedef typename renderable_type::vertex_id_type vertex_id_type;
+
 		//! The id of this vertex
-		vertex_id_t vertex_id;
+		vertex_id_type vertex_id;
+
+		//! The instance this vertex belongs to, or its object in a batch
+		size_t instance_id;
 
 		//! Reference to the owner object
 		const renderable_type & object;
@@ -32,58 +45,179 @@ namespace thrender {
 		render_context & context;
 
 		//! Construct control on vertex processing
-		vertex_processing_control(const renderable_type & _object, render_context & _context, vertex_id_t _vertex_id)
+		/**
+		 * @param _instance_id The draw of the vertex, looked up once
+		 * by the caller
+		 */
+		vertex_processing_control(const renderable_type & _object, render_context & _context, vertex_id_type _vertex_id, size_t _instance_id)
 		:
 			vertex_id(_vertex_id),
+			instance_id(_instance_id),
 			object(_object),
 			context(_context)
 		{}
 
+		//! Get the data of the instance being drawn
+		/**
+		 * Valid only inside pipeline::draw_instanced() and
+		 * pipeline::draw_batch(), with the type of instance
+		 * data or uniforms passed there.
+		 */
+		template<class InstanceType>
+		inline const InstanceType & instance() const {
+			return object.intermediate_buffer().template instance<InstanceType>(instance_id);
+		}
+
 		//! Drops the current vertex as discarded
 		/**
 		 * If a vertex is discarded, all the related elements
 		 * are discarded too.
 		 */
 		void discard() const{
-			const_cast<renderable_type &>(object).intermediate_buffer.discarded_vertices[vertex_id] = true;
+			const_cast<renderable_type &>(object).intermediate_buffer().discarded_vertices[vertex_id] = true;
 		}
 
 		//! Translate clip coordinates to window space
+		/**
+		 * The clip space position is kept aside for clipping. The w
+		 * component is replaced by 1/w of clip space, which is needed
+		 * for perspective correct interpolation.
+		 */
 		template<class V>
 		void translate_to_window_space(V & pos) {
-
-			// normalized device coordinates
-			pos = pos / pos.w;
-
-			// window space
-			pos.x = context.vp.left() + (pos.x * context.vp.half_width()) + context.vp.half_width();
-			pos.y = context.vp.top() + (pos.y * context.vp.half_height()) + context.vp.half_height();
-			pos.z = context.depth_range.translate_to_window_space(pos.z);
+			intermediate_buffer().clip_positions[vertex_id] = pos;
+			context.translate_to_window_space(pos);
 		}
 
 		//! Viewport clipping
 		/**
-		 * It will check if vertex is in the limits of viewport
-		 * and rendering frustum and will discard the vertex
-		 * if not.
+		 * Must be called after translate_to_window_space(). It marks
+		 * the vertex against the near and far planes and the guard band.
+		 * Primitives outside of any plane are dropped, while those
+		 * crossing a plane are clipped by the primitive processor.
+		 * Pixels outside the viewport are scissored at rasterization.
 		 */
 		template<class V>
-		void viewport_clip(V & pos) {
-
-			if (pos.x >= context.vp.width()	|| pos.x < 0
-					|| pos.y > context.vp.height() || pos.y < 0
-					|| pos.z < context.depth_range.near() || pos.z > context.depth_range.far()
-					// FixME: Why z must be opposite of near and far?
-				)
-			{
-				discard();
+		void viewport_clip(V &) {
+			intermediate_buffer().clip_codes[vertex_id] = details::clip_code(intermediate_buffer().clip_positions[vertex_id]);
+		}
+
+	private:
+
+		//! Get the writable intermediate buffer of the object
+		inline typename renderable_type::intermediate_buffer_type & intermediate_buffer() const {
+			return const_cast<renderable_type &>(object).intermediate_buffer();
+		}
+	};
+
+	//! Vertex packet processing control mechanism
+	/**
+	 * The counterpart of vertex_processing_control for vertex
+	 * shaders that process a packet of consecutive vertices at
+	 * once. Lanes past the end of the vertex array are inactive.
+	 */
+	template<class RenderableType>
+	struct vertex_packet_control {
+
+		//! Type of renderable object
+		typedef RenderableType renderable_type;
+
+		//! Type of packet of vertices
+		typedef typename renderable_type::vertex_packet_type packet_type;
+
+		//! Type of vertex id
+		typedef typename renderable_type::vertex_id_type vertex_id_type;
+
+		//! Number of vertices per packet
+		static const size_t lanes = simd::float4::lanes;
+
+		//! The id of the first vertex of the packet
+		vertex_id_type vertex_id;
+
+		//! The instance all vertices of the packet belong to
+		size_t instance_id;
+
+		//! Number of active lanes, starting from the first
+		size_t active_lanes;
+
+		//! Reference to the owner object
+		const renderable_type & object;
+
+		//! Reference to current render context
+		render_context & context;
+
+		//! Construct control on packet processing
+		/**
+		 * @param _instance_id The draw of the packet, looked up once
+		 * by the caller
+		 */
+		vertex_packet_control(const renderable_type & _object, render_context & _context, vertex_id_type _vertex_id, size_t _instance_id, size_t _active_lanes)
+		:
+			vertex_id(_vertex_id),
+			instance_id(_instance_id),
+			active_lanes(_active_lanes),
+			object(_object),
+			context(_context)
+		{}
+
+		//! Get the data of the instance being drawn
+		/**
+		 * @see vertex_processing_control::instance()
+		 */
+		template<class InstanceType>
+		inline const InstanceType & instance() const {
+			return object.intermediate_buffer().template instance<InstanceType>(instance_id);
+		}
+
+		//! Check if a lane holds a vertex
+		inline bool is_active(size_t lane) const {
+			return lane < active_lanes;
+		}
+
+		//! Drops the vertex of a lane as discarded
+		void discard(size_t lane) const {
+			if (is_active(lane))
+				intermediate_buffer().discarded_vertices[vertex_id + lane] = true;
+		}
+
+		//! Translate clip coordinates of all lanes to window space
+		/**
+		 * Clip coordinates of the active lanes are kept for clipping.
+		 * @see render_context::translate_to_window_space()
+		 */
+		void translate_to_window_space(simd::soa<glm::vec4> & pos) {
+			glm::vec4 lane_positions[lanes];
+			pos.extract(lane_positions);
+			for(size_t l = 0;l < active_lanes;l++)
+				intermediate_buffer().clip_positions[vertex_id + l] = lane_positions[l];
+			context.translate_to_window_space(pos);
+		}
+
+		//! Viewport clipping of all lanes
+		/**
+		 * @see vertex_processing_control::viewport_clip()
+		 */
+		void viewport_clip(simd::soa<glm::vec4> &) {
+			for(size_t l = 0;l < active_lanes;l++) {
+				intermediate_buffer().clip_codes[vertex_id + l] =
+						details::clip_code(intermediate_buffer().clip_positions[vertex_id + l]);
 			}
 		}
+
+	private:
+
+		//! Get the writable intermediate buffer of the object
+		inline typename renderable_type::intermediate_buffer_type & intermediate_buffer() const {
+			return const_cast<renderable_type &>(object).intermediate_buffer();
+		}
 	};
 
 	//! Kernel for processing vertices
 	/**
-	 * Unwraps vertex parameters to the vertex shaders API
+	 * Unwraps vertex parameters to the vertex shaders API.
+	 * Runs once per vertex of every draw. Only the attributes
+	 * that the shader outputs are copied from the input vertex
+	 * and stored in the processed vertices.
 	 */
 	template <class VertexShader, class RenderableType>
 	struct vertex_processor_kernel {
@@ -94,45 +228,247 @@ namespace thrender {
 		//! Type of renderable object
 		typedef RenderableType renderable_type;
 
+		//! Attributes that the shader outputs
+		typedef typename details::output_attributes<shader_type, typename renderable_type::vertex_type>::type output_attributes;
+
+		//! Attributes that are copied from the input vertex
+		typedef typename details::pass_through_attributes<shader_type, typename renderable_type::vertex_type>::type pass_through_attributes;
+
 		//! Reference to shader
 		shader_type & shader;
 
 		//! Reference to renderable object
-		const renderable_type & object;
+		renderable_type & object;
 
 		//! Reference to context
 		render_context & context;
 
 		//! Initialize by referencing the wrapped shader
-		vertex_processor_kernel(shader_type & _shader, const renderable_type & _object, render_context & _context)
+		vertex_processor_kernel(shader_type & _shader, renderable_type & _object, render_context & _context)
 		:
 			shader(_shader),
 			object(_object),
 			context(_context)
 		{}
 
-		template<class T>
-		void operator()(T & v) {
-			vertex_processing_control<renderable_type> vcontrol(object, context, thrust::get<2>(v));
-			thrust::get<1>(v) = thrust::get<0>(v);
-			shader(thrust::get<0>(v), thrust::get<1>(v), vcontrol);
+		void operator()(typename renderable_type::vertex_id_type id) {
+			typename renderable_type::intermediate_buffer_type & ib = object.intermediate_buffer();
+			size_t draw = ib.draw_of_vertex(id);
+			vertex_processing_control<renderable_type> vcontrol(object, context, id, draw);
+			ib.discarded_vertices[id] = false;
+			ib.clip_codes[id] = 0;
+
+			// Padding after the last packet of a draw
+			const typename renderable_type::intermediate_buffer_type::draw_range & range = ib.draws[draw];
+			if (id - range.first_vertex >= range.vertices->size())
+				return;
+
+			const typename renderable_type::vertex_type & vin = (*range.vertices)[id - range.first_vertex];
+			typename renderable_type::vertex_type vout;
+			details::copy_attributes<pass_through_attributes>::copy(vin, vout);
+			shader(vin, vout, vcontrol);
+			ib.processed_vertices.set(id, vout, output_attributes());
 		}
 
 	};
 
+	//! Kernel for processing packets of vertices
+	/**
+	 * Loads a packet from the structure of arrays input, or gathers
+	 * it from the vertices if the source does not keep one, runs the
+	 * packet overload of the shader and stores the attributes it
+	 * outputs with one aligned store per component. Packets never
+	 * span two draws, lanes past the end of a draw are padding.
+	 */
+	template <class VertexShader, class RenderableType>
+	struct vertex_packet_processor_kernel {
+
+		//! Type of vertex shader
+		typedef VertexShader shader_type;
+
+		//! Type of renderable object
+		typedef RenderableType renderable_type;
+
+		//! Type of vertex
+		typedef typename renderable_type::vertex_type vertex_type;
+
+		//! Type of packet of vertices
+		typedef typename renderable_type::vertex_packet_type packet_type;
+
+		//! Type of vertex streams
+		typedef typename renderable_type::vertex_array_type::soa_vertices_type soa_vertices_type;
+
+		//! Attributes that the shader outputs
+		typedef typename details::output_attributes<shader_type, vertex_type>::type output_attributes;
+
+		//! Attributes that are copied from the input vertex
+		typedef typename details::pass_through_attributes<shader_type, vertex_type>::type pass_through_attributes;
+
+		//! Number of vertices per packet
+		static const size_t lanes = soa_vertices_type::lanes;
+
+		//! Reference to shader
+		shader_type & shader;
+
+		//! Reference to renderable object
+		renderable_type & object;
+
+		//! Reference to context
+		render_context & context;
+
+		//! Initialize by referencing the wrapped shader
+		vertex_packet_processor_kernel(shader_type & _shader, renderable_type & _object, render_context & _context)
+		:
+			shader(_shader),
+			object(_object),
+			context(_context)
+		{}
+
+		void operator()(size_t packet) {
+			typename renderable_type::intermediate_buffer_type & ib = object.intermediate_buffer();
+			size_t draw = ib.draw_of_packet(packet);
+			const typename renderable_type::intermediate_buffer_type::draw_range & range = ib.draws[draw];
+			size_t input_packet = packet - range.first_packet;
+			size_t input_first = input_packet * lanes;
+			size_t first = packet * lanes;
+			size_t active_lanes = std::min(size_t(lanes), range.vertices->size() - input_first);
+			for(size_t l = 0;l < active_lanes;l++) {
+				ib.discarded_vertices[first + l] = false;
+				ib.clip_codes[first + l] = 0;
+			}
+
+			packet_type vin;
+			if (range.vertex_streams->size())
+				range.vertex_streams->load(input_packet, vin);
+			else
+				soa_vertices_type::gather(*range.vertices, input_first, active_lanes, vin);
+			packet_type vout;
+			details::copy_attributes<pass_through_attributes>::copy(vin, vout);
+			vertex_packet_control<renderable_type> vcontrol(object, context, first, draw, active_lanes);
+			shader(vin, vout, vcontrol);
+
+			ib.processed_vertices.store(packet, vout, output_attributes());
+		}
+	};
+
+namespace details {
+
+	//! Check if a vertex shader can process packets of vertices
+	template<class VertexShader, class RenderableType>
+	struct has_vertex_packet_operator {
+
+		template<class S>
+		static std::true_type test(int, decltype(std::declval<S &>()(
+			std::declval<const typename RenderableType::vertex_packet_type &>(),
+			std::declval<typename RenderableType::vertex_packet_type &>(),
+			std::declval<vertex_packet_control<RenderableType> &>())) * = 0);
+
+		template<class S>
+		static std::false_type test(...);
+
+		//! std::true_type if the overload exists
+		typedef decltype(test<VertexShader>(0)) type;
+
+		static const bool value = type::value;
+	};
+
+	//! Run a vertex shader one vertex at a time
+	/**
+	 * @param first The id of the first vertex to process
+	 * @param last The id after the last vertex to process
+	 * @return The id after the last processed vertex
+	 */
+	template<class VertexShader, class RenderableType>
+	size_t run_vertex_shader(RenderableType & object, VertexShader & shader, render_context & context,
+			size_t first, size_t last, std::false_type) {
+		thrust::counting_iterator<typename RenderableType::vertex_id_type> count_begin(first);
+		thrust::for_each(
+			count_begin,
+			count_begin + (last - first),
+			vertex_processor_kernel<VertexShader, RenderableType>(shader, object, context));		// Operation
+		return last;
+	}
+
+	//! Run a vertex shader one packet of vertices at a time
+	/**
+	 * Whole packets are processed, so vertices up to the end of
+	 * the packet of the last vertex are processed too.
+	 * @return The id after the last processed vertex, padding
+	 * of the last packet included
+	 */
+	template<class VertexShader, class RenderableType>
+	size_t run_vertex_shader(RenderableType & object, VertexShader & shader, render_context & context,
+			size_t first, size_t last, std::true_type) {
+		if (first >= last)
+			return first;
+
+		const typename RenderableType::intermediate_buffer_type & ib = object.intermediate_buffer();
+		object.update_vertex_streams();
+		size_t first_packet = ib.packet_of_vertex(first);
+		size_t last_packet = ib.packet_of_vertex(last - 1);
+		thrust::counting_iterator<size_t> packets_begin(first_packet);
+		thrust::for_each(
+			packets_begin,
+			packets_begin + (last_packet + 1 - first_packet),
+			vertex_packet_processor_kernel<VertexShader, RenderableType>(shader, object, context));
+		return ib.packet_end(last_packet);
+	}
+
+	//! Run a vertex shader on a range of vertices of a prepared object
+	/**
+	 * @return The id after the last processed vertex
+	 */
+	template<class VertexShader, class RenderableType>
+	inline size_t run_vertex_shader(RenderableType & object, VertexShader & shader, render_context & context,
+			size_t first, size_t last) {
+		// Store only the outputs of the shader, values are kept if they are already
+		typename RenderableType::intermediate_buffer_type & ib = object.intermediate_buffer();
+		ib.processed_vertices.resize(ib.total_vertices(),
+				typename output_attributes<VertexShader, typename RenderableType::vertex_type>::type());
+
+		return run_vertex_shader(object, shader, context, first, last,
+				typename has_vertex_packet_operator<VertexShader, RenderableType>::type());
+	}
+}
+
 	//! Process vertices and extract projected on window space
+	/**
+	 * If the shader has an overload for packets of vertices, it is
+	 * preferred. Packets are read from the structure of arrays copy
+	 * of the object, if it keeps one. The prepare and finish hooks
+	 * of the shader are called before and after the vertices.
+	 * @see renderable::keep_vertex_streams()
+	 */
 	template<class VertexShader, class RenderableType>
 	void process_vertices(RenderableType & object, VertexShader & shader, render_context & context) {
 
 		// Prepare object
-		object.prepare_for_rendering();
+		object.prepare_for_rendering(context);
 
 		// Process vertices
-		size_t total_vertices = object.vertices.size();
-		thrust::counting_iterator<vertex_id_t> count_begin(0);
-		thrust::for_each(
-			thrust::make_zip_iterator(thrust::make_tuple(object.vertices.cbegin(), object.intermediate_buffer.processed_vertices.begin(), count_begin)),
-			thrust::make_zip_iterator(thrust::make_tuple(object.vertices.cend(), object.intermediate_buffer.processed_vertices.end(), count_begin + total_vertices)),
-			vertex_processor_kernel<VertexShader, RenderableType>(shader, object, context));		// Operation
+		details::prepare_shader(shader, context);
+		details::run_vertex_shader(object, shader, context, 0, object.intermediate_buffer().total_vertices());
+		details::finish_shader(shader, context);
+	}
+
+	//! Process vertices of many instances of an object at once
+	/**
+	 * Vertices of all instances are processed in one parallel pass.
+	 * Shaders can access the data of the instance from their control.
+	 * @param instance_data Array with the data of each instance, it
+	 * must be valid until fragments of the object are processed.
+	 * @param instances Number of instances
+	 */
+	template<class VertexShader, class RenderableType, class InstanceType>
+	void process_vertices(RenderableType & object, VertexShader & shader, render_context & context,
+			const InstanceType * instance_data, size_t instances) {
+
+		// Prepare object
+		object.prepare_for_rendering(context, instance_data, instances);
+
+		// Process vertices
+		details::prepare_shader(shader, context);
+		details::run_vertex_shader(object, shader, context, 0, object.intermediate_buffer().total_vertices());
+		details::finish_shader(shader, context);
 	}
 }
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "./render_context.hpp"
+#include "./fragment_processor.hpp"
+#include <stdexcept>
+#include <typeinfo>
+#include <thrust/for_each.h>
+#include <thrust/iterator/counting_iterator.h>
+
+namespace thrender {
+namespace details {
+
+	//! Fragment shader that writes the id of visible primitives
+	struct visibility_fg_shader {
+
+		//! The visibility id of the first primitive of the object
+		visibility_pixel_t first_id;
+
+		visibility_fg_shader(visibility_pixel_t _first_id)
+		:
+			first_id(_first_id)
+		{}
+
+		template<class RenderableType>
+		void operator()(framebuffer_array & fb, const fragment_processing_control<RenderableType> & api) {
+			fb.visibility_buffer()[api.framebuffer_y][api.framebuffer_x] = first_id + api.primitive_id;
+		}
+
+		template<class RenderableType>
+		void operator()(framebuffer_array & fb, const fragment_packet_control<RenderableType> & api) {
+			for(size_t l = 0;l < api.lanes;l++) {
+				if (api.is_active(l))
+					fb.visibility_buffer()[api.lane_y(l)][api.lane_x(l)] = first_id + api.primitive_id;
+			}
+		}
+	};
+
+	//! Throw if an object was drawn in the visibility buffer since it was cleared
+	template<class RenderableType>
+	void check_visibility_redraw(const RenderableType & object, render_context & context) {
+		if (!object.has_intermediate_buffer())
+			return;
+		visibility_pixel_t base = object.intermediate_buffer().visibility_base;
+		const framebuffer_array::visibility_range * range = context.fb.find_visibility_range(base);
+		if (range && range->first == base && range->owner == &object)
+			throw std::logic_error("Object is drawn twice in the visibility buffer");
+	}
+
+	//! Kernel to shade the visible pixels of all objects of a type, one row at a time
+	template<class FragmentShader, class RenderableType>
+	struct visibility_resolve_kernel {
+
+		//! Type of fragment shader
+		typedef FragmentShader fragment_shader;
+
+		//! Type of the rendererable object
+		typedef RenderableType renderable_type;
+
+		//! Type of a range of visibility ids
+		typedef framebuffer_array::visibility_range visibility_range;
+
+		//! Reference to current rendering context
+		render_context & context;
+
+		//! Reference to fragment shader
+		fragment_shader & shader;
+
+		//! Construct the kernel for a specific context
+		visibility_resolve_kernel(fragment_shader & _shader, render_context & _context)
+		:
+			context(_context),
+			shader(_shader)
+		{}
+
+		//! Get the object that reserved a range, if it can be resolved
+		static const renderable_type * resolved_object(const visibility_range * range) {
+			if (!range || *range->type != typeid(renderable_type))
+				return 0;
+			const renderable_type * object = static_cast<const renderable_type *>(range->owner);
+			if (!object->has_intermediate_buffer() || object->intermediate_buffer().visibility_base != range->first)
+				return 0;
+			return object;
+		}
+
+		void operator()(window_size_t y) {
+			const visibility_pixel_t * ids = context.fb.visibility_buffer()[y];
+
+			// Neighbour pixels are mostly of the same object
+			const visibility_range * range = 0;
+			const renderable_type * object = 0;
+			for(window_size_t x = context.vp.left();x < context.vp.right();x++) {
+				if (ids[x] == default_visibility_clear_value)
+					continue;
+
+				if (!range || ids[x] - range->first >= range->count) {
+					range = context.fb.find_visibility_range(ids[x]);
+					object = resolved_object(range);
+				}
+				if (!object)
+					continue;
+
+				primitive_id_t id = ids[x] - range->first;
+				const typename renderable_type::intermediate_buffer_type & ib = object->intermediate_buffer();
+				const typename renderable_type::triangle_setup_type & setup = ib.setups[id];
+				fragment_processing_control<renderable_type> fgcontrol(*object, context, id, ib.draw_of_element(id), ib.element(id), setup);
+				fgcontrol.set_fragment(x, y, setup.edges.evaluate(x + 0.5f, y + 0.5f));
+				shader(context.fb, fgcontrol);
+			}
+		}
+	};
+}
+
+	//! Rasterize the primitives of an object in the visibility buffer
+	/**
+	 * Depth test and write are done as usual, but instead of shading
+	 * the id of the primitive is written in the visibility buffer.
+	 * Primitives must have been setup with process_primitives().
+	 * @throw std::logic_error If object was already drawn in the
+	 * visibility buffer since it was cleared, as the primitives
+	 * of the first draw would be lost.
+	 */
+	template<class RenderableType>
+	void process_visibility(RenderableType & object, render_context & context) {
+		details::check_visibility_redraw(object, context);
+		typename RenderableType::intermediate_buffer_type & ib = object.intermediate_buffer();
+		ib.visibility_base = context.fb.reserve_visibility_ids(ib.setups.size(), object);
+
+		details::visibility_fg_shader shader(ib.visibility_base);
+		details::run_fragments(object, shader, context, depth_test_mode::early);
+	}
+
+	//! Shade the pixels of the visibility buffer that belong to objects of a type
+	/**
+	 * Each pixel is shaded exactly once, regardless of the depth
+	 * complexity of the scene, in one pass over the visibility
+	 * buffer. Objects are found by the ranges of ids they reserved.
+	 * Attributes are evaluated from the setup of the visible
+	 * primitive, so objects must still hold the buffers of
+	 * process_visibility(). Pixels of objects of other types are
+	 * left as they are. The prepare and finish hooks of the shader
+	 * are called before and after the pixels.
+	 */
+	template<class RenderableType, class FragmentShader>
+	void resolve_visibility(FragmentShader & shader, render_context & context) {
+		details::prepare_shader(shader, context);
+		thrust::counting_iterator<window_size_t> rows_begin(context.vp.top());
+		thrust::for_each(
+				rows_begin,
+				rows_begin + context.vp.height(),
+				details::visibility_resolve_kernel<FragmentShader, RenderableType>(shader, context));
+		details::finish_shader(shader, context);
+	}
+}